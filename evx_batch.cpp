@@ -0,0 +1,538 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_batch.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_batch.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#define EVX_BATCH_ALIGNMENT             (4096)
+#define EVX_BATCH_MAX_REGISTERED_SIZE   (1024 * EVX_MB)
+#define EVX_BATCH_PENDING               (-0x7FFFFFFF)
+
+#if defined(__linux__)
+
+// The rings are mapped and driven directly through the system calls, as 
+// described in io_uring(7), so no additional library is required.
+typedef struct EVX_URING
+{
+    int32 fd;
+    bool registered;            // true if the buffer is registered for fixed reads.
+    iovec *vectors;             // one per slot, for vectored reads when not registered.
+
+    uint8 *sq_ring;
+    size_t sq_ring_size;
+    uint8 *cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    uint32 *sq_head;
+    uint32 *sq_tail;
+    uint32 *sq_array;
+    uint32 sq_mask;
+
+    uint32 *cq_head;
+    uint32 *cq_tail;
+    io_uring_cqe *cqes;
+    uint32 cq_mask;
+
+} EVX_URING;
+
+int32 _uring_setup(uint32 entries, io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int32 _uring_enter(int32 fd, uint32 submit_count, uint32 wait_count, uint32 flags)
+{
+    return syscall(__NR_io_uring_enter, fd, submit_count, wait_count, flags, NULL, 0);
+}
+
+int32 _uring_register(int32 fd, uint32 opcode, void *args, uint32 count)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, args, count);
+}
+
+void _close_uring(EVX_URING *ring)
+{
+    delete [] ring->vectors;
+
+    if (ring->sqes)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+
+    if (ring->sq_ring)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+
+    delete ring;
+}
+
+uint8 *_map_ring(int32 fd, size_t size, uint64 offset)
+{
+    void *address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+
+    return (MAP_FAILED == address) ? NULL : (uint8 *) address;
+}
+
+EVX_URING *_open_uring(uint32 entries)
+{
+    io_uring_params params;
+    EVX_URING *ring = new EVX_URING;
+
+    memset(ring, 0, sizeof(EVX_URING));
+    memset(&params, 0, sizeof(params));
+
+    ring->vectors = new iovec[entries];
+    ring->fd = _uring_setup(entries, &params);
+
+    if (ring->fd < 0)
+    {
+        _close_uring(ring);
+        return NULL;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    // Newer kernels share a single mapping between both rings.
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_ring_size = max(ring->sq_ring_size, ring->cq_ring_size);
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = _map_ring(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_ring : 
+                    _map_ring(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    ring->sqes = (io_uring_sqe *) _map_ring(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+
+    if (!ring->sq_ring || !ring->cq_ring || !ring->sqes)
+    {
+        _close_uring(ring);
+        return NULL;
+    }
+
+    ring->sq_head = (uint32 *) (ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (uint32 *) (ring->sq_ring + params.sq_off.tail);
+    ring->sq_array = (uint32 *) (ring->sq_ring + params.sq_off.array);
+    ring->sq_mask = *(uint32 *) (ring->sq_ring + params.sq_off.ring_mask);
+
+    ring->cq_head = (uint32 *) (ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (uint32 *) (ring->cq_ring + params.cq_off.tail);
+    ring->cqes = (io_uring_cqe *) (ring->cq_ring + params.cq_off.cqes);
+    ring->cq_mask = *(uint32 *) (ring->cq_ring + params.cq_off.ring_mask);
+
+    return ring;
+}
+
+// Unregistered reads are vectored, as IORING_OP_READ was only added in 
+// Linux 5.6 while IORING_OP_READV is available wherever io_uring is. The
+// slot's vector stays untouched until its read completes.
+void _queue_read(EVX_URING *ring, int32 fd, uint32 slot, uint8 *dest, uint32 size, uint64 offset, uint64 user_data)
+{
+    uint32 tail = *ring->sq_tail;
+    uint32 index = tail & ring->sq_mask;
+    io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+
+    if (ring->registered)
+    {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uint64) (uintptr_t) dest;
+        sqe->len = size;
+        sqe->buf_index = 0;
+    }
+    else
+    {
+        ring->vectors[slot].iov_base = dest;
+        ring->vectors[slot].iov_len = size;
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (uint64) (uintptr_t) &ring->vectors[slot];
+        sqe->len = 1;
+    }
+
+    ring->sq_array[index] = index;
+
+    // The kernel must see the entry before it sees the new tail.
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void _reap_completions(EVX_BATCH_READER *reader)
+{
+    EVX_URING *ring = reader->ring;
+    uint32 head = *ring->cq_head;
+    uint32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+    {
+        io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+
+        reader->results[cqe->user_data % reader->depth] = cqe->res;
+        reader->in_flight--;
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Keeps the window of depth requests that follow the next frame in flight.
+int32 _submit_reads(EVX_BATCH_READER *reader)
+{
+    uint64 limit = min((uint64) reader->requests.size(), reader->next_request + reader->depth);
+    uint32 count = 0;
+
+    for (; reader->submitted_count < limit; reader->submitted_count++, count++)
+    {
+        const EVX_BATCH_REQUEST &request = reader->requests[reader->submitted_count];
+        uint32 slot = reader->submitted_count % reader->depth;
+
+        reader->results[slot] = EVX_BATCH_PENDING;
+        reader->in_flight++;
+
+        _queue_read(reader->ring, reader->files[request.file], slot, reader->buffer + (uint64) slot * reader->slot_size, 
+                    request.size, request.offset, reader->submitted_count);
+    }
+
+    while (count)
+    {
+        int32 result = _uring_enter(reader->ring->fd, count, 0, 0);
+
+        if (result < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            return -1;
+        }
+
+        count -= result;
+    }
+
+    return 0;
+}
+
+int32 _wait_for_slot(EVX_BATCH_READER *reader, uint32 slot)
+{
+    _reap_completions(reader);
+
+    while (EVX_BATCH_PENDING == reader->results[slot])
+    {
+        if (_uring_enter(reader->ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && EINTR != errno)
+        {
+            return -1;
+        }
+
+        _reap_completions(reader);
+    }
+
+    return 0;
+}
+
+#else
+
+typedef struct EVX_URING
+{
+    int32 fd;
+
+} EVX_URING;
+
+#endif
+
+bool _read_fully(int32 fd, uint8 *dest, uint32 size, uint64 offset)
+{
+    while (size)
+    {
+        ssize_t count = pread(fd, dest, size, offset);
+
+        if (count < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        dest += count;
+        size -= count;
+        offset += count;
+    }
+
+    return true;
+}
+
+// Slots are sized for the largest record queued, and aligned so that reads
+// land on page boundaries.
+int32 _prepare_buffer(EVX_BATCH_READER *reader)
+{
+    uint32 largest_size = 0;
+    void *buffer = NULL;
+
+    for (size_t i = 0; i < reader->requests.size(); i++)
+    {
+        largest_size = max(largest_size, reader->requests[i].size);
+    }
+
+    reader->slot_size = (largest_size + EVX_BATCH_ALIGNMENT - 1) & ~(EVX_BATCH_ALIGNMENT - 1);
+
+    uint64 buffer_size = (uint64) reader->slot_size * reader->depth;
+
+    if (0 != posix_memalign(&buffer, EVX_BATCH_ALIGNMENT, buffer_size))
+    {
+        evx_msg("Failed to allocate %llu bytes for batched reads", buffer_size);
+        return -1;
+    }
+
+    reader->buffer = (uint8 *) buffer;
+
+#if defined(__linux__)
+    // Registration pins the buffer once, rather than on every read. It may
+    // be refused under a low memlock limit, in which case reads still go 
+    // through the ring, just without fixed buffers.
+    if (reader->ring && buffer_size <= EVX_BATCH_MAX_REGISTERED_SIZE)
+    {
+        iovec region = { reader->buffer, buffer_size };
+        reader->ring->registered = (0 == _uring_register(reader->ring->fd, IORING_REGISTER_BUFFERS, &region, 1));
+    }
+#endif
+
+    return 0;
+}
+
+int32 evx_batch_open(uint32 depth, EVX_BATCH_READER *reader)
+{
+    reader->files.clear();
+    reader->requests.clear();
+    reader->depth = min(max(depth, 1u), (uint32) EVX_BATCH_MAX_DEPTH);
+    reader->results.assign(reader->depth, 0);
+    reader->submitted_count = 0;
+    reader->next_request = 0;
+    reader->in_flight = 0;
+    reader->holding = false;
+    reader->buffer = NULL;
+    reader->slot_size = 0;
+    reader->ring = NULL;
+
+#if defined(__linux__)
+    reader->ring = _open_uring(reader->depth);
+
+    if (!reader->ring)
+    {
+        evx_msg("io_uring is unavailable, reading with pread");
+    }
+#endif
+
+    return 0;
+}
+
+void evx_batch_close(EVX_BATCH_READER *reader)
+{
+#if defined(__linux__)
+    if (reader->ring)
+    {
+        // Reads still in flight target the buffer, so they must finish first.
+        while (reader->in_flight && _wait_for_slot(reader, reader->submitted_count % reader->depth) >= 0);
+
+        _close_uring(reader->ring);
+        reader->ring = NULL;
+    }
+#endif
+
+    free(reader->buffer);
+    reader->buffer = NULL;
+
+    for (size_t i = 0; i < reader->files.size(); i++)
+    {
+        close(reader->files[i]);
+    }
+
+    reader->files.clear();
+    reader->requests.clear();
+}
+
+int32 evx_batch_add_file(EVX_BATCH_READER *reader, const char *filename, const EVX_FRAME_INDEX &index)
+{
+    // The slots are sized when reading starts.
+    if (reader->buffer)
+    {
+        evx_msg("Files must be added before reading begins");
+        return -1;
+    }
+
+    int32 fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        evx_msg("Error opening source file %s", filename);
+        return -1;
+    }
+
+    uint32 file = reader->files.size();
+    reader->files.push_back(fd);
+
+    for (size_t i = 0; i < index.frames.size(); i++)
+    {
+        EVX_BATCH_REQUEST request;
+
+        request.file = file;
+        request.frame_index = index.frames[i].frame_index;
+        request.offset = index.frames[i].offset;
+        request.size = index.frames[i].record_size;
+
+        reader->requests.push_back(request);
+    }
+
+    return file;
+}
+
+int32 evx_batch_next_frame(EVX_BATCH_READER *reader, EVX_BATCH_FRAME *frame)
+{
+    // The previous frame's slot may only be reused once it has been released.
+    if (reader->holding)
+    {
+        reader->next_request++;
+        reader->holding = false;
+    }
+
+    if (reader->next_request >= reader->requests.size())
+    {
+        return 1;
+    }
+
+    const EVX_BATCH_REQUEST &request = reader->requests[reader->next_request];
+    uint32 slot = reader->next_request % reader->depth;
+    int64 result = 0;
+
+    frame->file = request.file;
+    frame->frame_index = request.frame_index;
+    frame->payload = NULL;
+
+    // Without a buffer nothing further can be read, so the remaining 
+    // requests are abandoned.
+    if (!reader->buffer && 0 != _prepare_buffer(reader))
+    {
+        reader->next_request = reader->requests.size();
+        return -1;
+    }
+
+    uint8 *data = reader->buffer + (uint64) slot * reader->slot_size;
+    reader->holding = true;
+
+#if defined(__linux__)
+    if (reader->ring)
+    {
+        if (_submit_reads(reader) < 0 || _wait_for_slot(reader, slot) < 0)
+        {
+            evx_msg("Error waiting for batched reads: %s", strerror(errno));
+            return -1;
+        }
+
+        result = reader->results[slot];
+
+        if (result < 0)
+        {
+            evx_msg("Error reading frame %llu: %s", request.frame_index, strerror((int32) -result));
+            return -1;
+        }
+    }
+#endif
+
+    // Short reads are completed here. Without io_uring this reads the whole
+    // record.
+    if (result < request.size && !_read_fully(reader->files[request.file], data + result, request.size - result, request.offset + result))
+    {
+        evx_msg("Error reading frame %llu", request.frame_index);
+        return -1;
+    }
+
+    const EVX_MEDIA_RECORD_HEADER *record = (const EVX_MEDIA_RECORD_HEADER *) data;
+
+    if (record->header_size < sizeof(EVX_MEDIA_RECORD_HEADER) || record->header_size > request.size)
+    {
+        evx_msg("Invalid frame header for frame %llu", request.frame_index);
+        return -1;
+    }
+
+    // Fields introduced after the record was written are left zeroed.
+    memset(&frame->header, 0, sizeof(EVX_MEDIA_FRAME_HEADER));
+    memcpy(&frame->header, data, min(record->header_size, (uint32) sizeof(EVX_MEDIA_FRAME_HEADER)));
+
+    if (record->header_size + frame->header.frame_size != request.size)
+    {
+        evx_msg("Frame %llu does not match the index", request.frame_index);
+        return -1;
+    }
+
+    frame->payload = data + record->header_size;
+
+    return 0;
+}
+
+bool evx_batch_is_async(EVX_BATCH_READER *reader)
+{
+    return NULL != reader->ring;
+}
+
+#endif
@@ -0,0 +1,104 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_batch.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_BATCH_H__
+#define __EVX_BATCH_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+#include "evx_index.h"
+
+#include <vector>
+
+// The batch reader reads the frame records of one or more indexed files,
+// keeping up to depth reads in flight so that fast storage is not left 
+// idle between requests. On Linux the reads are issued through io_uring 
+// into a registered buffer; elsewhere, or where io_uring is unavailable, 
+// each frame is read with a single pread when it is requested. Frames are
+// always returned in the order they were queued.
+
+#define EVX_BATCH_DEFAULT_DEPTH         (32)
+#define EVX_BATCH_MAX_DEPTH             (1024)
+
+typedef struct EVX_BATCH_REQUEST
+{
+    uint32 file;
+    uint64 frame_index;
+    uint64 offset;
+    uint32 size;                // size of the frame header plus its payload.
+
+} EVX_BATCH_REQUEST;
+
+typedef struct EVX_BATCH_FRAME
+{
+    uint32 file;                // the number returned by evx_batch_add_file.
+    uint64 frame_index;         // position of the frame within its file.
+    EVX_MEDIA_FRAME_HEADER header;
+    const uint8 *payload;       // valid until the next call to evx_batch_next_frame.
+
+} EVX_BATCH_FRAME;
+
+typedef struct EVX_BATCH_READER
+{
+    std::vector<int32> files;
+    std::vector<EVX_BATCH_REQUEST> requests;
+    std::vector<int64> results;         // bytes read for each buffer slot.
+
+    uint32 depth;
+    uint64 submitted_count;             // requests issued so far.
+    uint64 next_request;                // the next request to return.
+    uint32 in_flight;
+    bool holding;                       // true while a returned frame is in use.
+
+    uint8 *buffer;                      // depth slots of slot_size bytes.
+    uint32 slot_size;
+
+    struct EVX_URING *ring;             // NULL when reading with pread.
+
+} EVX_BATCH_READER;
+
+int32 evx_batch_open(uint32 depth, EVX_BATCH_READER *reader);
+void evx_batch_close(EVX_BATCH_READER *reader);
+
+// Queues every frame in index, which must have been built from filename.
+// Returns the number by which frames of this file are identified, or -1.
+int32 evx_batch_add_file(EVX_BATCH_READER *reader, const char *filename, const EVX_FRAME_INDEX &index);
+
+// Returns 0 with the next queued frame, 1 once every frame has been 
+// returned, or -1 if the frame could not be read, in which case the next
+// call continues with the frame that follows it.
+int32 evx_batch_next_frame(EVX_BATCH_READER *reader, EVX_BATCH_FRAME *frame);
+
+// Returns true if reads are issued asynchronously through io_uring.
+bool evx_batch_is_async(EVX_BATCH_READER *reader);
+
+#endif // __EVX_BATCH_H__
@@ -0,0 +1,340 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_bench.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "cairo/evx1.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+#include "evx_reader.h"
+#include "evx_source.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Measures codec throughput without any window, file output or pacing, so
+// that results from development machines and servers are comparable. The
+// decode benchmark times the reader and the decoder separately. The encode
+// benchmark preloads its frames, so the source decoder is not measured.
+
+#define EVX_BENCH_DEFAULT_PASSES            (3)
+#define EVX_BENCH_DEFAULT_ENCODE_FRAMES     (30)
+
+typedef std::chrono::steady_clock evx_clock;
+
+typedef struct EVX_BENCH_OPTIONS
+{
+    char *source_filename;
+    uint32 pass_count;
+    uint64 frame_limit;         // zero for every frame when decoding.
+
+    bool encode;
+    int32 quality;
+    int32 raw_width;            // non-zero if the encode source is raw rgb24.
+    int32 raw_height;
+
+} EVX_BENCH_OPTIONS;
+
+typedef struct EVX_BENCH_PASS
+{
+    std::vector<double> frame_times;        // seconds spent in the codec per frame.
+    double io_time;                         // seconds spent reading records.
+    uint64 byte_count;                      // compressed bytes processed.
+
+} EVX_BENCH_PASS;
+
+double _seconds_since(evx_clock::time_point start_time)
+{
+    return std::chrono::duration<double>(evx_clock::now() - start_time).count();
+}
+
+double _percentile(const std::vector<double> &sorted_times, double fraction)
+{
+    if (sorted_times.empty())
+    {
+        return 0.0;
+    }
+
+    return sorted_times[min((size_t) (fraction * sorted_times.size()), sorted_times.size() - 1)];
+}
+
+void _report_pass(uint32 pass, const EVX_BENCH_PASS &result)
+{
+    std::vector<double> times = result.frame_times;
+    double total = 0.0;
+
+    std::sort(times.begin(), times.end());
+
+    for (size_t i = 0; i < times.size(); i++)
+    {
+        total += times[i];
+    }
+
+    if (times.empty() || total <= 0.0)
+    {
+        evx_msg("Pass %i: no frames", pass);
+        return;
+    }
+
+    evx_msg("Pass %i: %llu frames, %.2f fps, %.2f Mbps, frame ms p50 %.3f p95 %.3f p99 %.3f max %.3f, read %.3f s", 
+        pass, (uint64) times.size(), times.size() / total, result.byte_count * 8.0 / total / 1000000.0, 
+        _percentile(times, 0.50) * 1000.0, _percentile(times, 0.95) * 1000.0, _percentile(times, 0.99) * 1000.0, 
+        times.back() * 1000.0, result.io_time);
+}
+
+int32 _run_decode_pass(const EVX_BENCH_OPTIONS &options, image *frame_image, bool *image_allocated, EVX_BENCH_PASS *result)
+{
+    EVX_READER reader;
+
+    if (evx_reader_open(options.source_filename, &reader) < 0)
+    {
+        return -1;
+    }
+
+    if (!*image_allocated)
+    {
+        create_image(EVX_IMAGE_FORMAT_R8G8B8, reader.header.frame_width, reader.header.frame_height, frame_image);
+        *image_allocated = true;
+    }
+
+    while (!options.frame_limit || result->frame_times.size() < options.frame_limit)
+    {
+        evx_clock::time_point start_time = evx_clock::now();
+
+        if (0 != evx_reader_read_frame(&reader))
+        {
+            break;
+        }
+
+        result->io_time += _seconds_since(start_time);
+        start_time = evx_clock::now();
+
+        if (0 != evx_reader_decode_frame(&reader, frame_image))
+        {
+            evx_msg("Error decoding frame %llu", reader.frame_header.frame_index);
+            evx_reader_close(&reader);
+            return -1;
+        }
+
+        result->frame_times.push_back(_seconds_since(start_time));
+        result->byte_count += reader.frame_header.frame_size;
+    }
+
+    evx_reader_close(&reader);
+
+    return 0;
+}
+
+// Frames are stored back to back, as the encoder takes tightly packed input.
+typedef struct EVX_BENCH_FRAMES
+{
+    std::vector<uint8> data;
+    uint32 width;
+    uint32 height;
+    uint64 count;
+
+} EVX_BENCH_FRAMES;
+
+int32 _load_encode_frames(const EVX_BENCH_OPTIONS &options, EVX_BENCH_FRAMES *frames)
+{
+    EVX_FRAME_SOURCE source;
+    image frame_image;
+    int32 width = options.raw_width;
+    int32 height = options.raw_height;
+    int32 encoded_size = 0;
+
+    if (options.raw_width ? evx_open_rawvideo_source(options.source_filename, width, height, 30.0f, &source) < 0 
+                          : evx_open_ffmpeg_source(options.source_filename, &width, &height, &source) < 0)
+    {
+        evx_msg("Failed to open content file %s", options.source_filename);
+        return -1;
+    }
+
+    uint64 frame_limit = options.frame_limit ? options.frame_limit : EVX_BENCH_DEFAULT_ENCODE_FRAMES;
+    uint32 frame_size = width * height * 3;
+
+    create_image(EVX_IMAGE_FORMAT_R8G8B8, width, height, &frame_image);
+
+    frames->width = width;
+    frames->height = height;
+    frames->count = 0;
+    frames->data.reserve(frame_limit * frame_size);
+
+    while (frames->count < frame_limit && source.refresh(&encoded_size) >= 0)
+    {
+        source.copy_current_frame(frame_image.query_data(), frame_image.query_row_pitch());
+        frames->data.resize((frames->count + 1) * frame_size);
+
+        for (int32 y = 0; y < height; y++)
+        {
+            memcpy(&frames->data[frames->count * frame_size + y * width * 3], 
+                   frame_image.query_data() + y * frame_image.query_row_pitch(), width * 3);
+        }
+
+        frames->count++;
+    }
+
+    destroy_image(&frame_image);
+    source.deinitialize();
+    evx_msg("Loaded %llu frames of %ix%i", frames->count, width, height);
+
+    return frames->count ? 0 : -1;
+}
+
+int32 _run_encode_pass(const EVX_BENCH_OPTIONS &options, EVX_BENCH_FRAMES *frames, bit_stream *stream, EVX_BENCH_PASS *result)
+{
+    evx1_encoder *encoder = NULL;
+    uint32 frame_size = frames->width * frames->height * 3;
+
+    create_encoder(&encoder);
+
+    if (!encoder)
+    {
+        return -1;
+    }
+
+    encoder->set_quality(options.quality);
+
+    for (uint64 i = 0; i < frames->count; i++)
+    {
+        evx_clock::time_point start_time = evx_clock::now();
+
+        encoder->encode(&frames->data[i * frame_size], frames->width, frames->height, stream);
+
+        result->frame_times.push_back(_seconds_since(start_time));
+        result->byte_count += stream->query_byte_occupancy();
+        stream->empty();
+    }
+
+    destroy_encoder(encoder);
+
+    return 0;
+}
+
+int32 _parse_options(int argc, char **argv, EVX_BENCH_OPTIONS *options)
+{
+    int32 i = 1;
+
+    memset(options, 0, sizeof(EVX_BENCH_OPTIONS));
+    options->pass_count = EVX_BENCH_DEFAULT_PASSES;
+
+    for (; i < argc - 1 && '-' == argv[i][0]; i++)
+    {
+        if (0 == strcmp(argv[i], "-passes"))
+        {
+            options->pass_count = max(atoi(argv[++i]), 1);
+        }
+        else if (0 == strcmp(argv[i], "-frames"))
+        {
+            options->frame_limit = strtoull(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-encode"))
+        {
+            options->encode = true;
+            options->quality = atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-raw"))
+        {
+            if (2 != sscanf(argv[++i], "%ix%i", &options->raw_width, &options->raw_height))
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (i != argc - 1)
+    {
+        return -1;
+    }
+
+    options->source_filename = argv[i];
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    EVX_BENCH_OPTIONS options;
+    EVX_BENCH_FRAMES frames;
+    image frame_image;
+    bool image_allocated = false;
+    bit_stream stream;
+    uint32 pass = 0;
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    if (_parse_options(argc, argv, &options) < 0)
+    {
+        evx_msg("Required syntax: bench [-passes <count>] [-frames <count>] [-encode <quality> [-raw <width>x<height>]] <input_filename>");
+        return 0;
+    }
+
+    if (options.encode)
+    {
+        if (0 != _load_encode_frames(options, &frames))
+        {
+            return 0;
+        }
+
+        stream.resize_capacity((4*EVX_MB) << 3);
+    }
+
+    // The first pass also warms caches and allocators, so report each pass
+    // rather than an average.
+    for (; pass < options.pass_count; pass++)
+    {
+        EVX_BENCH_PASS result;
+        result.io_time = 0.0;
+        result.byte_count = 0;
+
+        int32 status = options.encode ? _run_encode_pass(options, &frames, &stream, &result)
+                                      : _run_decode_pass(options, &frame_image, &image_allocated, &result);
+
+        if (0 != status)
+        {
+            break;
+        }
+
+        _report_pass(pass, result);
+    }
+
+    if (image_allocated)
+    {
+        destroy_image(&frame_image);
+    }
+
+    return 0;
+}
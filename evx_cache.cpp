@@ -0,0 +1,418 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_cache.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_cache.h"
+#include "evx_memory.h"
+
+// Returns how far frame lies ahead of the position in the direction of 
+// play, which is negative for frames that have already been passed.
+int64 _query_distance(EVX_FRAME_CACHE *cache, uint64 frame)
+{
+    return ((int64) frame - (int64) cache->position) * cache->direction;
+}
+
+bool _is_protected(EVX_FRAME_CACHE *cache, uint64 frame)
+{
+    int64 distance = _query_distance(cache, frame);
+
+    return distance >= 0 && distance < cache->window;
+}
+
+// Returns true while target is still missing from the window ahead of the 
+// position, so decoding towards it is still worthwhile.
+bool _is_wanted(EVX_FRAME_CACHE *cache, uint64 target)
+{
+    return _is_protected(cache, target) && EVX_CACHE_FRAME_MISSING == cache->frame_slots[target];
+}
+
+// Frames that will be needed before the window wraps around the cache are 
+// kept as they are decoded on the way to a target, which in reverse is 
+// every frame from the entry point onwards.
+bool _should_keep(EVX_FRAME_CACHE *cache, uint64 frame)
+{
+    int64 distance = _query_distance(cache, frame);
+
+    return distance >= 0 && distance < cache->slot_count && EVX_CACHE_FRAME_MISSING == cache->frame_slots[frame];
+}
+
+// Finds the nearest frame ahead of the position that still needs decoding.
+bool _find_missing_frame(EVX_FRAME_CACHE *cache, uint64 *frame)
+{
+    for (uint32 i = 0; i < cache->window; i++)
+    {
+        int64 candidate = (int64) cache->position + (int64) i * cache->direction;
+
+        if (candidate < 0 || candidate >= (int64) cache->frame_count)
+        {
+            return false;
+        }
+
+        if (EVX_CACHE_FRAME_MISSING == cache->frame_slots[candidate])
+        {
+            *frame = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns an unused slot, or else the least recently used slot outside the
+// window, which is released. Returns -1 if every slot is in the window.
+int32 _claim_slot(EVX_FRAME_CACHE *cache)
+{
+    int32 best_slot = -1;
+
+    for (uint32 i = 0; i < cache->slot_count; i++)
+    {
+        EVX_CACHE_SLOT *slot = &cache->slots[i];
+
+        if (!slot->ready)
+        {
+            return i;
+        }
+
+        if (!_is_protected(cache, slot->frame_index) && 
+            (best_slot < 0 || slot->last_use < cache->slots[best_slot].last_use))
+        {
+            best_slot = i;
+        }
+    }
+
+    if (best_slot >= 0)
+    {
+        cache->frame_slots[cache->slots[best_slot].frame_index] = EVX_CACHE_FRAME_MISSING;
+        cache->slots[best_slot].ready = false;
+    }
+
+    return best_slot;
+}
+
+// Marks frames [first, last] as undecodable, as they all depend on a frame
+// that could not be read, and forces the next decode to seek.
+void _fail_frames(EVX_FRAME_CACHE *cache, uint64 first, uint64 last)
+{
+    std::lock_guard<std::mutex> guard(cache->lock);
+
+    for (uint64 i = first; i <= last; i++)
+    {
+        if (EVX_CACHE_FRAME_MISSING == cache->frame_slots[i])
+        {
+            cache->frame_slots[i] = EVX_CACHE_FRAME_FAILED;
+        }
+    }
+
+    cache->reader_frame = cache->frame_count;
+    cache->signal.notify_all();
+}
+
+// Decodes up to target, continuing from the current reader position if it
+// lies between target and its entry point, or else from the entry point.
+// Stops early if the consumer moves away from target.
+void _decode_to_frame(EVX_FRAME_CACHE *cache, uint64 target)
+{
+    uint64 entry_frame = evx_query_entry_point(cache->index, target);
+    bool scaled = (cache->frame_width != cache->index.header.frame_width || 
+                   cache->frame_height != cache->index.header.frame_height);
+
+    if (cache->reader_frame < entry_frame || cache->reader_frame > target)
+    {
+        if (evx_reader_seek(&cache->reader, cache->index.frames[entry_frame].offset, entry_frame) < 0)
+        {
+            _fail_frames(cache, target, target);
+            return;
+        }
+
+        cache->reader_frame = entry_frame;
+    }
+
+    while (cache->reader_frame <= target)
+    {
+        uint64 frame = cache->reader_frame;
+        int32 slot_index = -1;
+
+        {
+            std::lock_guard<std::mutex> guard(cache->lock);
+
+            if (cache->closing || !_is_wanted(cache, target))
+            {
+                return;
+            }
+
+            if (_should_keep(cache, frame))
+            {
+                slot_index = _claim_slot(cache);
+            }
+        }
+
+        // A claimed slot belongs to this thread until it is marked ready.
+        EVX_CACHE_SLOT *slot = (slot_index >= 0) ? &cache->slots[slot_index] : NULL;
+        image *output = &cache->scratch_image;
+
+        if (slot)
+        {
+            if (!slot->allocated)
+            {
+                create_image(EVX_IMAGE_FORMAT_R8G8B8, cache->frame_width, cache->frame_height, &slot->frame_image);
+                slot->allocated = true;
+            }
+
+            // Frames kept at full size are decoded straight into their slot.
+            if (!scaled)
+            {
+                output = &slot->frame_image;
+            }
+        }
+
+        if (0 != evx_reader_read_frame(&cache->reader) || 0 != evx_reader_decode_frame(&cache->reader, output))
+        {
+            evx_msg("Error decoding frame %llu", frame);
+            _fail_frames(cache, frame, target);
+            return;
+        }
+
+        cache->reader_frame++;
+
+        if (slot && scaled)
+        {
+            evx_memory_set_stage(EVX_MEMORY_STAGE_SCALE);
+            evx_box_filter(output->query_data(), output->query_width(), output->query_height(), output->query_row_pitch(),
+                           slot->frame_image.query_data(), cache->frame_width, cache->frame_height, slot->frame_image.query_row_pitch());
+            evx_memory_set_stage(EVX_MEMORY_STAGE_DECODE);
+        }
+
+        if (slot)
+        {
+            std::lock_guard<std::mutex> guard(cache->lock);
+
+            slot->frame_index = frame;
+            slot->frame_header = cache->reader.frame_header;
+            slot->last_use = ++cache->use_clock;
+            slot->ready = true;
+            cache->frame_slots[frame] = slot_index;
+            cache->signal.notify_all();
+        }
+    }
+}
+
+void _cache_thread_main(EVX_FRAME_CACHE *cache)
+{
+    evx_memory_set_stage(EVX_MEMORY_STAGE_DECODE);
+
+    while (true)
+    {
+        uint64 target = 0;
+
+        {
+            std::unique_lock<std::mutex> guard(cache->lock);
+
+            while (!cache->closing && !_find_missing_frame(cache, &target))
+            {
+                cache->signal.wait(guard);
+            }
+
+            if (cache->closing)
+            {
+                return;
+            }
+        }
+
+        _decode_to_frame(cache, target);
+    }
+}
+
+// Sizes the slots for frames of the cache's dimensions. A file that fits 
+// entirely is decoded only once, however it is played.
+void _allocate_slots(EVX_FRAME_CACHE *cache)
+{
+    uint64 frame_size = (uint64) cache->frame_width * cache->frame_height * 3;
+
+    cache->slot_count = (uint32) max(min(cache->size / max(frame_size, (uint64) 1), cache->frame_count), (uint64) 2);
+    cache->window = max(cache->slot_count / 2, 1u);
+    cache->slots = new EVX_CACHE_SLOT[cache->slot_count];
+    cache->frame_slots.assign(cache->frame_count, EVX_CACHE_FRAME_MISSING);
+
+    for (uint32 i = 0; i < cache->slot_count; i++)
+    {
+        cache->slots[i].allocated = false;
+        cache->slots[i].ready = false;
+    }
+}
+
+void _release_slots(EVX_FRAME_CACHE *cache)
+{
+    for (uint32 i = 0; i < cache->slot_count; i++)
+    {
+        if (cache->slots[i].allocated)
+        {
+            destroy_image(&cache->slots[i].frame_image);
+        }
+    }
+
+    delete [] cache->slots;
+    cache->slots = NULL;
+    cache->slot_count = 0;
+    cache->frame_slots.clear();
+}
+
+void _stop_cache_thread(EVX_FRAME_CACHE *cache)
+{
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        cache->closing = true;
+        cache->signal.notify_all();
+    }
+
+    cache->thread.join();
+    cache->closing = false;
+}
+
+int32 evx_cache_open(const char *filename, uint64 size, uint32 width, uint32 height, EVX_FRAME_CACHE *cache)
+{
+    cache->slots = NULL;
+    cache->slot_count = 0;
+    cache->size = size;
+    cache->frame_width = width;
+    cache->frame_height = height;
+    cache->reader_frame = 0;
+    cache->position = 0;
+    cache->direction = 1;
+    cache->use_clock = 0;
+    cache->closing = false;
+    cache->hit_count = 0;
+    cache->miss_count = 0;
+
+    if (evx_build_frame_index(filename, &cache->index) < 0 || cache->index.frames.empty())
+    {
+        return -1;
+    }
+
+    if (evx_reader_open(filename, &cache->reader) < 0)
+    {
+        return -1;
+    }
+
+    cache->frame_count = cache->index.frames.size();
+    _allocate_slots(cache);
+
+    create_image(EVX_IMAGE_FORMAT_R8G8B8, cache->index.header.frame_width, cache->index.header.frame_height, &cache->scratch_image);
+
+    cache->thread = std::thread(_cache_thread_main, cache);
+
+    return 0;
+}
+
+void evx_cache_close(EVX_FRAME_CACHE *cache)
+{
+    _stop_cache_thread(cache);
+    _release_slots(cache);
+
+    destroy_image(&cache->scratch_image);
+    evx_reader_close(&cache->reader);
+}
+
+void evx_cache_resize(EVX_FRAME_CACHE *cache, uint32 width, uint32 height)
+{
+    if (width == cache->frame_width && height == cache->frame_height)
+    {
+        return;
+    }
+
+    // The reader carries on from where it was, so only the slots change.
+    _stop_cache_thread(cache);
+    _release_slots(cache);
+
+    cache->frame_width = width;
+    cache->frame_height = height;
+
+    _allocate_slots(cache);
+    cache->thread = std::thread(_cache_thread_main, cache);
+}
+
+uint64 evx_cache_query_frame_count(EVX_FRAME_CACHE *cache)
+{
+    return cache->frame_count;
+}
+
+void evx_cache_seek(EVX_FRAME_CACHE *cache, uint64 frame, int32 direction)
+{
+    std::lock_guard<std::mutex> guard(cache->lock);
+
+    cache->position = min(frame, cache->frame_count - 1);
+    cache->direction = (direction < 0) ? -1 : 1;
+    cache->signal.notify_all();
+}
+
+int32 evx_cache_fetch(EVX_FRAME_CACHE *cache, uint64 frame, int32 direction, image *output, EVX_MEDIA_FRAME_HEADER *frame_header)
+{
+    std::unique_lock<std::mutex> guard(cache->lock);
+
+    if (frame >= cache->frame_count)
+    {
+        return -1;
+    }
+
+    cache->position = frame;
+    cache->direction = (direction < 0) ? -1 : 1;
+    cache->signal.notify_all();
+
+    if (cache->frame_slots[frame] >= 0)
+    {
+        cache->hit_count++;
+    }
+    else
+    {
+        cache->miss_count++;
+    }
+
+    while (EVX_CACHE_FRAME_MISSING == cache->frame_slots[frame])
+    {
+        cache->signal.wait(guard);
+    }
+
+    if (EVX_CACHE_FRAME_FAILED == cache->frame_slots[frame])
+    {
+        return -1;
+    }
+
+    EVX_CACHE_SLOT *slot = &cache->slots[cache->frame_slots[frame]];
+
+    slot->last_use = ++cache->use_clock;
+    *frame_header = slot->frame_header;
+    guard.unlock();
+
+    // The frame at the position is never evicted, so it can be copied 
+    // while the decode thread carries on.
+    memcpy(output->query_data(), slot->frame_image.query_data(), output->query_row_pitch() * output->query_height());
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_cache.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_CACHE_H__
+#define __EVX_CACHE_H__
+
+#include "cairo/base.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+#include "evx_index.h"
+#include "evx_reader.h"
+#include "evx_scale.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The frame cache holds decoded frames of a seekable file by frame number,
+// so that a player can step, scrub and play in either direction without
+// decoding the same frames again. Its size is bounded in bytes, and the 
+// least recently used frames are evicted first.
+//
+// A background thread keeps the cache filled around the position of the 
+// consumer, decoding from the nearest entry point wherever it has to. The
+// frames ahead of the position, in the direction of play, are never 
+// evicted, and in reverse every frame between the entry point and the 
+// position is kept, so that each segment is decoded once per pass.
+
+#define EVX_FRAME_CACHE_DEFAULT_SIZE        (256 * EVX_MB)
+
+// Values of frame_slots for frames that are not cached.
+#define EVX_CACHE_FRAME_MISSING             (-1)
+#define EVX_CACHE_FRAME_FAILED              (-2)
+
+typedef struct EVX_CACHE_SLOT
+{
+    image frame_image;          // allocated when the slot is first used.
+    EVX_MEDIA_FRAME_HEADER frame_header;
+    uint64 frame_index;
+    uint64 last_use;            // use stamp, the lowest is evicted first.
+    bool allocated;
+    bool ready;                 // true while the slot holds frame_index.
+
+} EVX_CACHE_SLOT;
+
+typedef struct EVX_FRAME_CACHE
+{
+    EVX_FRAME_INDEX index;
+    uint64 frame_count;
+    uint64 size;                // bytes of frames the slots may hold.
+    uint32 frame_width;         // dimensions frames are kept at.
+    uint32 frame_height;
+
+    EVX_READER reader;          // owned by the decode thread.
+    uint64 reader_frame;        // the next frame the reader would decode.
+    image scratch_image;        // receives frames that are decoded but not kept.
+    std::thread thread;
+
+    EVX_CACHE_SLOT *slots;
+    uint32 slot_count;
+    uint32 window;              // frames ahead of the position that are kept filled.
+    std::vector<int32> frame_slots;     // slot of each frame, or EVX_CACHE_FRAME_*.
+
+    std::mutex lock;
+    std::condition_variable signal;
+    uint64 position;
+    int32 direction;            // 1 when playing forward, -1 in reverse.
+    uint64 use_clock;
+    bool closing;
+
+    uint64 hit_count;
+    uint64 miss_count;
+
+} EVX_FRAME_CACHE;
+
+// Opens filename with a cache of at most size bytes of decoded frames, kept
+// at width x height, and starts filling it from the first frame. Requires 
+// a seekable file.
+int32 evx_cache_open(const char *filename, uint64 size, uint32 width, uint32 height, EVX_FRAME_CACHE *cache);
+void evx_cache_close(EVX_FRAME_CACHE *cache);
+
+// Changes the dimensions frames are kept at. Every cached frame is dropped,
+// and the cache is filled again from the position.
+void evx_cache_resize(EVX_FRAME_CACHE *cache, uint32 width, uint32 height);
+
+uint64 evx_cache_query_frame_count(EVX_FRAME_CACHE *cache);
+
+// Moves the position of the consumer, so that the frames from frame onwards
+// in direction are decoded ahead of time.
+void evx_cache_seek(EVX_FRAME_CACHE *cache, uint64 frame, int32 direction);
+
+// Moves the position to frame and copies it into output, which must have 
+// the dimensions of the cache, waiting for it to be decoded if it is not 
+// cached yet. Returns -1 if the frame cannot be decoded.
+int32 evx_cache_fetch(EVX_FRAME_CACHE *cache, uint64 frame, int32 direction, image *output, EVX_MEDIA_FRAME_HEADER *frame_header);
+
+#endif // __EVX_CACHE_H__
@@ -0,0 +1,127 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_concat.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "evx_format.h"
+#include "evx_index.h"
+#include "evx_remux.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <unistd.h>
+
+bool _is_compatible(const EVX_MEDIA_FILE_HEADER &first, const EVX_MEDIA_FILE_HEADER &header)
+{
+    return first.frame_width == header.frame_width &&
+           first.frame_height == header.frame_height &&
+           first.frame_rate == header.frame_rate;
+}
+
+int main(int argc, char **argv)
+{
+    EVX_REMUX_OUTPUT output;
+    EVX_MEDIA_FILE_HEADER first_header;
+    int32 result = 0;
+
+    if (argc < 3)
+    {
+        evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+        evx_msg("Required syntax: concat <output_filename> <input_filename> [<input_filename> ...]");
+        return 0;
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    output.fd = -1;
+
+    // Every input must share the dimensions and rate of the first.
+    for (int32 i = 2; i < argc && 0 == result; i++)
+    {
+        EVX_REMUX_SOURCE source;
+
+        if (evx_remux_open_source(argv[i], &source) < 0)
+        {
+            result = -1;
+        }
+        else if (2 == i)
+        {
+            first_header = source.index.header;
+            result = evx_remux_open_output(argv[1], first_header, &output);
+        }
+        else if (!_is_compatible(first_header, source.index.header))
+        {
+            evx_msg("%s does not match the dimensions and frame rate of %s", argv[i], argv[2]);
+            result = -1;
+        }
+
+        // The first frame of each input is an entry point, so the decoder 
+        // restarts cleanly at every join.
+        if (0 == result && source.index.frames.size())
+        {
+            result = evx_remux_append(&output, &source, 0, source.index.frames.size() - 1);
+        }
+
+        evx_remux_close_source(&source);
+    }
+
+    bool opened = (output.fd >= 0);
+
+    if (opened && evx_remux_close_output(&output) < 0)
+    {
+        result = -1;
+    }
+
+    // Don't leave a partial file behind that looks like a finished one.
+    if (result < 0 && opened)
+    {
+        evx_msg("Removing incomplete dest file %s", argv[1]);
+        unlink(argv[1]);
+    }
+
+    if (0 == result)
+    {
+        evx_msg("Wrote %llu frames to %s (%llu bytes copied in-kernel)", output.frame_count, argv[1], output.payload_bytes);
+    }
+
+    return 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+    evx_msg("concat is not available on this platform");
+    return 0;
+}
+
+#endif
@@ -31,130 +31,63 @@
 */
 
 #include "cairo/base.h"
-#include "cairo/evx1.h"
-#include "cairo/image.h"
 #include "evx_format.h"
+#include "evx_converter.h"
+#include "evx_memory.h"
+#include "evx_output.h"
 
-extern "C"
+bool _report_progress(void *context, uint64 frames_written, uint64 frame_count)
 {
-    int ffmpeg_initialize();
-    int ffmpeg_deinitialize();
-    int ffmpeg_reset();
-
-    int ffmpeg_play_file(char * filename, int *format, int *width, int *height);
-    int ffmpeg_copy_current_frame(unsigned char *dest, int row_pitch);
-    int ffmpeg_refresh(int *encoded_frame_size);
-
-    int ffmpeg_get_frame_count();
-    float ffmpeg_get_frame_rate();
-
-} // extern "C"
-
-void _print_file_header(const EVX_MEDIA_FILE_HEADER &header)
-{
-    evx_msg("Printing file header:");
-    evx_msg("size = %i", header.header_size);
-    evx_msg("version = %i", header.version);
-    evx_msg("width = %i", header.frame_width);
-    evx_msg("height = %i", header.frame_height);
-    evx_msg("frame count = %i", header.frame_count);
-    evx_msg("rate = %f", header.frame_rate);
-}
-
-void _prepare_evx_header(EVX_MEDIA_FILE_HEADER *header, uint32 width, uint32 height)
-{
-    header->magic[0] = 'E';
-    header->magic[1] = 'V';
-    header->magic[2] = 'X';
-    header->magic[3] = '1';
-    header->header_size = sizeof(EVX_MEDIA_FILE_HEADER);
-    header->version = 1;
-    header->frame_width = width;
-    header->frame_height = height;
-    header->frame_count = ffmpeg_get_frame_count();
-    header->frame_rate = ffmpeg_get_frame_rate();
+    if (0 == (frames_written % 10))
+    {
+        evx_msg("Processing frame %llu", frames_written);
+    }
 
-    _print_file_header(*header);
+    return true;
 }
 
 int main(int argc, char **argv)
 {
-    FILE *dest = NULL;
-    image frame_image;
-    evx1_encoder *encoder;
-    bit_stream cairo_stream;
-    int32 frame_index = 0;
-    int32 encoded_size = 0;
-    int32 content_width = 0;
-    int32 content_height = 0;
-    int32 content_format = 0;
-    EVX_MEDIA_FILE_HEADER header;
-
-    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+    EVX_CONVERT_OPTIONS options;
+    EVX_CONVERTER converter;
+    FILE *dest_file = NULL;
 
-    if (4 != argc)
+    if (evx_parse_convert_options(argc, argv, &options) < 0)
     {
         // No need to get fancy.
-        evx_msg("Required syntax: convert <input_filename> quality <output_filename>");
+        evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+        evx_msg("Required syntax: convert [-raw <width>x<height>] [-rate <fps>] [-threads <count>] [-index <frames>] [-keyint <frames>] [-scenecut <threshold>] [-start <frame>] [-end <frame>] [-step <frames>] [-resume] [-stats <file>] [-metrics <address>] [-score] [-scorefile <file>] [-memprofile] <input_filename|input_directory|-> quality <output_filename|->");
         return 0;
     }
 
-    dest = fopen(argv[3], "wb");
+    // Open the output first, as writing to stdout moves our messages to stderr.
+    dest_file = evx_open_convert_output(options);
 
-    if (!dest)
+    if (!dest_file)
     {
-        evx_msg("Error opening dest file %s", argv[3]);
+        evx_msg("Error opening dest file %s", options.dest_filename);
         return 0;
     }
 
-    ffmpeg_initialize();
-    
-    if (0 != ffmpeg_play_file(argv[1], (int*) &content_format, (int*) &content_width, (int*) &content_height))
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    // Track from the start, so the encoder created here is included.
+    if (options.memory_profile)
     {
-        evx_msg("Failed to open content file %s", argv[1]);
-        ffmpeg_deinitialize();
-        fclose(dest);
-        return 0;
+        evx_memory_enable();
     }
 
-    create_encoder(&encoder);
-    encoder->set_quality(atoi(argv[2]));
-
-    create_image(EVX_IMAGE_FORMAT_R8G8B8, content_width, content_height, &frame_image);
-    cairo_stream.resize_capacity((4*EVX_MB) << 3);
-
-    _prepare_evx_header(&header, content_width, content_height);
-    fwrite(&header, sizeof(header), 1, dest);
-
-    while (ffmpeg_refresh(&encoded_size) >= 0)
+    if (evx_converter_open(&converter) < 0)
     {
-        ffmpeg_copy_current_frame(frame_image.query_data(), frame_image.query_row_pitch());
-
-        // encode using cairo and then flush the frame to disk.
-        encoder->encode(frame_image.query_data(), frame_image.query_width(), frame_image.query_height(), &cairo_stream);
-
-        EVX_MEDIA_FRAME_HEADER frame_header;
-        frame_header.magic[0] = 'E';
-        frame_header.magic[0] = 'V';
-        frame_header.magic[0] = 'F';
-        frame_header.magic[0] = 'H';
-        frame_header.frame_index = frame_index++;
-        frame_header.frame_size = cairo_stream.query_byte_occupancy();
-        frame_header.header_size = sizeof(frame_header);
-        
-        fwrite(&frame_header, sizeof(frame_header), 1, dest);
-        fwrite(cairo_stream.query_data(), cairo_stream.query_byte_occupancy(), 1, dest);
-        cairo_stream.empty();
-
-        if (0 == (frame_index % 10))
-        {
-            evx_msg("Processing frame %i", frame_index);
-        }
+        evx_msg("Error creating encoder");
+        fclose(dest_file);
+        return 0;
     }
 
-    destroy_encoder(encoder);
-    ffmpeg_deinitialize();
-    fclose(dest);
+    converter.callback = _report_progress;
+    evx_converter_run(&converter, options, dest_file);
+    evx_converter_close(&converter);
+    fclose(dest_file);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1002 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_convertd.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "evx_format.h"
+#include "evx_converter.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The job server keeps a pool of forked worker processes, each holding a 
+// warm converter. The ffmpeg and raw video sources keep global state, so 
+// workers are processes rather than threads. Clients submit jobs over a
+// local socket with one request per connection:
+//
+//   SUBMIT <high|normal|low> <convert arguments>   ->  OK <job id>
+//   CANCEL <job id>                                ->  OK
+//   STATUS [<job id>]                              ->  one line per job
+//
+// Workers report back over a socketpair with PROGRESS and DONE lines, and
+// receive JOB and CANCEL lines.
+
+#define EVX_CONVERTD_PRIORITY_COUNT             (3)
+#define EVX_CONVERTD_MAX_REQUEST                (4096)
+#define EVX_CONVERTD_MAX_ARGUMENTS              (64)
+#define EVX_CONVERTD_DEFAULT_WORKER_MEMORY      (512)     // megabytes reserved per worker.
+#define EVX_CONVERTD_PROGRESS_INTERVAL          (0.25)    // seconds between progress reports.
+
+typedef std::chrono::steady_clock evx_clock;
+
+typedef enum EVX_JOB_STATE
+{
+    EVX_JOB_QUEUED = 0,
+    EVX_JOB_RUNNING,
+    EVX_JOB_DONE,
+    EVX_JOB_FAILED,
+    EVX_JOB_CANCELLED,
+
+} EVX_JOB_STATE;
+
+typedef struct EVX_CONVERTD_JOB
+{
+    uint64 id;
+    uint32 priority;
+    EVX_JOB_STATE state;
+    std::string arguments;
+
+    uint64 frames_written;
+    uint64 frame_count;             // expected total, zero if unknown.
+    evx_clock::time_point start_time;
+    evx_clock::time_point end_time;
+    bool cancel_requested;
+
+} EVX_CONVERTD_JOB;
+
+typedef struct EVX_CONVERTD_WORKER
+{
+    pid_t pid;
+    int32 fd;                       // our end of the worker socketpair.
+    uint64 job_id;                  // zero while idle.
+    std::string input;              // partial line received from the worker.
+
+} EVX_CONVERTD_WORKER;
+
+typedef struct EVX_CONVERTD_CLIENT
+{
+    int32 fd;
+    std::string request;
+
+} EVX_CONVERTD_CLIENT;
+
+typedef struct EVX_CONVERTD
+{
+    int32 listener;
+    std::vector<EVX_CONVERTD_WORKER> workers;
+    std::vector<EVX_CONVERTD_CLIENT> clients;
+    std::deque<uint64> queues[EVX_CONVERTD_PRIORITY_COUNT];
+    std::map<uint64, EVX_CONVERTD_JOB> jobs;
+    uint64 next_job_id;
+
+} EVX_CONVERTD;
+
+typedef struct EVX_CONVERTD_WORKER_JOB
+{
+    int32 fd;
+    uint64 id;
+    uint64 frames_written;
+    uint64 frame_count;
+    evx_clock::time_point last_report;
+
+} EVX_CONVERTD_WORKER_JOB;
+
+const char *g_priority_names[EVX_CONVERTD_PRIORITY_COUNT] = { "high", "normal", "low" };
+const char *g_state_names[] = { "queued", "running", "done", "failed", "cancelled" };
+
+volatile sig_atomic_t g_convertd_running = 1;
+
+void _handle_stop_signal(int signal_number)
+{
+    g_convertd_running = 0;
+}
+
+bool _send_line(int32 fd, const char *format, ...)
+{
+    char line[EVX_CONVERTD_MAX_REQUEST];
+    va_list args;
+
+    va_start(args, format);
+    int32 size = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (size < 0 || size >= (int32) sizeof(line))
+    {
+        return false;
+    }
+
+    for (int32 sent = 0; sent < size;)
+    {
+        ssize_t count = send(fd, line + sent, size - sent, 0);
+
+        if (count < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        sent += count;
+    }
+
+    return true;
+}
+
+// Reads a single line one byte at a time, so that nothing beyond the line
+// is consumed. Only used on the low volume worker control channel.
+bool _receive_line(int32 fd, std::string *line)
+{
+    char value = 0;
+
+    line->clear();
+
+    while (true)
+    {
+        ssize_t count = recv(fd, &value, 1, 0);
+
+        if (count < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        if ('\n' == value)
+        {
+            return true;
+        }
+
+        line->push_back(value);
+    }
+}
+
+// Splits arguments on whitespace into argv, with argv[0] set to "convert".
+int32 _split_arguments(char *arguments, char **argv)
+{
+    int32 argc = 0;
+
+    argv[argc++] = (char *) "convert";
+
+    for (char *token = strtok(arguments, " \t"); token && argc < EVX_CONVERTD_MAX_ARGUMENTS; token = strtok(NULL, " \t"))
+    {
+        argv[argc++] = token;
+    }
+
+    return argc;
+}
+
+// Jobs are always read from and written to files, as the standard streams 
+// of a worker belong to the server.
+int32 _parse_job_arguments(const std::string &arguments, EVX_CONVERT_OPTIONS *options, std::vector<char> *storage)
+{
+    char *argv[EVX_CONVERTD_MAX_ARGUMENTS];
+
+    storage->assign(arguments.begin(), arguments.end());
+    storage->push_back(0);
+
+    int32 argc = _split_arguments(&(*storage)[0], argv);
+
+    if (evx_parse_convert_options(argc, argv, options) < 0 || 
+        0 == strcmp(options->source_filename, "-") || 0 == strcmp(options->dest_filename, "-"))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**********************************************************************************
+//
+// Worker process
+//
+**********************************************************************************/
+
+bool _report_worker_progress(void *context, uint64 frames_written, uint64 frame_count)
+{
+    EVX_CONVERTD_WORKER_JOB *job = (EVX_CONVERTD_WORKER_JOB *) context;
+    evx_clock::time_point now = evx_clock::now();
+    struct pollfd control = { job->fd, POLLIN, 0 };
+    std::string line;
+
+    job->frames_written = frames_written;
+    job->frame_count = frame_count;
+
+    if (std::chrono::duration<double>(now - job->last_report).count() >= EVX_CONVERTD_PROGRESS_INTERVAL)
+    {
+        _send_line(job->fd, "PROGRESS %llu %llu %llu\n", job->id, frames_written, frame_count);
+        job->last_report = now;
+    }
+
+    // The only message a worker can receive while busy is a cancellation,
+    // and a server that has gone away cancels the job as well.
+    if (poll(&control, 1, 0) > 0 && (!_receive_line(job->fd, &line) || 0 == line.compare(0, 6, "CANCEL")))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void _run_worker(int32 fd)
+{
+    EVX_CONVERTER converter;
+    std::string line;
+
+    // Everything that can be set up ahead of a job is done once, here.
+    ffmpeg_initialize();
+
+    if (evx_converter_open(&converter) < 0)
+    {
+        evx_msg("Worker %i failed to create an encoder", getpid());
+        _exit(1);
+    }
+
+    while (_receive_line(fd, &line))
+    {
+        EVX_CONVERT_OPTIONS options;
+        EVX_CONVERTD_WORKER_JOB job;
+        std::vector<char> storage;
+        unsigned long long id = 0;
+        int32 offset = 0;
+        int32 result = -1;
+
+        if (1 != sscanf(line.c_str(), "JOB %llu %n", &id, &offset) || !offset)
+        {
+            continue;
+        }
+
+        job.fd = fd;
+        job.id = id;
+        job.frames_written = 0;
+        job.frame_count = 0;
+        job.last_report = evx_clock::now();
+
+        if (0 == _parse_job_arguments(line.substr(offset), &options, &storage))
+        {
+            FILE *dest_file = evx_open_convert_output(options);
+
+            if (dest_file)
+            {
+                converter.callback = _report_worker_progress;
+                converter.callback_context = &job;
+                result = evx_converter_run(&converter, options, dest_file);
+
+                if (0 != fclose(dest_file))
+                {
+                    result = -1;
+                }
+
+                // Cancelled and failed jobs leave nothing behind, unless they
+                // can be resumed from their checkpoint.
+                if (0 != result && !options.resume)
+                {
+                    unlink(options.dest_filename);
+                }
+            }
+            else
+            {
+                evx_msg("Error opening dest file %s", options.dest_filename);
+            }
+        }
+
+        _send_line(fd, "DONE %llu %s %llu %llu\n", job.id, 
+                   (0 == result) ? "done" : (EVX_CONVERT_CANCELLED == result) ? "cancelled" : "failed",
+                   job.frames_written, job.frame_count);
+    }
+
+    evx_converter_close(&converter);
+    _exit(0);
+}
+
+/**********************************************************************************
+//
+// Server
+//
+**********************************************************************************/
+
+void _set_close_on_exec(int32 fd)
+{
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+int32 _start_worker(EVX_CONVERTD *server, EVX_CONVERTD_WORKER *worker)
+{
+    int32 fds[2];
+
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+    {
+        return -1;
+    }
+
+    // Anything still buffered would otherwise be written by both processes.
+    fflush(stdout);
+    worker->pid = fork();
+
+    if (0 == worker->pid)
+    {
+        // The worker keeps only its end of the control channel. Workers are
+        // also restarted while clients are connected, and a client waits 
+        // for end of file, so their sockets must not be held open here.
+        close(server->listener);
+
+        for (uint32 i = 0; i < server->workers.size(); i++)
+        {
+            if (server->workers[i].fd >= 0)
+            {
+                close(server->workers[i].fd);
+            }
+        }
+
+        for (uint32 i = 0; i < server->clients.size(); i++)
+        {
+            close(server->clients[i].fd);
+        }
+
+        close(fds[0]);
+        _run_worker(fds[1]);
+    }
+
+    close(fds[1]);
+
+    if (worker->pid < 0)
+    {
+        close(fds[0]);
+        return -1;
+    }
+
+    _set_close_on_exec(fds[0]);
+    worker->fd = fds[0];
+    worker->job_id = 0;
+    worker->input.clear();
+
+    return 0;
+}
+
+uint64 _query_available_memory()
+{
+#if defined(__linux__)
+    FILE *meminfo = fopen("/proc/meminfo", "r");
+    char line[256];
+
+    // MemAvailable includes reclaimable cache, unlike the free page count.
+    while (meminfo && fgets(line, sizeof(line), meminfo))
+    {
+        unsigned long long kilobytes = 0;
+
+        if (1 == sscanf(line, "MemAvailable: %llu kB", &kilobytes))
+        {
+            fclose(meminfo);
+            return kilobytes * 1024;
+        }
+    }
+
+    if (meminfo)
+    {
+        fclose(meminfo);
+    }
+#endif
+
+    return (uint64) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+}
+
+// One worker per core, unless memory runs out first.
+uint32 _query_worker_count(uint32 requested_count, uint32 worker_memory)
+{
+    if (requested_count)
+    {
+        return requested_count;
+    }
+
+    uint32 core_count = max(std::thread::hardware_concurrency(), 1u);
+    uint64 memory_count = _query_available_memory() / ((uint64) worker_memory * EVX_MB);
+
+    evx_msg("%i cores, memory for %llu workers of %i MB", core_count, memory_count, worker_memory);
+
+    return max((uint32) min((uint64) core_count, memory_count), (uint32) 1);
+}
+
+int32 _open_listener(const char *path)
+{
+    struct sockaddr_un unix_address;
+    int32 fd = -1;
+
+    if (strlen(path) >= sizeof(unix_address.sun_path))
+    {
+        evx_msg("Socket path %s is too long", path);
+        return -1;
+    }
+
+    memset(&unix_address, 0, sizeof(unix_address));
+    unix_address.sun_family = AF_UNIX;
+    strcpy(unix_address.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+
+    if (fd < 0 || 0 != bind(fd, (struct sockaddr *) &unix_address, sizeof(unix_address)) || 0 != listen(fd, 64))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    _set_close_on_exec(fd);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+void _finish_job(EVX_CONVERTD *server, uint64 id, EVX_JOB_STATE state)
+{
+    EVX_CONVERTD_JOB *job = &server->jobs[id];
+
+    job->state = state;
+    job->end_time = evx_clock::now();
+
+    double elapsed = std::chrono::duration<double>(job->end_time - job->start_time).count();
+
+    evx_msg("Job %llu %s after %.1fs (%llu frames, %.1f fps)", id, g_state_names[state], elapsed, 
+            job->frames_written, elapsed > 0.0 ? job->frames_written / elapsed : 0.0);
+}
+
+// Hands queued jobs to idle workers, highest priority first.
+void _dispatch_jobs(EVX_CONVERTD *server)
+{
+    for (uint32 i = 0; i < server->workers.size(); i++)
+    {
+        EVX_CONVERTD_WORKER *worker = &server->workers[i];
+        uint32 priority = 0;
+
+        if (worker->job_id || worker->fd < 0)
+        {
+            continue;
+        }
+
+        while (priority < EVX_CONVERTD_PRIORITY_COUNT && server->queues[priority].empty())
+        {
+            priority++;
+        }
+
+        if (priority >= EVX_CONVERTD_PRIORITY_COUNT)
+        {
+            return;
+        }
+
+        EVX_CONVERTD_JOB *job = &server->jobs[server->queues[priority].front()];
+        server->queues[priority].pop_front();
+
+        job->state = EVX_JOB_RUNNING;
+        job->start_time = evx_clock::now();
+        worker->job_id = job->id;
+
+        evx_msg("Job %llu (%s) started on worker %i", job->id, g_priority_names[job->priority], worker->pid);
+
+        if (!_send_line(worker->fd, "JOB %llu %s\n", job->id, job->arguments.c_str()))
+        {
+            worker->job_id = 0;
+            _finish_job(server, job->id, EVX_JOB_FAILED);
+        }
+    }
+}
+
+void _handle_worker_line(EVX_CONVERTD *server, EVX_CONVERTD_WORKER *worker, const std::string &line)
+{
+    unsigned long long id = 0;
+    unsigned long long frames_written = 0;
+    unsigned long long frame_count = 0;
+    char status[32];
+
+    if (3 == sscanf(line.c_str(), "PROGRESS %llu %llu %llu", &id, &frames_written, &frame_count) && id == worker->job_id)
+    {
+        server->jobs[id].frames_written = frames_written;
+        server->jobs[id].frame_count = frame_count;
+    }
+    else if (4 == sscanf(line.c_str(), "DONE %llu %31s %llu %llu", &id, status, &frames_written, &frame_count) && id == worker->job_id)
+    {
+        EVX_JOB_STATE state = EVX_JOB_FAILED;
+
+        server->jobs[id].frames_written = frames_written;
+        server->jobs[id].frame_count = frame_count;
+
+        if (0 == strcmp(status, "done"))
+        {
+            state = EVX_JOB_DONE;
+        }
+        else if (0 == strcmp(status, "cancelled"))
+        {
+            state = EVX_JOB_CANCELLED;
+        }
+
+        worker->job_id = 0;
+        _finish_job(server, id, state);
+    }
+}
+
+// A worker that has exited is replaced, and its job is marked as failed.
+void _read_worker(EVX_CONVERTD *server, EVX_CONVERTD_WORKER *worker)
+{
+    char buffer[EVX_CONVERTD_MAX_REQUEST];
+    ssize_t count = recv(worker->fd, buffer, sizeof(buffer), 0);
+
+    if (count < 0 && EINTR == errno)
+    {
+        return;
+    }
+
+    if (count <= 0)
+    {
+        evx_msg("Worker %i exited unexpectedly, restarting it", worker->pid);
+
+        if (worker->job_id)
+        {
+            _finish_job(server, worker->job_id, EVX_JOB_FAILED);
+        }
+
+        close(worker->fd);
+        worker->fd = -1;
+        waitpid(worker->pid, NULL, 0);
+
+        if (_start_worker(server, worker) < 0)
+        {
+            evx_msg("Failed to restart worker");
+        }
+
+        return;
+    }
+
+    worker->input.append(buffer, count);
+
+    for (size_t end = worker->input.find('\n'); end != std::string::npos; end = worker->input.find('\n'))
+    {
+        _handle_worker_line(server, worker, worker->input.substr(0, end));
+        worker->input.erase(0, end + 1);
+    }
+}
+
+void _print_job_status(int32 fd, const EVX_CONVERTD_JOB &job)
+{
+    evx_clock::time_point end_time = (EVX_JOB_RUNNING == job.state) ? evx_clock::now() : job.end_time;
+    double elapsed = std::chrono::duration<double>(end_time - job.start_time).count();
+    double percent = job.frame_count ? 100.0 * job.frames_written / job.frame_count : 0.0;
+
+    _send_line(fd, "%llu %s %s %llu/%llu %.1f%% %.1fs %s\n", job.id, g_state_names[job.state], g_priority_names[job.priority],
+               job.frames_written, job.frame_count, percent, elapsed, job.arguments.c_str());
+}
+
+void _handle_request(EVX_CONVERTD *server, int32 fd, std::string &request)
+{
+    char command[16] = { 0 };
+    unsigned long long id = 0;
+    int32 offset = 0;
+
+    sscanf(request.c_str(), "%15s %n", command, &offset);
+
+    if (0 == strcmp(command, "SUBMIT"))
+    {
+        EVX_CONVERT_OPTIONS options;
+        std::vector<char> storage;
+        char priority_name[16] = { 0 };
+        int32 arguments_offset = 0;
+        uint32 priority = 0;
+
+        sscanf(request.c_str() + offset, "%15s %n", priority_name, &arguments_offset);
+
+        while (priority < EVX_CONVERTD_PRIORITY_COUNT && strcmp(priority_name, g_priority_names[priority]))
+        {
+            priority++;
+        }
+
+        std::string arguments = request.substr(offset + arguments_offset);
+
+        if (priority >= EVX_CONVERTD_PRIORITY_COUNT || !arguments_offset || _parse_job_arguments(arguments, &options, &storage) < 0)
+        {
+            _send_line(fd, "ERROR invalid job\n");
+            return;
+        }
+
+        EVX_CONVERTD_JOB job;
+        job.id = server->next_job_id++;
+        job.priority = priority;
+        job.state = EVX_JOB_QUEUED;
+        job.arguments = arguments;
+        job.frames_written = 0;
+        job.frame_count = 0;
+        job.cancel_requested = false;
+        job.start_time = evx_clock::now();
+        job.end_time = job.start_time;
+
+        server->jobs[job.id] = job;
+        server->queues[priority].push_back(job.id);
+
+        _send_line(fd, "OK %llu\n", job.id);
+    }
+    else if (0 == strcmp(command, "CANCEL") && 1 == sscanf(request.c_str() + offset, "%llu", &id) && server->jobs.count(id))
+    {
+        EVX_CONVERTD_JOB *job = &server->jobs[id];
+
+        if (EVX_JOB_QUEUED == job->state)
+        {
+            std::deque<uint64> &queue = server->queues[job->priority];
+
+            for (std::deque<uint64>::iterator i = queue.begin(); i != queue.end(); ++i)
+            {
+                if (*i == id)
+                {
+                    queue.erase(i);
+                    break;
+                }
+            }
+
+            job->state = EVX_JOB_CANCELLED;
+            job->end_time = job->start_time;
+            _send_line(fd, "OK\n");
+        }
+        else if (EVX_JOB_RUNNING == job->state)
+        {
+            // The worker stops after its current frame and reports back.
+            for (uint32 i = 0; i < server->workers.size(); i++)
+            {
+                if (server->workers[i].job_id == id && !job->cancel_requested)
+                {
+                    _send_line(server->workers[i].fd, "CANCEL\n");
+                    job->cancel_requested = true;
+                }
+            }
+
+            _send_line(fd, "OK\n");
+        }
+        else
+        {
+            _send_line(fd, "ERROR job %llu is not active\n", id);
+        }
+    }
+    else if (0 == strcmp(command, "STATUS"))
+    {
+        if (1 == sscanf(request.c_str() + offset, "%llu", &id))
+        {
+            if (server->jobs.count(id))
+            {
+                _print_job_status(fd, server->jobs[id]);
+            }
+            else
+            {
+                _send_line(fd, "ERROR unknown job %llu\n", id);
+            }
+
+            return;
+        }
+
+        for (std::map<uint64, EVX_CONVERTD_JOB>::iterator i = server->jobs.begin(); i != server->jobs.end(); ++i)
+        {
+            _print_job_status(fd, i->second);
+        }
+    }
+    else
+    {
+        _send_line(fd, "ERROR invalid request\n");
+    }
+}
+
+// Clients send a single request line and the connection is closed once it 
+// has been answered.
+bool _read_client(EVX_CONVERTD *server, EVX_CONVERTD_CLIENT *client)
+{
+    char buffer[EVX_CONVERTD_MAX_REQUEST];
+    ssize_t count = recv(client->fd, buffer, sizeof(buffer), 0);
+
+    if (count < 0 && (EINTR == errno || EAGAIN == errno))
+    {
+        return true;
+    }
+
+    if (count <= 0)
+    {
+        return false;
+    }
+
+    client->request.append(buffer, count);
+
+    size_t end = client->request.find('\n');
+
+    if (std::string::npos == end)
+    {
+        return client->request.size() < EVX_CONVERTD_MAX_REQUEST;
+    }
+
+    client->request.resize(end);
+    _handle_request(server, client->fd, client->request);
+
+    return false;
+}
+
+int32 _run_server(const char *path, uint32 worker_count)
+{
+    EVX_CONVERTD server;
+
+    server.next_job_id = 1;
+    server.listener = _open_listener(path);
+
+    if (server.listener < 0)
+    {
+        evx_msg("Failed to listen on %s", path);
+        return -1;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, _handle_stop_signal);
+    signal(SIGTERM, _handle_stop_signal);
+
+    server.workers.resize(worker_count);
+
+    for (uint32 i = 0; i < worker_count; i++)
+    {
+        server.workers[i].fd = -1;
+    }
+
+    for (uint32 i = 0; i < worker_count; i++)
+    {
+        if (_start_worker(&server, &server.workers[i]) < 0)
+        {
+            evx_msg("Failed to start worker %i", i);
+            return -1;
+        }
+    }
+
+    evx_msg("Listening on %s with %i workers", path, worker_count);
+
+    while (g_convertd_running)
+    {
+        std::vector<struct pollfd> fds;
+        struct pollfd listen_fd = { server.listener, POLLIN, 0 };
+
+        fds.push_back(listen_fd);
+
+        for (uint32 i = 0; i < server.workers.size(); i++)
+        {
+            struct pollfd worker_fd = { server.workers[i].fd, POLLIN, 0 };
+            fds.push_back(worker_fd);
+        }
+
+        for (uint32 i = 0; i < server.clients.size(); i++)
+        {
+            struct pollfd client_fd = { server.clients[i].fd, POLLIN, 0 };
+            fds.push_back(client_fd);
+        }
+
+        if (poll(&fds[0], fds.size(), 1000) <= 0)
+        {
+            continue;
+        }
+
+        for (uint32 i = 0; i < server.workers.size(); i++)
+        {
+            if (fds[1 + i].revents)
+            {
+                _read_worker(&server, &server.workers[i]);
+            }
+        }
+
+        // Walk clients backwards so that finished ones can be removed.
+        for (int32 i = server.clients.size() - 1; i >= 0; i--)
+        {
+            if (fds[1 + server.workers.size() + i].revents && !_read_client(&server, &server.clients[i]))
+            {
+                close(server.clients[i].fd);
+                server.clients.erase(server.clients.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            EVX_CONVERTD_CLIENT client;
+            client.fd = accept(server.listener, NULL, NULL);
+
+            if (client.fd >= 0)
+            {
+                _set_close_on_exec(client.fd);
+                server.clients.push_back(client);
+            }
+        }
+
+        _dispatch_jobs(&server);
+    }
+
+    evx_msg("Shutting down");
+
+    // Closing the control channel stops each worker once its job is done.
+    for (uint32 i = 0; i < server.workers.size(); i++)
+    {
+        if (server.workers[i].fd >= 0)
+        {
+            if (server.workers[i].job_id)
+            {
+                _send_line(server.workers[i].fd, "CANCEL\n");
+            }
+
+            close(server.workers[i].fd);
+            waitpid(server.workers[i].pid, NULL, 0);
+        }
+    }
+
+    for (uint32 i = 0; i < server.clients.size(); i++)
+    {
+        close(server.clients[i].fd);
+    }
+
+    close(server.listener);
+    unlink(path);
+
+    return 0;
+}
+
+int32 _run_client(const char *path, const std::string &request)
+{
+    struct sockaddr_un unix_address;
+    char buffer[EVX_CONVERTD_MAX_REQUEST];
+    int32 fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (strlen(path) >= sizeof(unix_address.sun_path))
+    {
+        evx_msg("Socket path %s is too long", path);
+        return -1;
+    }
+
+    memset(&unix_address, 0, sizeof(unix_address));
+    unix_address.sun_family = AF_UNIX;
+    strcpy(unix_address.sun_path, path);
+
+    if (fd < 0 || 0 != connect(fd, (struct sockaddr *) &unix_address, sizeof(unix_address)))
+    {
+        evx_msg("Failed to connect to %s", path);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!_send_line(fd, "%s\n", request.c_str()))
+    {
+        evx_msg("Failed to send request to %s", path);
+        close(fd);
+        return -1;
+    }
+
+    for (ssize_t count = 0; (count = recv(fd, buffer, sizeof(buffer), 0)) > 0;)
+    {
+        fwrite(buffer, count, 1, stdout);
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::string request;
+    uint32 worker_count = 0;
+    uint32 worker_memory = EVX_CONVERTD_DEFAULT_WORKER_MEMORY;
+    int32 i = 1;
+
+    if (argc >= 3 && (0 == strcmp(argv[1], "-submit") || 0 == strcmp(argv[1], "-cancel") || 0 == strcmp(argv[1], "-status")))
+    {
+        // Client requests are formed from the remaining arguments.
+        request = argv[1] + 1;
+
+        for (uint32 j = 0; j < request.size(); j++)
+        {
+            request[j] = toupper(request[j]);
+        }
+
+        for (int32 j = 3; j < argc; j++)
+        {
+            request = request + " " + argv[j];
+        }
+
+        return _run_client(argv[2], request) < 0 ? 1 : 0;
+    }
+
+    for (; i + 1 < argc && '-' == argv[i][0]; i += 2)
+    {
+        if (0 == strcmp(argv[i], "-workers"))
+        {
+            worker_count = atoi(argv[i + 1]);
+        }
+        else if (0 == strcmp(argv[i], "-memory"))
+        {
+            worker_memory = max(atoi(argv[i + 1]), 1);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i + 1 != argc)
+    {
+        evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+        evx_msg("Required syntax: convertd [-workers <count>] [-memory <megabytes per worker>] <socket path>");
+        evx_msg("                 convertd -submit <socket path> <high|normal|low> <convert arguments>");
+        evx_msg("                 convertd -cancel <socket path> <job id>");
+        evx_msg("                 convertd -status <socket path> [<job id>]");
+        return 0;
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    return _run_server(argv[i], _query_worker_count(worker_count, worker_memory)) < 0 ? 1 : 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+    evx_msg("convertd requires fork and unix domain sockets, and is not available on this platform");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,805 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_converter.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_converter.h"
+#include "evx_memory.h"
+#include "evx_metrics.h"
+#include "evx_output.h"
+#include "evx_quality.h"
+#include "evx_scene.h"
+
+#include <stddef.h>
+
+#if defined(EVX_PLATFORM_WINDOWS)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+void _print_file_header(const EVX_MEDIA_FILE_HEADER &header)
+{
+    evx_msg("Printing file header:");
+    evx_msg("size = %i", header.header_size);
+    evx_msg("version = %i", header.version);
+    evx_msg("width = %i", header.frame_width);
+    evx_msg("height = %i", header.frame_height);
+    evx_msg("frame count = %llu", header.frame_count);
+    evx_msg("rate = %f", header.frame_rate);
+}
+
+void _prepare_evx_header(EVX_MEDIA_FILE_HEADER *header, const EVX_FRAME_SOURCE &source, const EVX_CONVERT_OPTIONS &options, 
+                         uint32 width, uint32 height, bool streaming)
+{
+    uint64 source_frame_count = source.get_frame_count();
+
+    if (options.end_frame)
+    {
+        source_frame_count = source_frame_count ? min(source_frame_count, options.end_frame) : options.end_frame;
+    }
+
+    memset(header, 0, sizeof(EVX_MEDIA_FILE_HEADER));
+    evx_set_magic(header->magic, "EVX1");
+    header->header_size = sizeof(EVX_MEDIA_FILE_HEADER);
+    header->version = EVX_MEDIA_VERSION;
+    header->frame_width = width;
+    header->frame_height = height;
+    header->frame_rate = source.get_frame_rate() / options.frame_step;
+
+    // Streams carry their frame count in-band, as the source count is 
+    // frequently zero or wrong and cannot be corrected afterwards.
+    if (!streaming && source_frame_count > options.start_frame)
+    {
+        header->frame_count = (source_frame_count - options.start_frame + options.frame_step - 1) / options.frame_step;
+    }
+
+    _print_file_header(*header);
+}
+
+int32 evx_parse_convert_options(int argc, char **argv, EVX_CONVERT_OPTIONS *options)
+{
+    int32 i = 1;
+
+    memset(options, 0, sizeof(EVX_CONVERT_OPTIONS));
+    options->index_interval = EVX_DEFAULT_INDEX_INTERVAL;
+    options->frame_step = 1;
+
+    for (; i < argc && '-' == argv[i][0] && argv[i][1]; i++)
+    {
+        if (0 == strcmp(argv[i], "-resume"))
+        {
+            options->resume = true;
+            continue;
+        }
+
+        if (0 == strcmp(argv[i], "-score"))
+        {
+            options->score = true;
+            continue;
+        }
+
+        if (0 == strcmp(argv[i], "-memprofile"))
+        {
+            options->memory_profile = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            return -1;
+        }
+
+        if (0 == strcmp(argv[i], "-raw"))
+        {
+            if (2 != sscanf(argv[++i], "%ix%i", &options->raw_width, &options->raw_height))
+            {
+                return -1;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-rate"))
+        {
+            options->raw_frame_rate = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-threads"))
+        {
+            options->sequence_threads = max(atoi(argv[++i]), 0);
+        }
+        else if (0 == strcmp(argv[i], "-index"))
+        {
+            options->index_interval = max(atoi(argv[++i]), 1);
+        }
+        else if (0 == strcmp(argv[i], "-keyint"))
+        {
+            options->keyframe_interval = max(atoi(argv[++i]), 0);
+        }
+        else if (0 == strcmp(argv[i], "-scenecut"))
+        {
+            options->scene_threshold = max(atof(argv[++i]), 0.0);
+        }
+        else if (0 == strcmp(argv[i], "-start"))
+        {
+            options->start_frame = strtoull(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-end"))
+        {
+            options->end_frame = strtoull(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-step"))
+        {
+            options->frame_step = max(atoi(argv[++i]), 1);
+        }
+        else if (0 == strcmp(argv[i], "-stats"))
+        {
+            options->stats_filename = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-metrics"))
+        {
+            options->metrics_address = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-scorefile"))
+        {
+            options->score = true;
+            options->score_filename = argv[++i];
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (3 != argc - i || (options->end_frame && options->end_frame <= options->start_frame))
+    {
+        return -1;
+    }
+
+    options->source_filename = argv[i];
+    options->quality = atoi(argv[i + 1]);
+    options->dest_filename = argv[i + 2];
+
+    if (options->raw_width && 0.0f == options->raw_frame_rate)
+    {
+        options->raw_frame_rate = 30.0f;
+    }
+
+    return 0;
+}
+
+bool _write_output(EVX_CONVERT_OUTPUT *output, const void *data, uint32 size)
+{
+    if (size && 1 != fwrite(data, size, 1, output->file))
+    {
+        return false;
+    }
+
+    output->offset += size;
+
+    return true;
+}
+
+bool _write_index_record(EVX_CONVERT_OUTPUT *output, uint32 flags)
+{
+    EVX_MEDIA_INDEX_HEADER index_header;
+
+    evx_set_magic(index_header.magic, "EVIX");
+    index_header.header_size = sizeof(index_header);
+    index_header.frame_count = output->frame_count;
+    index_header.entry_count = output->index_count;
+    index_header.flags = flags;
+
+    if (!_write_output(output, &index_header, sizeof(index_header)) ||
+        !_write_output(output, output->index_entries, output->index_count * sizeof(EVX_MEDIA_INDEX_ENTRY)))
+    {
+        return false;
+    }
+
+    output->index_count = 0;
+
+    // Flush each index record so that readers following the file see 
+    // complete records as early as possible.
+    return 0 == fflush(output->file);
+}
+
+bool _write_frame_record(EVX_CONVERT_OUTPUT *output, bit_stream *cairo_stream, uint32 flags, int64 timestamp, uint32 duration)
+{
+    EVX_MEDIA_FRAME_HEADER frame_header;
+    EVX_MEDIA_INDEX_ENTRY *entry = &output->index_entries[output->index_count++];
+
+    evx_set_magic(frame_header.magic, "EVFH");
+    frame_header.header_size = sizeof(frame_header);
+    frame_header.frame_index = output->frame_count++;
+    frame_header.frame_size = cairo_stream->query_byte_occupancy();
+    frame_header.flags = flags | EVX_FRAME_FLAG_TIMESTAMP;
+    frame_header.timestamp = timestamp;
+    frame_header.duration = duration;
+
+    entry->frame_index = frame_header.frame_index;
+    entry->offset = output->offset;
+
+    if (!_write_output(output, &frame_header, sizeof(frame_header)) ||
+        !_write_output(output, cairo_stream->query_data(), frame_header.frame_size))
+    {
+        return false;
+    }
+
+    if (output->index_count >= output->index_interval)
+    {
+        return _write_index_record(output, 0);
+    }
+
+    return true;
+}
+
+void _prepare_checkpoint_filename(const EVX_CONVERT_OPTIONS &options, char *filename, uint32 size)
+{
+    snprintf(filename, size, "%s%s", options.dest_filename, EVX_CHECKPOINT_EXTENSION);
+}
+
+void _prepare_checkpoint(EVX_CONVERT_CHECKPOINT *checkpoint, const EVX_CONVERT_OPTIONS &options)
+{
+    memset(checkpoint, 0, sizeof(EVX_CONVERT_CHECKPOINT));
+    evx_set_magic(checkpoint->magic, "EVCP");
+    checkpoint->header_size = sizeof(EVX_CONVERT_CHECKPOINT);
+    checkpoint->quality = options.quality;
+    checkpoint->index_interval = options.index_interval;
+    checkpoint->keyframe_interval = options.keyframe_interval;
+    checkpoint->scene_threshold = options.scene_threshold;
+    checkpoint->frame_step = options.frame_step;
+    checkpoint->raw_frame_rate = options.raw_frame_rate;
+    checkpoint->start_frame = options.start_frame;
+    checkpoint->end_frame = options.end_frame;
+    snprintf(checkpoint->source_filename, sizeof(checkpoint->source_filename), "%s", options.source_filename);
+}
+
+bool _sync_file(FILE *file)
+{
+    if (0 != fflush(file))
+    {
+        return false;
+    }
+
+#if defined(EVX_PLATFORM_WINDOWS)
+    return 0 == _commit(_fileno(file));
+#else
+    return 0 == fsync(fileno(file));
+#endif
+}
+
+bool _truncate_file(FILE *file, uint64 size)
+{
+    fflush(file);
+
+#if defined(EVX_PLATFORM_WINDOWS)
+    if (0 != _chsize_s(_fileno(file), size))
+#else
+    if (0 != ftruncate(fileno(file), size))
+#endif
+    {
+        return false;
+    }
+
+    return 0 == fseek(file, size, SEEK_SET);
+}
+
+// The checkpoint is written to a temporary file that replaces the previous
+// one, so a crash leaves either the old or the new checkpoint intact.
+bool _save_checkpoint(const EVX_CONVERT_OPTIONS &options, const EVX_MEDIA_FILE_HEADER &header, 
+                      const EVX_CONVERT_OUTPUT &output, uint64 source_frame)
+{
+    EVX_CONVERT_CHECKPOINT checkpoint;
+    char filename[EVX_CHECKPOINT_MAX_PATH + 32];
+    char temp_filename[EVX_CHECKPOINT_MAX_PATH + 48];
+
+    // Everything the checkpoint refers to must be on disk before it is.
+    if (!_sync_file(output.file))
+    {
+        return false;
+    }
+
+    _prepare_checkpoint(&checkpoint, options);
+    checkpoint.header = header;
+    checkpoint.output_offset = output.offset;
+    checkpoint.frame_count = output.frame_count;
+    checkpoint.source_frame = source_frame;
+
+    _prepare_checkpoint_filename(options, filename, sizeof(filename));
+    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename);
+
+    FILE *file = fopen(temp_filename, "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    bool result = (1 == fwrite(&checkpoint, sizeof(checkpoint), 1, file)) && _sync_file(file);
+
+    if (0 != fclose(file) || !result)
+    {
+        remove(temp_filename);
+        return false;
+    }
+
+#if defined(EVX_PLATFORM_WINDOWS)
+    remove(filename);
+#endif
+
+    return 0 == rename(temp_filename, filename);
+}
+
+int32 _load_checkpoint(const EVX_CONVERT_OPTIONS &options, EVX_CONVERT_CHECKPOINT *checkpoint)
+{
+    EVX_CONVERT_CHECKPOINT expected;
+    char filename[EVX_CHECKPOINT_MAX_PATH + 32];
+
+    _prepare_checkpoint_filename(options, filename, sizeof(filename));
+    _prepare_checkpoint(&expected, options);
+
+    FILE *file = fopen(filename, "rb");
+
+    if (!file)
+    {
+        return -1;
+    }
+
+    bool result = (1 == fread(checkpoint, sizeof(EVX_CONVERT_CHECKPOINT), 1, file));
+    fclose(file);
+
+    // The options are compared field by field, from quality to the source
+    // filename, as a checkpoint of a different conversion is useless.
+    if (!result || !evx_check_magic(checkpoint->magic, "EVCP") || sizeof(EVX_CONVERT_CHECKPOINT) != checkpoint->header_size ||
+        0 != memcmp(&checkpoint->quality, &expected.quality, sizeof(expected) - offsetof(EVX_CONVERT_CHECKPOINT, quality)))
+    {
+        evx_msg("Ignoring checkpoint %s, which does not match this conversion", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+// A checkpoint is only useful if the output still holds everything that it
+// refers to. The frame count in the file header is the only field that is
+// rewritten, when the conversion finishes.
+bool _check_checkpoint_output(const EVX_CONVERT_OPTIONS &options, const EVX_CONVERT_CHECKPOINT &checkpoint, FILE *file)
+{
+    EVX_MEDIA_FILE_HEADER header;
+
+    bool result = (0 == fseek(file, 0, SEEK_END)) && (uint64) ftell(file) >= checkpoint.output_offset &&
+                  (0 == fseek(file, 0, SEEK_SET)) && (1 == fread(&header, sizeof(header), 1, file));
+
+    if (result)
+    {
+        header.frame_count = checkpoint.header.frame_count;
+        result = (0 == memcmp(&header, &checkpoint.header, sizeof(header)));
+    }
+
+    if (!result)
+    {
+        evx_msg("Ignoring checkpoint, as %s no longer holds the frames it refers to", options.dest_filename);
+    }
+
+    return result;
+}
+
+void _remove_checkpoint(const EVX_CONVERT_OPTIONS &options)
+{
+    char filename[EVX_CHECKPOINT_MAX_PATH + 32];
+
+    _prepare_checkpoint_filename(options, filename, sizeof(filename));
+    remove(filename);
+}
+
+// Restarts the encoder so that the next frame becomes an entry point.
+void _reset_encoder(evx1_encoder **encoder)
+{
+    if (*encoder)
+    {
+        destroy_encoder(*encoder);
+    }
+
+    create_encoder(encoder);
+}
+
+bool _finish_output(EVX_CONVERT_OUTPUT *output, EVX_MEDIA_FILE_HEADER *header)
+{
+    if (!_write_index_record(output, EVX_INDEX_FLAG_FINAL))
+    {
+        return false;
+    }
+
+    // Seekable outputs also get an exact frame count in the file header.
+    if (!output->streaming)
+    {
+        header->frame_count = output->frame_count;
+
+        if (0 != fseek(output->file, 0, SEEK_SET) ||
+            1 != fwrite(header, sizeof(EVX_MEDIA_FILE_HEADER), 1, output->file))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int32 evx_converter_open(EVX_CONVERTER *converter)
+{
+    converter->encoder = NULL;
+    converter->encoder_used = false;
+    converter->image_allocated = false;
+    converter->index_entries = NULL;
+    converter->index_capacity = 0;
+    converter->callback = NULL;
+    converter->callback_context = NULL;
+
+    create_encoder(&converter->encoder);
+    converter->cairo_stream.resize_capacity((4*EVX_MB) << 3);
+
+    return converter->encoder ? 0 : -1;
+}
+
+void evx_converter_close(EVX_CONVERTER *converter)
+{
+    if (converter->encoder)
+    {
+        destroy_encoder(converter->encoder);
+        converter->encoder = NULL;
+    }
+
+    if (converter->image_allocated)
+    {
+        destroy_image(&converter->frame_image);
+        converter->image_allocated = false;
+    }
+
+    delete [] converter->index_entries;
+    converter->index_entries = NULL;
+    converter->index_capacity = 0;
+}
+
+// Buffers are only reallocated when a run needs more than the last one.
+void _prepare_buffers(EVX_CONVERTER *converter, uint32 width, uint32 height, uint32 index_interval)
+{
+    if (converter->image_allocated && 
+        (converter->frame_image.query_width() != width || converter->frame_image.query_height() != height))
+    {
+        destroy_image(&converter->frame_image);
+        converter->image_allocated = false;
+    }
+
+    if (!converter->image_allocated)
+    {
+        create_image(EVX_IMAGE_FORMAT_R8G8B8, width, height, &converter->frame_image);
+        converter->image_allocated = true;
+    }
+
+    if (converter->index_capacity < index_interval)
+    {
+        delete [] converter->index_entries;
+        converter->index_entries = new EVX_MEDIA_INDEX_ENTRY[index_interval];
+        converter->index_capacity = index_interval;
+    }
+
+    converter->cairo_stream.empty();
+}
+
+int32 _open_source(const EVX_CONVERT_OPTIONS &options, int32 *width, int32 *height, EVX_FRAME_SOURCE *source)
+{
+    if (evx_is_image_sequence(options.source_filename))
+    {
+        float frame_rate = (options.raw_frame_rate > 0.0f) ? options.raw_frame_rate : 30.0f;
+
+        return evx_open_sequence_source(options.source_filename, options.raw_width, options.raw_height, frame_rate, 
+                                        options.sequence_threads, width, height, source);
+    }
+
+    if (options.raw_width)
+    {
+        *width = options.raw_width;
+        *height = options.raw_height;
+
+        return evx_open_rawvideo_source(options.source_filename, *width, *height, options.raw_frame_rate, source);
+    }
+
+    return evx_open_ffmpeg_source(options.source_filename, width, height, source);
+}
+
+FILE *evx_open_convert_output(const EVX_CONVERT_OPTIONS &options)
+{
+    FILE *file = NULL;
+
+    if (options.resume && 0 != strcmp(options.dest_filename, "-"))
+    {
+        file = fopen(options.dest_filename, "r+b");
+    }
+
+    return file ? file : evx_open_output_file(options.dest_filename);
+}
+
+int32 evx_converter_run(EVX_CONVERTER *converter, const EVX_CONVERT_OPTIONS &options, FILE *dest_file)
+{
+    int32 encoded_size = 0;
+    int32 content_width = 0;
+    int32 content_height = 0;
+    int32 result = 0;
+    EVX_MEDIA_FILE_HEADER header;
+    EVX_CONVERT_OUTPUT output;
+    EVX_CONVERT_CHECKPOINT checkpoint;
+    EVX_FRAME_SOURCE source;
+    EVX_CONVERT_METRICS metrics;
+    EVX_METRICS_EXPORTER exporter;
+    EVX_QUALITY_ENGINE quality_engine;
+    EVX_MEMORY_PROFILE memory_profile;
+    EVX_SCENE_DETECTOR scene_detector;
+    FILE *score_file = NULL;
+
+    // Buffers prepared for this run are included in the profile.
+    if (options.memory_profile)
+    {
+        evx_memory_enable();
+        evx_memory_begin(&memory_profile);
+    }
+
+    memset(&output, 0, sizeof(output));
+    output.file = dest_file;
+    output.streaming = (0 == strcmp(options.dest_filename, "-"));
+    output.index_interval = options.index_interval;
+
+    if (0 != _open_source(options, &content_width, &content_height, &source))
+    {
+        return -1;
+    }
+
+    _prepare_buffers(converter, content_width, content_height, options.index_interval);
+    output.index_entries = converter->index_entries;
+
+    bool checkpointing = options.resume && !output.streaming;
+    bool resumed = checkpointing && 0 == _load_checkpoint(options, &checkpoint) &&
+                   checkpoint.header.frame_width == (uint32) content_width && 
+                   checkpoint.header.frame_height == (uint32) content_height &&
+                   _check_checkpoint_output(options, checkpoint, output.file);
+
+    // Only trimmed or subsampled conversions need to position the source; 
+    // the frames in between are never converted.
+    bool seeking = options.start_frame || options.frame_step > 1 || resumed;
+    uint64 source_frame = options.start_frame;
+
+    if (resumed)
+    {
+        // Anything written after the checkpoint is discarded and rewritten.
+        header = checkpoint.header;
+        output.offset = checkpoint.output_offset;
+        output.frame_count = checkpoint.frame_count;
+        source_frame = checkpoint.source_frame;
+
+        if (!_truncate_file(output.file, output.offset))
+        {
+            evx_msg("Error truncating dest file %s", options.dest_filename);
+            source.deinitialize();
+            return -1;
+        }
+
+        evx_msg("Resuming at frame %llu (source frame %llu)", output.frame_count, source_frame);
+    }
+    else
+    {
+        if (checkpointing && !_truncate_file(output.file, 0))
+        {
+            evx_msg("Error truncating dest file %s", options.dest_filename);
+            source.deinitialize();
+            return -1;
+        }
+
+        _prepare_evx_header(&header, source, options, content_width, content_height, output.streaming);
+        _write_output(&output, &header, sizeof(header));
+    }
+
+    image *frame_image = &converter->frame_image;
+    bit_stream *cairo_stream = &converter->cairo_stream;
+    bool restart_encoder = true;
+    bool detecting = options.scene_threshold > 0.0 && 
+                     0 == evx_scene_open(content_width, content_height, options.scene_threshold, &scene_detector);
+    uint64 entry_frame = output.frame_count;
+    uint64 entry_count = 0;
+    uint64 scene_cut_count = 0;
+    bool exporting = options.stats_filename || options.metrics_address;
+
+    evx_reset_convert_metrics(&metrics);
+    metrics.frames_written = output.frame_count;
+    metrics.frame_count = header.frame_count;
+
+    if (exporting && 0 != evx_metrics_open(&metrics, options.stats_filename, options.metrics_address, &exporter))
+    {
+        exporting = false;
+    }
+
+    if (options.score_filename && !(score_file = fopen(options.score_filename, "w")))
+    {
+        evx_msg("Failed to open score file %s", options.score_filename);
+    }
+
+    if (options.score)
+    {
+        evx_quality_open(content_width, content_height, score_file, &quality_engine);
+    }
+
+    while (!options.end_frame || source_frame < options.end_frame)
+    {
+        evx_metrics_clock::time_point stage_time = evx_metrics_clock::now();
+        evx_memory_set_stage(EVX_MEMORY_STAGE_INGEST);
+
+        if ((seeking && source.seek_frame(source_frame) < 0) || source.refresh(&encoded_size) < 0)
+        {
+            break;
+        }
+
+        long long frame_timestamp = 0;
+        int32 frame_duration = 0;
+
+        // Frames that are stepped over extend the display of the one before.
+        source_frame += options.frame_step;
+        source.copy_current_frame(frame_image->query_data(), frame_image->query_row_pitch());
+        source.get_frame_time(&frame_timestamp, (int*) &frame_duration);
+        frame_duration *= options.frame_step;
+
+        double scene_score = 0.0;
+        bool scene_cut = detecting && evx_scene_detect(&scene_detector, frame_image->query_data(), frame_image->query_row_pitch(), &scene_score);
+        stage_time = evx_add_stage_time(&metrics, EVX_CONVERT_STAGE_READ, stage_time);
+
+        uint32 frame_flags = 0;
+        evx_memory_set_stage(EVX_MEMORY_STAGE_ENCODE);
+
+        // Every run begins with an entry point, so an encoder that has seen
+        // frames from a previous run is restarted as well. Scene cuts also
+        // start a fresh encoder, since prediction from the previous scene
+        // gains little, and the interval limit counts from the latest one.
+        if (restart_encoder || scene_cut || 
+            (options.keyframe_interval && output.frame_count - entry_frame >= options.keyframe_interval))
+        {
+            if (scene_cut)
+            {
+                evx_msg("Scene cut at frame %llu (score %.1f)", output.frame_count, scene_score);
+                scene_cut_count++;
+            }
+
+            restart_encoder = false;
+            entry_frame = output.frame_count;
+            entry_count++;
+
+            if (converter->encoder_used)
+            {
+                _reset_encoder(&converter->encoder);
+            }
+
+            converter->encoder->set_quality(options.quality);
+            frame_flags |= EVX_FRAME_FLAG_ENTRY_POINT;
+        }
+
+        // encode using cairo and then flush the frame to disk.
+        converter->encoder->encode(frame_image->query_data(), frame_image->query_width(), frame_image->query_height(), cairo_stream);
+        converter->encoder_used = true;
+        stage_time = evx_add_stage_time(&metrics, EVX_CONVERT_STAGE_ENCODE, stage_time);
+
+        // The scoring thread works on copies, so the encoder can move on to
+        // the next frame while this one is measured.
+        evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
+
+        if (options.score)
+        {
+            EVX_QUALITY_SLOT *slot = evx_quality_acquire(&quality_engine);
+
+            evx_quality_copy(slot->source, frame_image->query_data(), content_width, content_height, frame_image->query_row_pitch());
+            converter->encoder->peek(EVX_PEEK_DESTINATION, slot->dest);
+            evx_quality_submit(&quality_engine, output.frame_count);
+        }
+
+        uint64 frame_size = cairo_stream->query_byte_occupancy();
+        evx_memory_set_stage(EVX_MEMORY_STAGE_WRITE);
+
+        if (!_write_frame_record(&output, cairo_stream, frame_flags, frame_timestamp, max(frame_duration, 0)))
+        {
+            evx_msg("Error writing frame %llu, stopping", output.frame_count);
+            result = -1;
+            break;
+        }
+
+        cairo_stream->empty();
+
+        if (checkpointing && 0 == output.index_count && !_save_checkpoint(options, header, output, source_frame))
+        {
+            evx_msg("Error saving checkpoint for %s", options.dest_filename);
+        }
+
+        evx_add_stage_time(&metrics, EVX_CONVERT_STAGE_WRITE, stage_time);
+        evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
+
+        if (options.memory_profile)
+        {
+            evx_memory_frame(&memory_profile);
+        }
+        metrics.bytes_written += frame_size;
+        metrics.max_frame_size = max(metrics.max_frame_size.load(), frame_size);
+        metrics.frames_written = output.frame_count;
+
+        if (converter->callback && !converter->callback(converter->callback_context, output.frame_count, header.frame_count))
+        {
+            result = EVX_CONVERT_CANCELLED;
+            break;
+        }
+    }
+
+    evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
+
+    if (detecting)
+    {
+        evx_msg("Marked %llu entry points, %llu of them at scene cuts", entry_count, scene_cut_count);
+        evx_scene_close(&scene_detector);
+    }
+
+    if (!_finish_output(&output, &header))
+    {
+        evx_msg("Error finalizing dest file %s", options.dest_filename);
+        result = -1;
+    }
+
+    if (exporting)
+    {
+        evx_metrics_close(&exporter);
+    }
+
+    if (options.score)
+    {
+        EVX_QUALITY_SUMMARY summary;
+
+        evx_quality_close(&quality_engine);
+        evx_quality_query(&quality_engine, &summary);
+        evx_print_quality_summary(summary);
+    }
+
+    if (score_file)
+    {
+        fclose(score_file);
+    }
+
+    // Interrupted conversions keep their checkpoint so they can be resumed.
+    if (checkpointing && 0 == result)
+    {
+        _remove_checkpoint(options);
+    }
+
+    source.deinitialize();
+
+    if (options.memory_profile)
+    {
+        evx_memory_print(&memory_profile, options.dest_filename);
+    }
+
+    return result;
+}
@@ -0,0 +1,167 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_converter.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_CONVERTER_H__
+#define __EVX_CONVERTER_H__
+
+#include "cairo/base.h"
+#include "cairo/evx1.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+#include "evx_source.h"
+
+// The converter is the engine behind the convert tool. It owns an encoder
+// and the frame and bitstream buffers, which are kept between runs so that
+// long lived processes only pay for their setup once.
+
+// Returned by evx_converter_run when the progress callback cancels a run.
+#define EVX_CONVERT_CANCELLED           (1)
+
+typedef struct EVX_CONVERT_OPTIONS
+{
+    char *source_filename;
+    char *dest_filename;
+    int32 quality;
+
+    int32 raw_width;            // non-zero if the source, or image sequence frames, are raw rgb24.
+    int32 raw_height;
+    float raw_frame_rate;       // frame rate of raw sources and image sequences.
+    uint32 sequence_threads;    // threads decoding image sequences, zero for one per core.
+
+    uint32 index_interval;
+    uint32 keyframe_interval;   // maximum frames between entry points, zero for no limit.
+    double scene_threshold;     // scene detection threshold, zero to disable.
+
+    uint64 start_frame;         // first source frame to convert.
+    uint64 end_frame;           // source frame to stop at, zero for the end of the source.
+    uint32 frame_step;          // convert every nth source frame.
+
+    bool resume;                // checkpoint the output, and resume from a previous checkpoint.
+
+    const char *stats_filename; // file to keep updated with metrics, may be NULL.
+    const char *metrics_address;// unix socket path or [host]:port to serve metrics on, may be NULL.
+
+    bool score;                 // measure psnr and ssim of the encoded frames.
+    const char *score_filename; // file to write per frame scores to, may be NULL.
+
+    bool memory_profile;        // track allocations per stage and report the footprint.
+
+} EVX_CONVERT_OPTIONS;
+
+typedef struct EVX_CONVERT_OUTPUT
+{
+    FILE *file;
+    bool streaming;             // true if the output cannot be back-patched.
+    uint64 offset;
+    uint64 frame_count;
+
+    EVX_MEDIA_INDEX_ENTRY *index_entries;
+    uint32 index_count;
+    uint32 index_interval;
+
+} EVX_CONVERT_OUTPUT;
+
+// Resumable conversions keep a checkpoint next to the output, in a file
+// with EVX_CHECKPOINT_EXTENSION appended to its name. A checkpoint is saved
+// after each index record, once the output has been synced to disk, and is
+// removed when the conversion completes. Converting again with the same 
+// options truncates the output to the checkpoint and continues from there.
+
+#define EVX_CHECKPOINT_EXTENSION        ".checkpoint"
+#define EVX_CHECKPOINT_MAX_PATH         (1024)
+
+#pragma pack( push )
+#pragma pack( 2 )
+
+typedef struct EVX_CONVERT_CHECKPOINT
+{
+    uint8 magic[4];             // must be 'EVCP'
+    uint32 header_size;         // must be sizeof(EVX_CONVERT_CHECKPOINT)
+
+    EVX_MEDIA_FILE_HEADER header;
+    uint64 output_offset;       // end of the last index record written.
+    uint64 frame_count;         // frames written before output_offset.
+    uint64 source_frame;        // next source frame to convert.
+
+    // The options that shape the output must match to resume.
+    int32 quality;
+    uint32 index_interval;
+    uint32 keyframe_interval;
+    double scene_threshold;     // entry points follow scene cuts.
+    uint32 frame_step;
+    float raw_frame_rate;
+    uint64 start_frame;
+    uint64 end_frame;
+    char source_filename[EVX_CHECKPOINT_MAX_PATH];
+
+} EVX_CONVERT_CHECKPOINT;
+
+#pragma pack(pop)
+
+// Called after every frame that is written, with the expected total taken
+// from the file header (zero if unknown). Returning false cancels the run.
+typedef bool (*EVX_CONVERT_CALLBACK)(void *context, uint64 frames_written, uint64 frame_count);
+
+typedef struct EVX_CONVERTER
+{
+    evx1_encoder *encoder;
+    bool encoder_used;          // true once the encoder holds state from a frame.
+
+    image frame_image;
+    bool image_allocated;
+    bit_stream cairo_stream;
+
+    EVX_MEDIA_INDEX_ENTRY *index_entries;
+    uint32 index_capacity;
+
+    EVX_CONVERT_CALLBACK callback;
+    void *callback_context;
+
+} EVX_CONVERTER;
+
+// Parses the arguments of the convert tool, where argv[0] is the program
+// or command name and is ignored.
+int32 evx_parse_convert_options(int argc, char **argv, EVX_CONVERT_OPTIONS *options);
+
+int32 evx_converter_open(EVX_CONVERTER *converter);
+void evx_converter_close(EVX_CONVERTER *converter);
+
+// Opens options.dest_filename for evx_converter_run. Resumable outputs are
+// opened without being truncated, so that a checkpoint can be used.
+FILE *evx_open_convert_output(const EVX_CONVERT_OPTIONS &options);
+
+// Converts options.source_filename into dest_file, which the caller has 
+// opened with evx_open_convert_output. Returns 0 on
+// success, EVX_CONVERT_CANCELLED if cancelled by the callback, or -1.
+int32 evx_converter_run(EVX_CONVERTER *converter, const EVX_CONVERT_OPTIONS &options, FILE *dest_file);
+
+#endif // __EVX_CONVERTER_H__
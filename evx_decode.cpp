@@ -0,0 +1,226 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_decode.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "cairo/evx1.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+#include "evx_reader.h"
+#include "evx_output.h"
+#include "evx_segment.h"
+
+#include <thread>
+#include <chrono>
+
+// Every decoded frame is written by the main thread, from either a single
+// reader or a segment decoder.
+typedef struct EVX_DECODE_SOURCE
+{
+    EVX_READER reader;
+    EVX_SEGMENT_DECODER segments;
+    bool segmented;
+    image frame_image;
+
+} EVX_DECODE_SOURCE;
+
+int32 _open_decode_source(const char *filename, bool follow, int32 thread_count, EVX_DECODE_SOURCE *source)
+{
+    source->segmented = (thread_count >= 0);
+
+    if (source->segmented)
+    {
+        if (evx_segment_open(filename, thread_count, 0, &source->segments) < 0)
+        {
+            return -1;
+        }
+
+        evx_print_file_header(source->segments.header);
+        evx_msg("Decoding %u segments on %u threads with %u frames of reordering", (uint32) source->segments.segments.size(), 
+            evx_segment_query_thread_count(&source->segments), source->segments.slot_count);
+
+        return 0;
+    }
+
+    if (evx_reader_open(filename, &source->reader) < 0)
+    {
+        return -1;
+    }
+
+    source->reader.follow = follow;
+
+    evx_print_file_header(source->reader.header);
+
+    EVX_MEDIA_FILE_HEADER *header = &source->reader.header;
+    create_image(EVX_IMAGE_FORMAT_R8G8B8, header->frame_width, header->frame_height, &source->frame_image);
+
+    return 0;
+}
+
+void _close_decode_source(EVX_DECODE_SOURCE *source)
+{
+    if (source->segmented)
+    {
+        evx_segment_close(&source->segments);
+        return;
+    }
+
+    destroy_image(&source->frame_image);
+    evx_reader_close(&source->reader);
+}
+
+// Returns 0 with the next frame, EVX_READER_PENDING if following a file 
+// that has no further frames yet, or -1 at the end or on error.
+int32 _next_decode_frame(EVX_DECODE_SOURCE *source, image **frame)
+{
+    if (source->segmented)
+    {
+        return (0 == evx_segment_next_frame(&source->segments, frame)) ? 0 : -1;
+    }
+
+    if (evx_reader_is_done(&source->reader))
+    {
+        return -1;
+    }
+
+    *frame = &source->frame_image;
+
+    return evx_reader_next_frame(&source->reader, &source->frame_image);
+}
+
+int main(int argc, char **argv)
+{
+    EVX_DECODE_SOURCE source;
+    EVX_ASYNC_WRITER writer;
+    EVX_OUTPUT_FORMAT format;
+    uint64 frame_count = 0;
+    bool follow = false;
+    int32 thread_count = -1;
+    int32 i = 1;
+
+    for (; i < argc && '-' == argv[i][0] && argv[i][1]; i++)
+    {
+        if (0 == strcmp(argv[i], "-follow"))
+        {
+            follow = true;
+        }
+        else if (0 == strcmp(argv[i], "-threads") && i < argc - 1)
+        {
+            thread_count = max(atoi(argv[++i]), 0);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    // Skip past any options to the positional arguments.
+    argc -= i - 1;
+    argv += i - 1;
+
+    // Segments are located through the index, which requires a complete,
+    // seekable file.
+    bool segment_conflict = (thread_count >= 0) && (follow || (argc > 1 && 0 == strcmp(argv[1], "-")));
+
+    if (4 != argc || segment_conflict || evx_parse_output_format(argv[2], &format) < 0)
+    {
+        // Use stderr here, as stdout may be feeding another process.
+        fprintf(stderr, "Required syntax: decode [-follow | -threads <count>] <input_filename|-> <rgb|y4m|bgra> <output_filename|->\n");
+        return 0;
+    }
+
+    // Open the output first so that any stdout redirection is in place 
+    // before the reader starts reporting.
+    if (evx_writer_open(argv[3], &writer) < 0)
+    {
+        return 0;
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    if (_open_decode_source(argv[1], follow, thread_count, &source) < 0)
+    {
+        evx_writer_close(&writer);
+        return 0;
+    }
+
+    EVX_MEDIA_FILE_HEADER *header = source.segmented ? &source.segments.header : &source.reader.header;
+
+    while (true)
+    {
+        image *frame_image = NULL;
+        int32 result = _next_decode_frame(&source, &frame_image);
+
+        if (EVX_READER_PENDING == result)
+        {
+            // The file is still being written, so wait for more data.
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        if (result < 0)
+        {
+            break;
+        }
+
+        uint8 *dest = evx_writer_acquire(&writer, evx_query_output_size(format, header->frame_width, header->frame_height));
+        uint32 size = 0;
+
+        if (0 == frame_count)
+        {
+            size += evx_write_output_header(format, header->frame_width, header->frame_height, header->frame_rate, dest);
+        }
+
+        size += evx_write_output_frame(format, frame_image, dest + size);
+
+        if (evx_writer_submit(&writer, size) < 0)
+        {
+            evx_msg("Error writing frame %llu, stopping", frame_count);
+            break;
+        }
+
+        if (0 == (++frame_count % 100))
+        {
+            evx_msg("Decoded frame %llu", frame_count);
+        }
+    }
+
+    if (evx_writer_close(&writer) < 0)
+    {
+        evx_msg("Error flushing output %s", argv[3]);
+    }
+
+    evx_msg("Decoded %llu frames", frame_count);
+
+    _close_decode_source(&source);
+
+    return 0;
+}
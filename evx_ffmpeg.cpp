@@ -32,6 +32,8 @@
 
 #include "cairo/base.h"
 
+#include <math.h>
+
 extern "C" {
 
 #include "ffmpeg/libavformat/avformat.h"
@@ -48,8 +50,22 @@ unsigned char *g_raw_buffer = NULL;
 unsigned char *g_raw_buffer_0 = NULL;
 int g_buffer_size = 0;
 int g_current_stream_index = -1;
+int g_frame_ready = 0;
+int64_t g_next_frame = 0;
+int64_t g_frame_timestamp = 0;      // presentation time of the current frame, in microseconds.
+int64_t g_frame_duration = 0;
 static struct SwsContext * g_scale_context = 0;
 
+// Decoded frames carry their own best effort timestamp and the duration of
+// the packet they were coded in only in later libavcodec releases.
+#define EVX_FFMPEG_VERSION(major, minor) (LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(major, minor, 100) && LIBAVCODEC_VERSION_MICRO >= 100)
+#define EVX_FFMPEG_FRAME_BEST_EFFORT_TIMESTAMP  EVX_FFMPEG_VERSION(53, 35)
+#define EVX_FFMPEG_FRAME_PKT_DURATION           EVX_FFMPEG_VERSION(54, 59)
+
+// Seeking by container is only worthwhile for jumps longer than a typical
+// keyframe interval; shorter gaps are decoded through without conversion.
+#define FFMPEG_SEEK_THRESHOLD   (64)
+
 int ffmpeg_initialize()
 {
     av_register_all();
@@ -60,6 +76,8 @@ int ffmpeg_reset()
 {
     g_buffer_size = 0;
     g_current_stream_index = -1;
+    g_frame_ready = 0;
+    g_next_frame = 0;
 
     if (g_scale_context) sws_freeContext(g_scale_context);
     if (g_raw_buffer_0) av_free(g_raw_buffer_0);
@@ -69,6 +87,17 @@ int ffmpeg_reset()
     if (g_codec_context) avcodec_close(g_codec_context);
     if (g_format_context) av_close_input_file(g_format_context);
 
+    // Workers open many files in one process, and a later file that fails
+    // to open resets again, so nothing freed here may be freed twice.
+    g_scale_context = NULL;
+    g_raw_buffer_0 = NULL;
+    g_raw_buffer = NULL;
+    g_frame_2 = NULL;
+    g_frame = NULL;
+    g_codec_context = NULL;
+    g_codec = NULL;
+    g_format_context = NULL;
+
     return 0;
 }
 
@@ -77,7 +106,7 @@ int ffmpeg_deinitialize()
     return ffmpeg_reset();
 }
 
-int64_t ffmpeg_get_frame_count()
+long long ffmpeg_get_frame_count()
 {
     if (g_current_stream_index >= 0)
     {
@@ -87,6 +116,14 @@ int64_t ffmpeg_get_frame_count()
     return 0;
 }
 
+int ffmpeg_get_frame_time(long long *timestamp, int *duration)
+{
+    *timestamp = g_frame_timestamp;
+    *duration = (int) g_frame_duration;
+
+    return 0;
+}
+
 float ffmpeg_get_frame_rate()
 {
     if (g_current_stream_index >= 0)
@@ -103,6 +140,8 @@ int ffmpeg_play_file(char * filename, int *format, int *width, int *height)
 {
     unsigned int i = 0;
     g_current_stream_index = -1;
+    g_frame_ready = 0;
+    g_next_frame = 0;
 
     if (av_open_input_file(&g_format_context, filename, NULL, 0, NULL) != 0)
     {
@@ -232,11 +271,92 @@ int ffmpeg_copy_current_frame(unsigned char *dest, int row_pitch)
     return 0;
 }
 
-int ffmpeg_refresh(int *encoded_frame_size)
+static int64_t _ffmpeg_get_frame_number(int64_t timestamp)
+{
+    AVStream *stream = g_format_context->streams[g_current_stream_index];
+    int64_t start_time = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time : 0;
+    double seconds = (double) (timestamp - start_time) * stream->time_base.num / stream->time_base.den;
+
+    return (int64_t) floor(seconds * stream->r_frame_rate.num / stream->r_frame_rate.den + 0.5);
+}
+
+static int64_t _ffmpeg_get_timestamp(int64_t frame)
+{
+    AVStream *stream = g_format_context->streams[g_current_stream_index];
+    int64_t start_time = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time : 0;
+    double seconds = (double) frame * stream->r_frame_rate.den / stream->r_frame_rate.num;
+
+    return start_time + (int64_t) (seconds * stream->time_base.den / stream->time_base.num);
+}
+
+// Converts a stream timestamp, or a duration when start_time is zero, to
+// microseconds.
+static int64_t _ffmpeg_get_microseconds(int64_t timestamp, int64_t start_time)
+{
+    AVStream *stream = g_format_context->streams[g_current_stream_index];
+
+    return (int64_t) floor((double) (timestamp - start_time) * stream->time_base.num * 1000000.0 / stream->time_base.den + 0.5);
+}
+
+// Returns the presentation timestamp of the picture just decoded. With 
+// frame reordering, the packet that completes a picture is not the one it
+// was coded in, so the timestamps the decoder carried through with the 
+// picture are preferred over those of the packet.
+static int64_t _ffmpeg_get_picture_timestamp(const AVPacket &packet)
+{
+#if EVX_FFMPEG_FRAME_BEST_EFFORT_TIMESTAMP
+    if (g_frame->best_effort_timestamp != AV_NOPTS_VALUE)
+    {
+        return g_frame->best_effort_timestamp;
+    }
+#endif
+
+    if (g_frame->pkt_pts != AV_NOPTS_VALUE)
+    {
+        return g_frame->pkt_pts;
+    }
+
+    return (packet.pts != AV_NOPTS_VALUE) ? packet.pts : packet.dts;
+}
+
+// Returns the duration of the picture just decoded, in stream time base 
+// units, or zero if neither it nor the packet carries one.
+static int64_t _ffmpeg_get_picture_duration(const AVPacket &packet)
+{
+#if EVX_FFMPEG_FRAME_PKT_DURATION
+    if (g_frame->pkt_duration > 0)
+    {
+        return g_frame->pkt_duration;
+    }
+#endif
+
+    return (packet.duration > 0) ? packet.duration : 0;
+}
+
+// Records the timing of a decoded frame. Containers that do not carry 
+// durations fall back to the nominal frame rate.
+static void _ffmpeg_update_frame_time(const AVPacket &packet, int64_t timestamp)
+{
+    AVStream *stream = g_format_context->streams[g_current_stream_index];
+    int64_t start_time = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time : 0;
+    int64_t nominal_duration = (int64_t) floor(1000000.0 * stream->r_frame_rate.den / stream->r_frame_rate.num + 0.5);
+    int64_t duration = _ffmpeg_get_picture_duration(packet);
+
+    g_frame_timestamp = (timestamp != AV_NOPTS_VALUE) ? _ffmpeg_get_microseconds(timestamp, start_time) 
+                                                      : (g_next_frame - 1) * nominal_duration;
+    g_frame_duration = duration ? _ffmpeg_get_microseconds(duration, 0) : nominal_duration;
+}
+
+static void _ffmpeg_convert_frame()
+{
+    sws_scale(g_scale_context, g_frame->data, g_frame->linesize, 0, 
+              g_codec_context->height, g_frame_2->data, g_frame_2->linesize);
+}
+
+// Decodes the next video frame, converting it to rgb only if it will be 
+// used. Frame numbers are tracked from picture timestamps where available.
+static int _ffmpeg_decode_frame(int *encoded_frame_size, int convert)
 {
-    int i = 0;
-    int r = 0;
-    int stride = 0;
     int icompleted = 0;
     AVPacket packet;
 
@@ -263,9 +383,14 @@ int ffmpeg_refresh(int *encoded_frame_size)
 
             if (icompleted)
             {          
-				int i = 0;
-                int ret = sws_scale(g_scale_context, g_frame->data, g_frame->linesize, 0, 
-                                    g_codec_context->height, g_frame_2->data, g_frame_2->linesize );
+                int64_t timestamp = _ffmpeg_get_picture_timestamp(packet);
+                g_next_frame = (timestamp != AV_NOPTS_VALUE) ? _ffmpeg_get_frame_number(timestamp) + 1 : g_next_frame + 1;
+                _ffmpeg_update_frame_time(packet, timestamp);
+
+                if (convert)
+                {
+                    _ffmpeg_convert_frame();
+                }
 
                 av_free_packet(&packet);
                 return 0;
@@ -278,4 +403,62 @@ int ffmpeg_refresh(int *encoded_frame_size)
     return -1;
 }
 
+int ffmpeg_refresh(int *encoded_frame_size)
+{
+    // A frame already converted by ffmpeg_seek_frame is returned first.
+    if (g_frame_ready)
+    {
+        g_frame_ready = 0;
+        return 0;
+    }
+
+    return _ffmpeg_decode_frame(encoded_frame_size, 1);
+}
+
+int ffmpeg_seek_frame(long long frame)
+{
+    int64_t position = g_frame_ready ? g_next_frame - 1 : g_next_frame;
+
+    if (g_current_stream_index < 0)
+    {
+        return -1;
+    }
+
+    if (frame == position)
+    {
+        return 0;
+    }
+
+    g_frame_ready = 0;
+
+    // Long jumps go through the container, which lands on the keyframe at
+    // or before the target. Whatever remains is decoded but not converted.
+    if (frame < position || frame - position > FFMPEG_SEEK_THRESHOLD)
+    {
+        if (av_seek_frame(g_format_context, g_current_stream_index, _ffmpeg_get_timestamp(frame), AVSEEK_FLAG_BACKWARD) >= 0)
+        {
+            avcodec_flush_buffers(g_codec_context);
+        }
+        else if (frame < position)
+        {
+            printf("[FF] Failed to seek to frame %lli\n", frame);
+            return -1;
+        }
+    }
+
+    do
+    {
+        if (_ffmpeg_decode_frame(NULL, 0) < 0)
+        {
+            return -1;
+        }
+    } 
+    while (g_next_frame <= frame);
+
+    _ffmpeg_convert_frame();
+    g_frame_ready = 1;
+
+    return 0;
+}
+
 } // extern "C"
\ No newline at end of file
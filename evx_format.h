@@ -37,6 +37,36 @@
 
 using namespace evx;
 
+// Version 1 files contain only frame records, and their frame magic may not
+// be valid. Version 2 files always carry valid record magic and may
+// interleave index records between frame records, so readers dispatch on
+// the record magic and use header_size to skip fields they don't know.
+
+#define EVX_MEDIA_VERSION_LEGACY        (1)
+#define EVX_MEDIA_VERSION               (2)
+
+// Index records are written periodically by convert, so a stream never 
+// requires back-patching. The final record of a complete stream is an 
+// index record with EVX_INDEX_FLAG_FINAL set.
+
+#define EVX_INDEX_FLAG_FINAL            (0x1)
+#define EVX_DEFAULT_INDEX_INTERVAL      (64)
+
+// Entry points are frames that were encoded by a fresh encoder, and so can
+// be decoded by a fresh decoder without any of the frames before them. The
+// first frame of a stream is always an entry point, whether or not it was 
+// written with the flag.
+
+#define EVX_FRAME_FLAG_ENTRY_POINT      (0x1)
+
+// Frames carry their presentation time and duration, in microseconds, when
+// EVX_FRAME_FLAG_TIMESTAMP is set, so variable rate sources keep their 
+// timing. Frames written without timestamps are timed by the frame rate in
+// the file header.
+
+#define EVX_FRAME_FLAG_TIMESTAMP        (0x2)
+#define EVX_TIMESTAMP_SCALE             (1000000)
+
 #pragma pack( push )
 #pragma pack( 2 )
 
@@ -48,22 +78,76 @@ typedef struct EVX_MEDIA_FILE_HEADER
 
     uint32 frame_width;
     uint32 frame_height;
-    uint64 frame_count;         // only a hint, may be zero.
+    uint64 frame_count;         // only a hint, may be zero (always zero when streamed).
     float frame_rate;
 
     uint8 reserved[3];
 
 } EVX_MEDIA_FILE_HEADER;
 
+typedef struct EVX_MEDIA_RECORD_HEADER
+{
+    uint8 magic[4];
+    uint32 header_size;
+
+} EVX_MEDIA_RECORD_HEADER;
+
 typedef struct EVX_MEDIA_FRAME_HEADER
 {
     uint8 magic[4];              // must be 'EVFH'
-    uint32 header_size;          // must be sizeof(EVX_MEDIA_FILE_HEADER)
+    uint32 header_size;          // must be sizeof(EVX_MEDIA_FRAME_HEADER)
     uint64 frame_index;         
     uint32 frame_size;           // size of payload, not including the header
+    uint32 flags;
+    int64 timestamp;             // presentation time, if EVX_FRAME_FLAG_TIMESTAMP is set
+    uint32 duration;             // display time, if EVX_FRAME_FLAG_TIMESTAMP is set
 
 } EVX_MEDIA_FRAME_HEADER;
 
+typedef struct EVX_MEDIA_INDEX_HEADER
+{
+    uint8 magic[4];              // must be 'EVIX'
+    uint32 header_size;          // must be sizeof(EVX_MEDIA_INDEX_HEADER)
+    uint64 frame_count;          // total frames written before this record
+    uint32 entry_count;          // number of index entries that follow
+    uint32 flags;
+
+} EVX_MEDIA_INDEX_HEADER;
+
+typedef struct EVX_MEDIA_INDEX_ENTRY
+{
+    uint64 frame_index;
+    uint64 offset;               // offset of the frame record from the start of the file
+
+} EVX_MEDIA_INDEX_ENTRY;
+
 #pragma pack(pop)
 
+inline void evx_set_magic(uint8 *magic, const char *value)
+{
+    memcpy(magic, value, 4);
+}
+
+inline bool evx_check_magic(const uint8 *magic, const char *value)
+{
+    return 0 == memcmp(magic, value, 4);
+}
+
+// Returns the presentation time and duration of a frame in microseconds.
+inline void evx_query_frame_time(const EVX_MEDIA_FILE_HEADER &header, const EVX_MEDIA_FRAME_HEADER &frame_header, 
+                                 int64 *timestamp, uint32 *duration)
+{
+    if (frame_header.flags & EVX_FRAME_FLAG_TIMESTAMP)
+    {
+        *timestamp = frame_header.timestamp;
+        *duration = frame_header.duration;
+        return;
+    }
+
+    double frame_rate = (header.frame_rate > 0.0f) ? header.frame_rate : 1.0;
+
+    *timestamp = (int64) (frame_header.frame_index * EVX_TIMESTAMP_SCALE / frame_rate + 0.5);
+    *duration = (uint32) (EVX_TIMESTAMP_SCALE / frame_rate + 0.5);
+}
+
 #endif // __EVX_FORMAT_H__
\ No newline at end of file
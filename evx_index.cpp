@@ -0,0 +1,161 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_index.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_index.h"
+#include "evx_reader.h"
+
+int32 evx_build_frame_index(const char *filename, EVX_FRAME_INDEX *index)
+{
+    FILE *file = fopen(filename, "rb");
+    uint64 offset = sizeof(EVX_MEDIA_FILE_HEADER);
+
+    index->frames.clear();
+    index->file_size = 0;
+
+    if (!file)
+    {
+        evx_msg("Error opening source file %s", filename);
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    index->file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (1 != fread(&index->header, sizeof(index->header), 1, file) ||
+        evx_check_header_format(index->header) < 0)
+    {
+        evx_msg("Invalid or unsupported file header in %s", filename);
+        fclose(file);
+        return -1;
+    }
+
+    while (offset < index->file_size)
+    {
+        EVX_MEDIA_RECORD_HEADER record;
+        uint64 record_size = 0;
+
+        if (0 != fseek(file, offset, SEEK_SET) || 1 != fread(&record, sizeof(record), 1, file) ||
+            record.header_size < sizeof(record))
+        {
+            break;
+        }
+
+        // Only the header of each record is read; payloads are skipped.
+        if (EVX_MEDIA_VERSION_LEGACY == index->header.version || evx_check_magic(record.magic, "EVFH"))
+        {
+            EVX_MEDIA_FRAME_HEADER frame_header;
+
+            memset(&frame_header, 0, sizeof(frame_header));
+            memcpy(&frame_header, &record, sizeof(record));
+
+            uint32 known_size = min(record.header_size, (uint32) sizeof(frame_header));
+
+            if (1 != fread((uint8 *) &frame_header + sizeof(record), known_size - sizeof(record), 1, file))
+            {
+                break;
+            }
+
+            EVX_FRAME_ENTRY entry;
+            entry.frame_index = index->frames.size();
+            entry.offset = offset;
+            entry.record_size = record.header_size + frame_header.frame_size;
+            entry.flags = frame_header.flags;
+
+            if (index->frames.empty())
+            {
+                entry.flags |= EVX_FRAME_FLAG_ENTRY_POINT;
+            }
+            record_size = entry.record_size;
+
+            index->frames.push_back(entry);
+        }
+        else if (evx_check_magic(record.magic, "EVIX"))
+        {
+            EVX_MEDIA_INDEX_HEADER index_header;
+
+            memset(&index_header, 0, sizeof(index_header));
+            memcpy(&index_header, &record, sizeof(record));
+
+            uint32 known_size = min(record.header_size, (uint32) sizeof(index_header));
+
+            if (1 != fread((uint8 *) &index_header + sizeof(record), known_size - sizeof(record), 1, file))
+            {
+                break;
+            }
+
+            record_size = record.header_size + (uint64) index_header.entry_count * sizeof(EVX_MEDIA_INDEX_ENTRY);
+        }
+        else
+        {
+            evx_msg("Unknown record at offset %llu in %s", offset, filename);
+            break;
+        }
+
+        // A record that runs past the end of the file was never completed.
+        if (offset + record_size > index->file_size)
+        {
+            if (index->frames.size() && index->frames.back().offset == offset)
+            {
+                index->frames.pop_back();
+            }
+
+            break;
+        }
+
+        offset += record_size;
+    }
+
+    fclose(file);
+
+    return 0;
+}
+
+uint64 evx_query_frame_range_size(const EVX_FRAME_INDEX &index, uint64 first, uint64 last)
+{
+    const EVX_FRAME_ENTRY &first_entry = index.frames[first];
+    const EVX_FRAME_ENTRY &last_entry = index.frames[last];
+
+    return last_entry.offset + last_entry.record_size - first_entry.offset;
+}
+
+uint64 evx_query_entry_point(const EVX_FRAME_INDEX &index, uint64 frame)
+{
+    frame = min(frame, (uint64) index.frames.size() - 1);
+
+    while (frame && !(index.frames[frame].flags & EVX_FRAME_FLAG_ENTRY_POINT))
+    {
+        frame--;
+    }
+
+    return frame;
+}
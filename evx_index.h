@@ -0,0 +1,73 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_index.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_INDEX_H__
+#define __EVX_INDEX_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+#include <vector>
+
+// A frame index locates every frame record in a file without reading any
+// payloads, so tools can address frames by number instead of decoding 
+// their way through the file.
+
+typedef struct EVX_FRAME_ENTRY
+{
+    uint64 frame_index;
+    uint64 offset;              // offset of the frame record.
+    uint32 record_size;         // size of the frame header plus its payload.
+    uint32 flags;               // EVX_FRAME_FLAG_* from the frame header.
+
+} EVX_FRAME_ENTRY;
+
+typedef struct EVX_FRAME_INDEX
+{
+    EVX_MEDIA_FILE_HEADER header;
+    std::vector<EVX_FRAME_ENTRY> frames;
+    uint64 file_size;
+
+} EVX_FRAME_INDEX;
+
+// Walks the record chain of filename, collecting an entry for every frame.
+int32 evx_build_frame_index(const char *filename, EVX_FRAME_INDEX *index);
+
+// Returns the number of bytes spanned by frames [first, last], including 
+// any index records interleaved between them.
+uint64 evx_query_frame_range_size(const EVX_FRAME_INDEX &index, uint64 first, uint64 last);
+
+// Returns the last entry point at or before frame, from which a fresh 
+// decoder can decode its way forward to frame.
+uint64 evx_query_entry_point(const EVX_FRAME_INDEX &index, uint64 frame);
+
+#endif // __EVX_INDEX_H__
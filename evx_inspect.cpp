@@ -34,32 +34,34 @@
 #include "cairo/evx1.h"
 #include "cairo/image.h"
 #include "evx_format.h"
+#include "evx_memory.h"
+#include "evx_quality.h"
+#include "evx_source.h"
 
 #if defined(EVX_PLATFORM_WINDOWS)
 #include "time.h"
+#elif defined(EVX_PLATFORM_MACOSX)
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+
+// Headless builds (EVX_HEADLESS) have no window, and encode the source as
+// fast as possible while reporting bitrate and quality.
+#if !defined(EVX_HEADLESS)
+#if defined(EVX_PLATFORM_WINDOWS)
 #include "gl/gl.h"
 #include "glut/glut.h"
 #elif defined(EVX_PLATFORM_MACOSX)
-#include <sys/time.h>
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
 #include <GLUT/glut.h>
+#else
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
 #endif
 
-extern "C"
-{
-    int ffmpeg_initialize();
-    int ffmpeg_deinitialize();
-    int ffmpeg_reset();
-
-    int ffmpeg_play_file(char * filename, int *format, int *width, int *height);
-    int ffmpeg_copy_current_frame(unsigned char *dest, int row_pitch);
-    int ffmpeg_refresh(int *encoded_frame_size);
-
-    int ffmpeg_get_frame_count();
-    float ffmpeg_get_frame_rate();
-
-} // extern "C"
 
 
 typedef struct EVX_VIDEO_STATE
@@ -75,6 +77,8 @@ typedef struct EVX_VIDEO_STATE
 image g_frame_image;
 evx1_encoder *g_encoder;
 bit_stream g_cairo_stream;
+EVX_QUALITY_ENGINE g_quality_engine;
+EVX_QUALITY_SUMMARY g_reported_quality = {0};
 
 EVX_MEDIA_FILE_HEADER g_header = {0};
 EVX_VIDEO_STATE g_video_state = {0};
@@ -84,6 +88,9 @@ uint32 g_total_encoded_bytes = 0;
 uint32 g_total_source_bytes_read = 0;
 uint32 g_frame_texture = EVX_MAX_UINT32;
 uint8 *g_temp_buffer = NULL;
+const char *g_source_filename = NULL;
+bool g_memory_profiling = false;
+EVX_MEMORY_PROFILE g_memory_profile;
 
 uint64 _get_system_time_ms()
 {
@@ -93,6 +100,10 @@ uint64 _get_system_time_ms()
     timeval time;
     gettimeofday(&time, NULL);
     return (time.tv_sec * 1000) + (time.tv_usec / 1000);
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (time.tv_sec * 1000) + (time.tv_nsec / 1000000);
 #endif
 }
 
@@ -132,6 +143,8 @@ bool _should_update_video_frame()
     return true;
 }
 
+#if !defined(EVX_HEADLESS)
+
 char *_peek_name_from_index(uint8 index)
 {
     switch (index)
@@ -180,6 +193,8 @@ void handle_key_press(unsigned char key, int x, int y)
         (g_video_state.state ? "paused" : "playing"), _get_rate_multiplier());
 }
 
+#endif
+
 uint32 _get_file_size(FILE *f)
 {
     uint32 file_size = 0;
@@ -202,40 +217,72 @@ void _report_bit_rate()
 
         g_total_source_bytes_read = 0;
         g_total_encoded_bytes = 0;
+
+        // Quality is averaged over the frames scored since the last report.
+        EVX_QUALITY_SUMMARY quality;
+        evx_quality_query(&g_quality_engine, &quality);
+
+        if (quality.frame_count > g_reported_quality.frame_count)
+        {
+            uint64 frame_count = quality.frame_count - g_reported_quality.frame_count;
+
+            evx_msg("PSNR: %.2f dB, SSIM: %.4f", 
+                (quality.psnr_sum - g_reported_quality.psnr_sum) / frame_count,
+                (quality.ssim_sum - g_reported_quality.ssim_sum) / frame_count);
+
+            g_reported_quality = quality;
+        }
     }
 }
 
-void _read_next_frame(image *output)
+// Returns -1 once the source is exhausted.
+int32 _read_next_frame(image *output)
 {
     if (!g_video_state.state)
     {
         // If we've completed all frames in the file, do nothing.
         if (g_header.frame_count && (g_video_state.frame_count >= g_header.frame_count))
         {
-            return;
+            return -1;
         }
 
+#if !defined(EVX_HEADLESS)
         // If insufficient time has passed, do nothing.
         if (!_should_update_video_frame())
         {
-            return;
+            return 0;
         }
+#endif
 
         int32 g_read_frame_size = 0;
+        evx_memory_set_stage(EVX_MEMORY_STAGE_INGEST);
 
         if (ffmpeg_refresh(&g_read_frame_size) < 0)
         {
-            return;
+            evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
+            return -1;
         }
 
         ffmpeg_copy_current_frame(output->query_data(), output->query_row_pitch());
 
         g_total_source_bytes_read += g_read_frame_size;
 
+        evx_memory_set_stage(EVX_MEMORY_STAGE_ENCODE);
         g_encoder->encode(output->query_data(), output->query_width(), output->query_height(), &g_cairo_stream);
+        evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
+
+        EVX_QUALITY_SLOT *slot = evx_quality_acquire(&g_quality_engine);
+        evx_quality_copy(slot->source, output->query_data(), output->query_width(), output->query_height(), output->query_row_pitch());
+        g_encoder->peek(EVX_PEEK_DESTINATION, slot->dest);
+        evx_quality_submit(&g_quality_engine, g_video_state.frame_count);
 
         g_video_state.frame_count++;
 
+        if (g_memory_profiling)
+        {
+            evx_memory_frame(&g_memory_profile);
+        }
+
         g_total_encoded_bytes += sizeof(EVX_MEDIA_FRAME_HEADER) + g_cairo_stream.query_byte_occupancy();
 
         if (0 == (g_video_state.frame_count % 10))
@@ -249,8 +296,12 @@ void _read_next_frame(image *output)
     // Peek the appropriate frame and render it to our output.
     g_encoder->peek(g_current_peek_state, output->query_data());
     g_cairo_stream.empty();
+
+    return 0;
 }
 
+#if !defined(EVX_HEADLESS)
+
 void _prepare_frame_texture()
 {
     if (EVX_MAX_UINT32 == g_frame_texture)
@@ -301,6 +352,8 @@ void render_scene()
     glutSwapBuffers();
 }
 
+#endif
+
 void _print_file_header(const EVX_MEDIA_FILE_HEADER &header)
 {
     evx_msg("Printing file header:");
@@ -328,6 +381,13 @@ void _prepare_evx_header(EVX_MEDIA_FILE_HEADER *header, uint32 width, uint32 hei
     _print_file_header(*header);
 }
 
+// The windowed inspector exits from its key handler, so the profile is
+// printed at exit.
+void _print_memory_profile()
+{
+    evx_memory_print(&g_memory_profile, g_source_filename);
+}
+
 int main(int argc, char **argv)
 {
     int32 content_width = 0;
@@ -336,13 +396,28 @@ int main(int argc, char **argv)
 
     evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
 
+    g_memory_profiling = (argc > 1 && 0 == strcmp(argv[1], "-memprofile"));
+
+    // Skip past any options to the positional arguments.
+    argc -= g_memory_profiling;
+    argv += g_memory_profiling;
+
     if (3 != argc)
     {
         // No need to get fancy.
-        evx_msg("Required syntax: inspect <input_filename> initial_quality");
+        evx_msg("Required syntax: inspect [-memprofile] <input_filename> initial_quality");
         return 0;
     }
 
+    g_source_filename = argv[1];
+
+    if (g_memory_profiling)
+    {
+        evx_memory_enable();
+        evx_memory_begin(&g_memory_profile);
+        atexit(_print_memory_profile);
+    }
+
     ffmpeg_initialize();
     
     if (0 != ffmpeg_play_file(argv[1], (int*) &content_format, (int*) &content_width, (int*) &content_height))
@@ -361,7 +436,11 @@ int main(int argc, char **argv)
     g_cairo_stream.resize_capacity((4*EVX_MB) << 3);
     create_encoder(&g_encoder);
     g_encoder->set_quality(atoi(argv[2]));
+    evx_quality_open(g_header.frame_width, g_header.frame_height, NULL, &g_quality_engine);
 
+#if defined(EVX_HEADLESS)
+    while (0 == _read_next_frame(&g_frame_image));
+#else
     glutInit(&argc, argv);
     glutInitWindowSize(g_header.frame_width, g_header.frame_height);
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
@@ -370,6 +449,13 @@ int main(int argc, char **argv)
     glutIdleFunc(&render_scene);
     glutKeyboardFunc(&handle_key_press);
     glutMainLoop();
+#endif
+
+    EVX_QUALITY_SUMMARY quality;
+
+    evx_quality_close(&g_quality_engine);
+    evx_quality_query(&g_quality_engine, &quality);
+    evx_print_quality_summary(quality);
 
     destroy_image(&g_frame_image);
     destroy_encoder(g_encoder);
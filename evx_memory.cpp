@@ -0,0 +1,382 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_memory.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_memory.h"
+
+#include <new>
+#include <stdlib.h>
+
+#if defined(EVX_PLATFORM_WINDOWS)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#if defined(EVX_PLATFORM_MACOSX)
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+typedef struct EVX_MEMORY_STAGE_COUNTERS
+{
+    std::atomic<uint64> allocation_count;
+    std::atomic<uint64> allocated_bytes;
+    std::atomic<int64> live_bytes;
+    std::atomic<int64> peak_live_bytes;
+
+} EVX_MEMORY_STAGE_COUNTERS;
+
+// These are zero initialized before any constructor runs, so allocations 
+// made during static initialization are safe.
+static EVX_MEMORY_STAGE_COUNTERS g_memory_counters[EVX_MEMORY_STAGE_COUNT];
+static std::atomic<bool> g_memory_tracking;
+static thread_local EVX_MEMORY_STAGE g_memory_stage = EVX_MEMORY_STAGE_OTHER;
+
+#if defined(EVX_MEMORY_PROFILER)
+
+// Every block carries a header, whether or not tracking is enabled, so that 
+// blocks allocated before tracking began are not counted when freed. The 
+// header keeps the 16 byte alignment that malloc provides.
+typedef struct EVX_MEMORY_BLOCK
+{
+    uint64 size;
+    uint32 stage;
+    uint32 tracked;
+
+} EVX_MEMORY_BLOCK;
+
+void *_allocate_block(size_t size)
+{
+    EVX_MEMORY_BLOCK *block = (EVX_MEMORY_BLOCK *) malloc(sizeof(EVX_MEMORY_BLOCK) + size);
+
+    if (!block)
+    {
+        return NULL;
+    }
+
+    block->size = size;
+    block->stage = g_memory_stage;
+    block->tracked = 0;
+
+    if (g_memory_tracking.load(std::memory_order_relaxed))
+    {
+        EVX_MEMORY_STAGE_COUNTERS *counters = &g_memory_counters[block->stage];
+        int64 live_bytes = counters->live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        int64 peak_bytes = counters->peak_live_bytes.load(std::memory_order_relaxed);
+
+        counters->allocation_count.fetch_add(1, std::memory_order_relaxed);
+        counters->allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+        while (live_bytes > peak_bytes && !counters->peak_live_bytes.compare_exchange_weak(peak_bytes, live_bytes));
+
+        block->tracked = 1;
+    }
+
+    return block + 1;
+}
+
+void _release_block(void *pointer)
+{
+    if (!pointer)
+    {
+        return;
+    }
+
+    EVX_MEMORY_BLOCK *block = (EVX_MEMORY_BLOCK *) pointer - 1;
+
+    // Frees are charged to the stage that made the allocation.
+    if (block->tracked)
+    {
+        g_memory_counters[block->stage].live_bytes.fetch_sub(block->size, std::memory_order_relaxed);
+    }
+
+    free(block);
+}
+
+void *operator new(size_t size)
+{
+    void *pointer = _allocate_block(size);
+
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return _allocate_block(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return _allocate_block(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    _release_block(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    _release_block(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    _release_block(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    _release_block(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+    _release_block(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+    _release_block(pointer);
+}
+
+#endif // EVX_MEMORY_PROFILER
+
+void evx_memory_enable()
+{
+#if defined(EVX_MEMORY_PROFILER)
+    g_memory_tracking = true;
+#else
+    static std::atomic<bool> warned;
+
+    if (!warned.exchange(true))
+    {
+        evx_msg("Allocation tracking is not built in (make MEMPROFILE=1), so only process memory is profiled");
+    }
+#endif
+}
+
+bool evx_memory_is_enabled()
+{
+    return g_memory_tracking;
+}
+
+EVX_MEMORY_STAGE evx_memory_set_stage(EVX_MEMORY_STAGE stage)
+{
+    EVX_MEMORY_STAGE previous = g_memory_stage;
+    g_memory_stage = stage;
+
+    return previous;
+}
+
+const char *evx_memory_stage_name(EVX_MEMORY_STAGE stage)
+{
+    switch (stage)
+    {
+        case EVX_MEMORY_STAGE_OTHER: return "other";
+        case EVX_MEMORY_STAGE_INGEST: return "ingest";
+        case EVX_MEMORY_STAGE_SCALE: return "scale";
+        case EVX_MEMORY_STAGE_ENCODE: return "encode";
+        case EVX_MEMORY_STAGE_DECODE: return "decode";
+        case EVX_MEMORY_STAGE_WRITE: return "write";
+        default: break;
+    };
+
+    return "unknown";
+}
+
+void evx_memory_query(EVX_MEMORY_COUNTERS counters[EVX_MEMORY_STAGE_COUNT])
+{
+    for (uint32 i = 0; i < EVX_MEMORY_STAGE_COUNT; i++)
+    {
+        counters[i].allocation_count = g_memory_counters[i].allocation_count;
+        counters[i].allocated_bytes = g_memory_counters[i].allocated_bytes;
+        counters[i].live_bytes = g_memory_counters[i].live_bytes;
+        counters[i].peak_live_bytes = g_memory_counters[i].peak_live_bytes;
+    }
+}
+
+uint64 evx_query_resident_size()
+{
+#if defined(EVX_PLATFORM_WINDOWS)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined(EVX_PLATFORM_MACOSX)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (KERN_SUCCESS != task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count))
+    {
+        return 0;
+    }
+
+    return info.resident_size;
+#else
+    FILE *statm = fopen("/proc/self/statm", "r");
+    unsigned long long total_pages = 0, resident_pages = 0;
+
+    if (!statm)
+    {
+        return 0;
+    }
+
+    if (2 != fscanf(statm, "%llu %llu", &total_pages, &resident_pages))
+    {
+        resident_pages = 0;
+    }
+
+    fclose(statm);
+
+    return (uint64) resident_pages * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+uint64 evx_query_peak_resident_size()
+{
+#if defined(EVX_PLATFORM_WINDOWS)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    rusage usage;
+
+    if (0 != getrusage(RUSAGE_SELF, &usage))
+    {
+        return 0;
+    }
+
+    // Reported in bytes on macOS, and in kilobytes elsewhere.
+#if defined(EVX_PLATFORM_MACOSX)
+    return usage.ru_maxrss;
+#else
+    return (uint64) usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+uint64 evx_query_heap_size()
+{
+#if defined(EVX_PLATFORM_MACOSX)
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(NULL, &statistics);
+    return statistics.size_in_use;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+void evx_memory_begin(EVX_MEMORY_PROFILE *profile)
+{
+    for (uint32 i = 0; i < EVX_MEMORY_STAGE_COUNT; i++)
+    {
+        g_memory_counters[i].peak_live_bytes = g_memory_counters[i].live_bytes.load();
+    }
+
+    evx_memory_query(profile->start);
+    memcpy(profile->steady, profile->start, sizeof(profile->steady));
+
+    profile->frame_count = 0;
+    profile->steady_resident_size = 0;
+    profile->steady_heap_size = 0;
+}
+
+void evx_memory_frame(EVX_MEMORY_PROFILE *profile)
+{
+    if (EVX_MEMORY_WARMUP_FRAMES == ++profile->frame_count)
+    {
+        evx_memory_query(profile->steady);
+        profile->steady_resident_size = evx_query_resident_size();
+        profile->steady_heap_size = evx_query_heap_size();
+    }
+}
+
+void evx_memory_print(EVX_MEMORY_PROFILE *profile, const char *name)
+{
+    EVX_MEMORY_COUNTERS end[EVX_MEMORY_STAGE_COUNT];
+    uint64 steady_frames = profile->frame_count > EVX_MEMORY_WARMUP_FRAMES ? profile->frame_count - EVX_MEMORY_WARMUP_FRAMES : 0;
+
+    evx_memory_query(end);
+
+    evx_msg("Memory profile for %s: %llu frames, resident %.1f MB (steady %.1f MB, process peak %.1f MB), heap %.1f MB (steady %.1f MB)", 
+        name, profile->frame_count, evx_query_resident_size() / (double) EVX_MB, profile->steady_resident_size / (double) EVX_MB, 
+        evx_query_peak_resident_size() / (double) EVX_MB, evx_query_heap_size() / (double) EVX_MB, profile->steady_heap_size / (double) EVX_MB);
+
+    // Without tracking every stage counter stays at zero.
+    if (!g_memory_tracking)
+    {
+        return;
+    }
+
+    evx_msg("  %-8s %10s %12s %10s %10s %15s %15s", "stage", "allocs", "allocated MB", "live MB", "peak MB", "steady allocs/f", "steady KB/f");
+
+    for (uint32 i = 0; i < EVX_MEMORY_STAGE_COUNT; i++)
+    {
+        uint64 allocation_count = end[i].allocation_count - profile->start[i].allocation_count;
+        uint64 allocated_bytes = end[i].allocated_bytes - profile->start[i].allocated_bytes;
+        uint64 steady_count = end[i].allocation_count - profile->steady[i].allocation_count;
+        uint64 steady_bytes = end[i].allocated_bytes - profile->steady[i].allocated_bytes;
+
+        if (!allocation_count && !end[i].live_bytes)
+        {
+            continue;
+        }
+
+        evx_msg("  %-8s %10llu %12.2f %10.2f %10.2f %15.2f %15.2f", evx_memory_stage_name((EVX_MEMORY_STAGE) i), 
+            allocation_count, allocated_bytes / (double) EVX_MB, end[i].live_bytes / (double) EVX_MB, 
+            end[i].peak_live_bytes / (double) EVX_MB, steady_frames ? (double) steady_count / steady_frames : 0.0,
+            steady_frames ? steady_bytes / 1024.0 / steady_frames : 0.0);
+    }
+
+    if (!steady_frames)
+    {
+        evx_msg("  fewer than %i frames, so no steady state was measured", EVX_MEMORY_WARMUP_FRAMES + 1);
+    }
+}
@@ -0,0 +1,116 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_memory.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_MEMORY_H__
+#define __EVX_MEMORY_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+#include <atomic>
+
+// Allocation tracking attributes every C++ heap allocation, including those
+// made inside the Cairo codec, to the pipeline stage that the allocating 
+// thread is currently running. It replaces the global operator new and 
+// delete, so it is only built when EVX_MEMORY_PROFILER is defined (make 
+// MEMPROFILE=1); other builds keep the standard allocator, and profiles 
+// report only the resident and heap sizes. Where built, tracking is off 
+// until evx_memory_enable is called, and each allocation then costs a flag 
+// test and a 16 byte header.
+//
+// Allocations made through malloc (ffmpeg frames, for instance) are not 
+// attributed to stages, but are included in the heap and resident sizes 
+// that a profile reports.
+
+#define EVX_MEMORY_WARMUP_FRAMES        (30)
+
+typedef enum EVX_MEMORY_STAGE
+{
+    EVX_MEMORY_STAGE_OTHER = 0,     // setup, teardown and anything unlabelled.
+    EVX_MEMORY_STAGE_INGEST,        // reading source frames or records.
+    EVX_MEMORY_STAGE_SCALE,
+    EVX_MEMORY_STAGE_ENCODE,
+    EVX_MEMORY_STAGE_DECODE,
+    EVX_MEMORY_STAGE_WRITE,
+    EVX_MEMORY_STAGE_COUNT,
+
+} EVX_MEMORY_STAGE;
+
+typedef struct EVX_MEMORY_COUNTERS
+{
+    uint64 allocation_count;
+    uint64 allocated_bytes;
+    int64 live_bytes;               // bytes allocated by the stage and not yet freed.
+    int64 peak_live_bytes;
+
+} EVX_MEMORY_COUNTERS;
+
+// A profile covers one stream. Counters are sampled when it begins, once 
+// EVX_MEMORY_WARMUP_FRAMES frames have been processed, and when it is 
+// printed, so that the allocations of the steady state can be told apart
+// from those of setup and warm up.
+typedef struct EVX_MEMORY_PROFILE
+{
+    EVX_MEMORY_COUNTERS start[EVX_MEMORY_STAGE_COUNT];
+    EVX_MEMORY_COUNTERS steady[EVX_MEMORY_STAGE_COUNT];
+    uint64 frame_count;
+    uint64 steady_resident_size;
+    uint64 steady_heap_size;
+
+} EVX_MEMORY_PROFILE;
+
+void evx_memory_enable();
+bool evx_memory_is_enabled();
+
+// Sets the stage of the calling thread and returns its previous stage.
+EVX_MEMORY_STAGE evx_memory_set_stage(EVX_MEMORY_STAGE stage);
+
+const char *evx_memory_stage_name(EVX_MEMORY_STAGE stage);
+void evx_memory_query(EVX_MEMORY_COUNTERS counters[EVX_MEMORY_STAGE_COUNT]);
+
+// Returns the current and peak resident set size of the process, or zero
+// if unavailable. The peak covers the life of the process.
+uint64 evx_query_resident_size();
+uint64 evx_query_peak_resident_size();
+
+// Returns the bytes in use by malloc, or zero if unavailable.
+uint64 evx_query_heap_size();
+
+// Starts a profile, resetting the peak of every stage to its live bytes.
+void evx_memory_begin(EVX_MEMORY_PROFILE *profile);
+
+// Counts a processed frame.
+void evx_memory_frame(EVX_MEMORY_PROFILE *profile);
+
+void evx_memory_print(EVX_MEMORY_PROFILE *profile, const char *name);
+
+#endif // __EVX_MEMORY_H__
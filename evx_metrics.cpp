@@ -0,0 +1,322 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_metrics.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_metrics.h"
+#include "evx_socket.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+const char *g_stage_names[EVX_CONVERT_STAGE_COUNT] = { "read", "encode", "write" };
+
+void evx_reset_convert_metrics(EVX_CONVERT_METRICS *metrics)
+{
+    metrics->frames_written = 0;
+    metrics->bytes_written = 0;
+    metrics->max_frame_size = 0;
+    metrics->frame_count = 0;
+    metrics->running = true;
+
+    for (uint32 i = 0; i < EVX_CONVERT_STAGE_COUNT; i++)
+    {
+        metrics->stage_nanoseconds[i] = 0;
+    }
+}
+
+evx_metrics_clock::time_point evx_add_stage_time(EVX_CONVERT_METRICS *metrics, EVX_CONVERT_STAGE stage, 
+                                                 evx_metrics_clock::time_point start_time)
+{
+    evx_metrics_clock::time_point now = evx_metrics_clock::now();
+    metrics->stage_nanoseconds[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_time).count();
+
+    return now;
+}
+
+void _append_metric(std::string *text, const char *name, const char *type, const char *help, double value)
+{
+    char line[512];
+
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %.15g\n", name, help, name, type, name, value);
+    text->append(line);
+}
+
+// Samples the counters and formats them. Rates are taken over the last 
+// interval, so a stalled job shows up as zero throughput and a growing ETA.
+void _sample_metrics(EVX_METRICS_EXPORTER *exporter)
+{
+    EVX_CONVERT_METRICS *metrics = exporter->metrics;
+    evx_metrics_clock::time_point now = evx_metrics_clock::now();
+    double interval = std::chrono::duration<double>(now - exporter->sample_time).count();
+    double elapsed = std::chrono::duration<double>(now - exporter->start_time).count();
+    uint64 frames = metrics->frames_written;
+    uint64 bytes = metrics->bytes_written;
+    uint64 frame_count = metrics->frame_count;
+    std::string text;
+    char line[256];
+
+    if (interval > 0.0)
+    {
+        exporter->frame_rate = (frames - exporter->sample_frames) / interval;
+        exporter->byte_rate = (bytes - exporter->sample_bytes) / interval;
+    }
+
+    exporter->sample_time = now;
+    exporter->sample_frames = frames;
+    exporter->sample_bytes = bytes;
+
+    double eta = -1.0;
+
+    if (frame_count && exporter->frame_rate > 0.0)
+    {
+        eta = (frame_count - min(frames, frame_count)) / exporter->frame_rate;
+    }
+
+    _append_metric(&text, "evx_convert_running", "gauge", "Whether the conversion is still running.", metrics->running ? 1.0 : 0.0);
+    _append_metric(&text, "evx_convert_elapsed_seconds", "gauge", "Time since the conversion started.", elapsed);
+    _append_metric(&text, "evx_convert_frames_total", "counter", "Frames written.", frames);
+    _append_metric(&text, "evx_convert_expected_frames", "gauge", "Frames expected in total, zero if unknown.", frame_count);
+    _append_metric(&text, "evx_convert_bytes_total", "counter", "Frame payload bytes written.", bytes);
+    _append_metric(&text, "evx_convert_frames_per_second", "gauge", "Frames written per second over the last interval.", exporter->frame_rate);
+    _append_metric(&text, "evx_convert_bytes_per_second", "gauge", "Bytes written per second over the last interval.", exporter->byte_rate);
+    _append_metric(&text, "evx_convert_frame_size_bytes_avg", "gauge", "Average frame payload size.", frames ? (double) bytes / frames : 0.0);
+    _append_metric(&text, "evx_convert_frame_size_bytes_max", "gauge", "Largest frame payload size.", metrics->max_frame_size);
+    _append_metric(&text, "evx_convert_eta_seconds", "gauge", "Estimated time remaining, -1 if unknown.", eta);
+
+    text.append("# HELP evx_convert_stage_seconds_total Time spent in each stage of the conversion.\n");
+    text.append("# TYPE evx_convert_stage_seconds_total counter\n");
+
+    for (uint32 i = 0; i < EVX_CONVERT_STAGE_COUNT; i++)
+    {
+        snprintf(line, sizeof(line), "evx_convert_stage_seconds_total{stage=\"%s\"} %.6f\n", g_stage_names[i], 
+                 metrics->stage_nanoseconds[i] / 1e9);
+        text.append(line);
+    }
+
+    std::lock_guard<std::mutex> guard(exporter->lock);
+    exporter->text.swap(text);
+}
+
+// Readers of the stats file never see a partial sample, as each sample is
+// written to a temporary file that then replaces the previous one.
+void _write_stats_file(EVX_METRICS_EXPORTER *exporter)
+{
+    char temp_filename[1024];
+    std::string text;
+
+    if (!exporter->stats_filename)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(exporter->lock);
+        text = exporter->text;
+    }
+
+    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", exporter->stats_filename);
+
+    FILE *file = fopen(temp_filename, "wb");
+
+    if (!file)
+    {
+        return;
+    }
+
+    bool result = (1 == fwrite(text.data(), text.size(), 1, file));
+
+    if (0 != fclose(file) || !result)
+    {
+        remove(temp_filename);
+        return;
+    }
+
+#if defined(EVX_PLATFORM_WINDOWS)
+    remove(exporter->stats_filename);
+#endif
+
+    rename(temp_filename, exporter->stats_filename);
+}
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+// A scraper that disconnects early must not kill the conversion with 
+// SIGPIPE. Platforms without MSG_NOSIGNAL set SO_NOSIGPIPE instead.
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL    (0)
+#endif
+
+// Scrapers speak http, so every connection gets a minimal http response 
+// regardless of what it asked for.
+void _answer_client(EVX_METRICS_EXPORTER *exporter, int32 fd)
+{
+    struct pollfd request = { fd, POLLIN, 0 };
+    char buffer[1024];
+    std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+
+#if defined(SO_NOSIGPIPE)
+    int32 enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+
+    if (poll(&request, 1, 100) > 0)
+    {
+        recv(fd, buffer, sizeof(buffer), 0);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(exporter->lock);
+        response.append(exporter->text);
+    }
+
+    for (size_t sent = 0; sent < response.size();)
+    {
+        ssize_t count = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+
+        if (count <= 0)
+        {
+            break;
+        }
+
+        sent += count;
+    }
+
+    close(fd);
+}
+
+#endif
+
+void _exporter_thread_main(EVX_METRICS_EXPORTER *exporter)
+{
+    evx_metrics_clock::time_point next_sample = evx_metrics_clock::now();
+
+    while (!exporter->closing)
+    {
+        evx_metrics_clock::time_point now = evx_metrics_clock::now();
+
+        if (now >= next_sample)
+        {
+            _sample_metrics(exporter);
+            _write_stats_file(exporter);
+            next_sample += std::chrono::duration_cast<evx_metrics_clock::duration>(std::chrono::duration<double>(EVX_METRICS_INTERVAL));
+            continue;
+        }
+
+        // Wake at least every 100ms so that closing is noticed promptly.
+        int32 timeout = (int32) min(std::chrono::duration_cast<std::chrono::milliseconds>(next_sample - now).count() + 1, (long long) 100);
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+        if (exporter->listener >= 0)
+        {
+            struct pollfd listener = { exporter->listener, POLLIN, 0 };
+
+            if (poll(&listener, 1, timeout) > 0)
+            {
+                int32 fd = accept(exporter->listener, NULL, NULL);
+
+                if (fd >= 0)
+                {
+                    _answer_client(exporter, fd);
+                }
+            }
+
+            continue;
+        }
+#endif
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+    }
+}
+
+int32 evx_metrics_open(EVX_CONVERT_METRICS *metrics, const char *stats_filename, const char *address, EVX_METRICS_EXPORTER *exporter)
+{
+    exporter->metrics = metrics;
+    exporter->stats_filename = stats_filename;
+    exporter->listener = -1;
+    exporter->closing = false;
+    exporter->text.clear();
+    exporter->start_time = evx_metrics_clock::now();
+    exporter->sample_time = exporter->start_time;
+    exporter->sample_frames = metrics->frames_written;
+    exporter->sample_bytes = metrics->bytes_written;
+    exporter->frame_rate = 0.0;
+    exporter->byte_rate = 0.0;
+
+    if (address)
+    {
+#if !defined(EVX_PLATFORM_WINDOWS)
+        exporter->listener = evx_open_socket(address, true);
+
+        if (exporter->listener < 0 || 0 != listen(exporter->listener, 16))
+        {
+            evx_msg("Failed to serve metrics on %s", address);
+
+            if (exporter->listener >= 0)
+            {
+                close(exporter->listener);
+            }
+
+            return -1;
+        }
+
+        evx_msg("Serving metrics on %s", address);
+#else
+        evx_msg("Serving metrics is not available on this platform");
+        return -1;
+#endif
+    }
+
+    exporter->thread = std::thread(_exporter_thread_main, exporter);
+
+    return 0;
+}
+
+void evx_metrics_close(EVX_METRICS_EXPORTER *exporter)
+{
+    exporter->closing = true;
+    exporter->thread.join();
+
+    // The final sample reports the finished state.
+    exporter->metrics->running = false;
+    _sample_metrics(exporter);
+    _write_stats_file(exporter);
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+    if (exporter->listener >= 0)
+    {
+        close(exporter->listener);
+        exporter->listener = -1;
+    }
+#endif
+}
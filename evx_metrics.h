@@ -0,0 +1,108 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_metrics.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_METRICS_H__
+#define __EVX_METRICS_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Conversion metrics are plain counters updated by the converter after 
+// each frame. An exporter thread samples them once a second to derive 
+// rates and an ETA, and publishes the result in the Prometheus text format
+// by atomically replacing a stats file, by answering on a local socket, 
+// or both.
+
+#define EVX_METRICS_INTERVAL            (1.0)     // seconds between samples.
+
+typedef std::chrono::steady_clock evx_metrics_clock;
+
+typedef enum EVX_CONVERT_STAGE
+{
+    EVX_CONVERT_STAGE_READ = 0,     // source decode, seek and copy.
+    EVX_CONVERT_STAGE_ENCODE,
+    EVX_CONVERT_STAGE_WRITE,
+    EVX_CONVERT_STAGE_COUNT,
+
+} EVX_CONVERT_STAGE;
+
+typedef struct EVX_CONVERT_METRICS
+{
+    std::atomic<uint64> frames_written;
+    std::atomic<uint64> bytes_written;
+    std::atomic<uint64> max_frame_size;
+    std::atomic<uint64> frame_count;                        // expected total, zero if unknown.
+    std::atomic<uint64> stage_nanoseconds[EVX_CONVERT_STAGE_COUNT];
+    std::atomic<bool> running;
+
+} EVX_CONVERT_METRICS;
+
+typedef struct EVX_METRICS_EXPORTER
+{
+    EVX_CONVERT_METRICS *metrics;
+    const char *stats_filename;     // may be NULL.
+    int32 listener;                 // -1 if not serving.
+
+    std::thread thread;
+    std::mutex lock;
+    std::atomic<bool> closing;
+    std::string text;               // latest formatted sample.
+
+    evx_metrics_clock::time_point start_time;
+    evx_metrics_clock::time_point sample_time;
+    uint64 sample_frames;
+    uint64 sample_bytes;
+    double frame_rate;
+    double byte_rate;
+
+} EVX_METRICS_EXPORTER;
+
+void evx_reset_convert_metrics(EVX_CONVERT_METRICS *metrics);
+
+// Adds the time since start_time to a stage, and returns the current time
+// so that consecutive stages can be chained.
+evx_metrics_clock::time_point evx_add_stage_time(EVX_CONVERT_METRICS *metrics, EVX_CONVERT_STAGE stage, 
+                                                 evx_metrics_clock::time_point start_time);
+
+// Starts exporting metrics. Either stats_filename or address may be NULL.
+int32 evx_metrics_open(EVX_CONVERT_METRICS *metrics, const char *stats_filename, const char *address, EVX_METRICS_EXPORTER *exporter);
+
+// Publishes a final sample and stops the exporter.
+void evx_metrics_close(EVX_METRICS_EXPORTER *exporter);
+
+#endif // __EVX_METRICS_H__
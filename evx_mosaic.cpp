@@ -0,0 +1,402 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_mosaic.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "cairo/evx1.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+#include "evx_reader.h"
+#include "evx_output.h"
+#include "evx_pool.h"
+
+#include <chrono>
+#include <math.h>
+
+typedef std::chrono::steady_clock evx_clock;
+
+typedef struct EVX_MOSAIC_STREAM
+{
+    const char *filename;
+    EVX_READER reader;
+    image frame_image;
+    bool open;
+    bool done;
+
+    uint32 tile_x;
+    uint32 tile_y;
+    uint32 *column_offsets;     // source byte offset for each tile column.
+
+    uint64 target_frame;        // frames that should have been presented by now.
+    uint64 decoded_frames;
+    uint64 max_lag;
+    double decode_seconds;
+
+} EVX_MOSAIC_STREAM;
+
+typedef struct EVX_MOSAIC_OPTIONS
+{
+    EVX_OUTPUT_FORMAT format;
+    const char *dest_filename;
+    uint32 columns;
+    uint32 tile_width;
+    uint32 tile_height;
+    uint32 thread_count;
+    float frame_rate;
+    bool realtime;
+
+} EVX_MOSAIC_OPTIONS;
+
+typedef struct EVX_MOSAIC
+{
+    EVX_MOSAIC_STREAM *streams;
+    uint32 stream_count;
+    image output_image;
+    uint32 tile_width;
+    uint32 tile_height;
+    bool realtime;
+    evx_clock::time_point deadline;
+
+} EVX_MOSAIC;
+
+double _get_elapsed_seconds(evx_clock::time_point from_time)
+{
+    return std::chrono::duration<double>(evx_clock::now() - from_time).count();
+}
+
+// Nearest neighbour scaling is plenty for monitoring tiles, and the column
+// lookup is built once per stream so each row is a simple gather.
+void _prepare_tile_mapping(EVX_MOSAIC *mosaic, EVX_MOSAIC_STREAM *stream)
+{
+    uint32 source_width = stream->frame_image.query_width();
+
+    stream->column_offsets = new uint32[mosaic->tile_width];
+
+    for (uint32 x = 0; x < mosaic->tile_width; x++)
+    {
+        stream->column_offsets[x] = ((uint64) x * source_width / mosaic->tile_width) * 3;
+    }
+}
+
+void _compose_tile(EVX_MOSAIC *mosaic, EVX_MOSAIC_STREAM *stream)
+{
+    uint32 source_height = stream->frame_image.query_height();
+    uint32 source_pitch = stream->frame_image.query_row_pitch();
+    uint32 dest_pitch = mosaic->output_image.query_row_pitch();
+    uint8 *source = stream->frame_image.query_data();
+    uint8 *dest = mosaic->output_image.query_data() + stream->tile_y * dest_pitch + stream->tile_x * 3;
+
+    for (uint32 y = 0; y < mosaic->tile_height; y++)
+    {
+        uint8 *source_row = source + ((uint64) y * source_height / mosaic->tile_height) * source_pitch;
+        uint8 *dest_row = dest + y * dest_pitch;
+
+        for (uint32 x = 0; x < mosaic->tile_width; x++)
+        {
+            uint8 *pixel = source_row + stream->column_offsets[x];
+            dest_row[3 * x + 0] = pixel[0];
+            dest_row[3 * x + 1] = pixel[1];
+            dest_row[3 * x + 2] = pixel[2];
+        }
+    }
+}
+
+// Decodes a stream forward to its target frame and refreshes its tile. In 
+// realtime mode a stream that cannot catch up before the output deadline 
+// gives up its turn and falls behind, which shows up as lag.
+void _update_stream(void *context, uint32 index)
+{
+    EVX_MOSAIC *mosaic = (EVX_MOSAIC *) context;
+    EVX_MOSAIC_STREAM *stream = &mosaic->streams[index];
+    bool updated = false;
+
+    while (!stream->done && stream->decoded_frames < stream->target_frame)
+    {
+        if (mosaic->realtime && updated && evx_clock::now() >= mosaic->deadline)
+        {
+            break;
+        }
+
+        evx_clock::time_point start_time = evx_clock::now();
+
+        if (0 != evx_reader_next_frame(&stream->reader, &stream->frame_image))
+        {
+            stream->done = true;
+            break;
+        }
+
+        stream->decode_seconds += _get_elapsed_seconds(start_time);
+        stream->decoded_frames++;
+        updated = true;
+    }
+
+    if (!stream->done)
+    {
+        stream->max_lag = max(stream->max_lag, stream->target_frame - min(stream->target_frame, stream->decoded_frames));
+    }
+
+    if (updated)
+    {
+        _compose_tile(mosaic, stream);
+    }
+}
+
+void _report_lag(EVX_MOSAIC *mosaic, double elapsed_seconds)
+{
+    uint32 sustained_count = 0;
+
+    for (uint32 i = 0; i < mosaic->stream_count; i++)
+    {
+        EVX_MOSAIC_STREAM *stream = &mosaic->streams[i];
+        uint64 lag = stream->target_frame - min(stream->target_frame, stream->decoded_frames);
+        float frame_rate = stream->reader.header.frame_rate;
+
+        if (stream->done)
+        {
+            lag = 0;
+        }
+
+        evx_msg("Stream %i (%s): lag %llu frames (%.1f ms), max lag %llu, decode %.2f ms/frame", i, stream->filename, 
+                lag, 1000.0f * lag / frame_rate, stream->max_lag, 
+                stream->decoded_frames ? 1000.0 * stream->decode_seconds / stream->decoded_frames : 0.0);
+
+        sustained_count += (lag <= 1);
+    }
+
+    evx_msg("%.1fs: %i of %i streams keeping up", elapsed_seconds, sustained_count, mosaic->stream_count);
+}
+
+int32 _parse_options(int argc, char **argv, EVX_MOSAIC_OPTIONS *options, int32 *first_source)
+{
+    int32 i = 1;
+
+    memset(options, 0, sizeof(EVX_MOSAIC_OPTIONS));
+    options->tile_width = 320;
+    options->tile_height = 180;
+    options->frame_rate = 30.0f;
+
+    for (; i < argc && '-' == argv[i][0] && argv[i][1]; i++)
+    {
+        if (0 == strcmp(argv[i], "-realtime"))
+        {
+            options->realtime = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            return -1;
+        }
+
+        if (0 == strcmp(argv[i], "-tile"))
+        {
+            if (2 != sscanf(argv[++i], "%ux%u", &options->tile_width, &options->tile_height) ||
+                !options->tile_width || !options->tile_height)
+            {
+                return -1;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-columns"))
+        {
+            options->columns = atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-rate"))
+        {
+            options->frame_rate = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-threads"))
+        {
+            options->thread_count = atoi(argv[++i]);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (argc - i < 3 || evx_parse_output_format(argv[i], &options->format) < 0 || options->frame_rate <= 0.0f)
+    {
+        return -1;
+    }
+
+    options->dest_filename = argv[i + 1];
+    *first_source = i + 2;
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    EVX_MOSAIC mosaic;
+    EVX_MOSAIC_OPTIONS options;
+    EVX_ASYNC_WRITER writer;
+    EVX_THREAD_POOL pool;
+    int32 first_source = 0;
+    uint64 frame_count = 0;
+
+    if (_parse_options(argc, argv, &options, &first_source) < 0)
+    {
+        // Use stderr here, as stdout may be feeding another process.
+        fprintf(stderr, "Required syntax: mosaic [-tile <width>x<height>] [-columns <count>] [-rate <fps>] [-threads <count>] [-realtime] "
+                        "<rgb|y4m|bgra> <output_filename|-> <input_filename> [<input_filename> ...]\n");
+        return 0;
+    }
+
+    if (evx_writer_open(options.dest_filename, &writer) < 0)
+    {
+        return 0;
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    mosaic.stream_count = argc - first_source;
+    mosaic.streams = new EVX_MOSAIC_STREAM[mosaic.stream_count];
+    mosaic.tile_width = options.tile_width;
+    mosaic.tile_height = options.tile_height;
+    mosaic.realtime = options.realtime;
+
+    uint32 columns = options.columns ? options.columns : (uint32) ceil(sqrt((double) mosaic.stream_count));
+    uint32 rows = (mosaic.stream_count + columns - 1) / columns;
+
+    create_image(EVX_IMAGE_FORMAT_R8G8B8, columns * mosaic.tile_width, rows * mosaic.tile_height, &mosaic.output_image);
+    memset(mosaic.output_image.query_data(), 0, mosaic.output_image.query_row_pitch() * mosaic.output_image.query_height());
+
+    for (uint32 i = 0; i < mosaic.stream_count; i++)
+    {
+        EVX_MOSAIC_STREAM *stream = &mosaic.streams[i];
+
+        stream->filename = argv[first_source + i];
+        stream->open = (evx_reader_open(stream->filename, &stream->reader) >= 0);
+        stream->done = !stream->open;
+        stream->column_offsets = NULL;
+        stream->target_frame = 0;
+        stream->decoded_frames = 0;
+        stream->max_lag = 0;
+        stream->decode_seconds = 0.0;
+
+        // Images are stored bottom-up, so the first row of tiles sits at the
+        // top of the output image.
+        stream->tile_x = (i % columns) * mosaic.tile_width;
+        stream->tile_y = (rows - 1 - i / columns) * mosaic.tile_height;
+
+        if (stream->open)
+        {
+            EVX_MEDIA_FILE_HEADER *header = &stream->reader.header;
+            create_image(EVX_IMAGE_FORMAT_R8G8B8, header->frame_width, header->frame_height, &stream->frame_image);
+            _prepare_tile_mapping(&mosaic, stream);
+        }
+    }
+
+    evx_pool_open(options.thread_count, &pool);
+    evx_msg("Decoding %i streams on %i threads into a %ix%i mosaic", mosaic.stream_count, 
+            evx_pool_query_thread_count(&pool), mosaic.output_image.query_width(), mosaic.output_image.query_height());
+
+    evx_clock::time_point start_time = evx_clock::now();
+    double output_period = 1.0 / options.frame_rate;
+    double next_report = 1.0;
+    bool active = true;
+
+    while (active)
+    {
+        // Every stream is paced by its own frame rate, against either the 
+        // wall clock or the output timeline.
+        double elapsed = options.realtime ? _get_elapsed_seconds(start_time) : frame_count * output_period;
+        mosaic.deadline = start_time + std::chrono::duration_cast<evx_clock::duration>(
+                                           std::chrono::duration<double>((frame_count + 1) * output_period));
+        active = false;
+
+        for (uint32 i = 0; i < mosaic.stream_count; i++)
+        {
+            EVX_MOSAIC_STREAM *stream = &mosaic.streams[i];
+            stream->target_frame = (uint64) (elapsed * stream->reader.header.frame_rate) + 1;
+            active |= !stream->done;
+        }
+
+        if (!active)
+        {
+            break;
+        }
+
+        evx_pool_run(&pool, _update_stream, &mosaic, mosaic.stream_count);
+
+        uint32 output_size = evx_query_output_size(options.format, mosaic.output_image.query_width(), mosaic.output_image.query_height());
+        uint8 *dest = evx_writer_acquire(&writer, output_size);
+        uint32 size = 0;
+
+        if (0 == frame_count)
+        {
+            size += evx_write_output_header(options.format, mosaic.output_image.query_width(), 
+                                            mosaic.output_image.query_height(), options.frame_rate, dest);
+        }
+
+        size += evx_write_output_frame(options.format, &mosaic.output_image, dest + size);
+
+        if (evx_writer_submit(&writer, size) < 0)
+        {
+            evx_msg("Error writing mosaic frame %llu, stopping", frame_count);
+            break;
+        }
+
+        frame_count++;
+
+        if (frame_count * output_period >= next_report)
+        {
+            _report_lag(&mosaic, _get_elapsed_seconds(start_time));
+            next_report += 1.0;
+        }
+
+        if (options.realtime)
+        {
+            std::this_thread::sleep_until(mosaic.deadline);
+        }
+    }
+
+    _report_lag(&mosaic, _get_elapsed_seconds(start_time));
+    evx_msg("Wrote %llu mosaic frames", frame_count);
+
+    evx_pool_close(&pool);
+    evx_writer_close(&writer);
+
+    for (uint32 i = 0; i < mosaic.stream_count; i++)
+    {
+        if (mosaic.streams[i].open)
+        {
+            destroy_image(&mosaic.streams[i].frame_image);
+            evx_reader_close(&mosaic.streams[i].reader);
+            delete [] mosaic.streams[i].column_offsets;
+        }
+    }
+
+    destroy_image(&mosaic.output_image);
+    delete [] mosaic.streams;
+
+    return 0;
+}
@@ -0,0 +1,342 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_output.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_output.h"
+#include "evx_scale.h"
+
+#if defined(EVX_PLATFORM_WINDOWS)
+#include <io.h>
+#include <fcntl.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#else
+#include <unistd.h>
+#endif
+
+#include <math.h>
+
+void _writer_thread_main(EVX_ASYNC_WRITER *writer)
+{
+    std::unique_lock<std::mutex> guard(writer->lock);
+
+    while (true)
+    {
+        while (!writer->pending && !writer->closing)
+        {
+            writer->signal.wait(guard);
+        }
+
+        if (!writer->pending)
+        {
+            break;
+        }
+
+        // The producer never touches the pending buffer, so the write
+        // itself may proceed without holding the lock.
+        uint8 *data = writer->buffers[writer->fill_index ^ 1];
+        uint32 size = writer->pending_size;
+
+        guard.unlock();
+        bool failed = (size && 1 != fwrite(data, size, 1, writer->file));
+        guard.lock();
+
+        writer->failed |= failed;
+        writer->pending = false;
+        writer->signal.notify_all();
+    }
+}
+
+FILE *evx_open_output_file(const char *filename)
+{
+    if (0 != strcmp(filename, "-"))
+    {
+        return fopen(filename, "wb");
+    }
+
+    int32 fd = dup(fileno(stdout));
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    fflush(stdout);
+    dup2(fileno(stderr), fileno(stdout));
+
+#if defined(EVX_PLATFORM_WINDOWS)
+    _setmode(fd, _O_BINARY);
+#endif
+
+    return fdopen(fd, "wb");
+}
+
+int32 evx_writer_open(const char *filename, EVX_ASYNC_WRITER *writer)
+{
+    writer->file = NULL;
+    writer->fill_index = 0;
+    writer->pending_size = 0;
+    writer->pending = false;
+    writer->closing = false;
+    writer->failed = false;
+    writer->buffers[0] = NULL;
+    writer->buffers[1] = NULL;
+    writer->buffer_sizes[0] = 0;
+    writer->buffer_sizes[1] = 0;
+
+    writer->file = evx_open_output_file(filename);
+
+    if (!writer->file)
+    {
+        evx_msg("Error opening dest file %s", filename);
+        return -1;
+    }
+
+    writer->thread = std::thread(_writer_thread_main, writer);
+
+    return 0;
+}
+
+int32 evx_writer_close(EVX_ASYNC_WRITER *writer)
+{
+    if (writer->thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(writer->lock);
+            writer->closing = true;
+            writer->signal.notify_all();
+        }
+
+        writer->thread.join();
+    }
+
+    if (writer->file)
+    {
+        writer->failed |= (0 != fflush(writer->file));
+        fclose(writer->file);
+        writer->file = NULL;
+    }
+
+    delete [] writer->buffers[0];
+    delete [] writer->buffers[1];
+    writer->buffers[0] = NULL;
+    writer->buffers[1] = NULL;
+
+    return writer->failed ? -1 : 0;
+}
+
+uint8 *evx_writer_acquire(EVX_ASYNC_WRITER *writer, uint32 size)
+{
+    uint32 index = writer->fill_index;
+
+    // The fill buffer is never in flight, so it may be grown freely.
+    if (writer->buffer_sizes[index] < size)
+    {
+        delete [] writer->buffers[index];
+        writer->buffers[index] = new uint8[size];
+        writer->buffer_sizes[index] = size;
+    }
+
+    return writer->buffers[index];
+}
+
+int32 evx_writer_submit(EVX_ASYNC_WRITER *writer, uint32 size)
+{
+    std::unique_lock<std::mutex> guard(writer->lock);
+
+    while (writer->pending)
+    {
+        writer->signal.wait(guard);
+    }
+
+    if (writer->failed)
+    {
+        return -1;
+    }
+
+    writer->pending = true;
+    writer->pending_size = size;
+    writer->fill_index ^= 1;
+    writer->signal.notify_all();
+
+    return 0;
+}
+
+int32 evx_parse_output_format(const char *name, EVX_OUTPUT_FORMAT *format)
+{
+    if (0 == strcmp(name, "rgb"))
+    {
+        *format = EVX_OUTPUT_FORMAT_RGB;
+        return 0;
+    }
+
+    if (0 == strcmp(name, "y4m"))
+    {
+        *format = EVX_OUTPUT_FORMAT_Y4M;
+        return 0;
+    }
+
+    if (0 == strcmp(name, "bgra"))
+    {
+        *format = EVX_OUTPUT_FORMAT_BGRA;
+        return 0;
+    }
+
+    return -1;
+}
+
+uint32 evx_query_output_size(EVX_OUTPUT_FORMAT format, uint32 width, uint32 height)
+{
+    switch (format)
+    {
+        case EVX_OUTPUT_FORMAT_RGB: return width * height * 3;
+        case EVX_OUTPUT_FORMAT_Y4M: return width * height * 3 + 128;
+        case EVX_OUTPUT_FORMAT_BGRA: return width * height * 4;
+    };
+
+    return 0;
+}
+
+void _get_rate_fraction(float frame_rate, uint32 *num, uint32 *den)
+{
+    // Rates such as 29.97 are stored as floats, so recover the NTSC 
+    // fraction where possible rather than writing 2997:100.
+    uint32 ntsc_rate = (uint32) (frame_rate * 1.001f + 0.5f);
+
+    if (fabs(frame_rate - ntsc_rate / 1.001f) < 0.005f && 
+        fabs(frame_rate - (float) ntsc_rate) > 0.005f)
+    {
+        *num = ntsc_rate * 1000;
+        *den = 1001;
+        return;
+    }
+
+    *num = (uint32) (frame_rate * 1000.0f + 0.5f);
+    *den = 1000;
+
+    while (*num && 0 == (*num % 10) && 0 == (*den % 10))
+    {
+        *num /= 10;
+        *den /= 10;
+    }
+}
+
+uint32 evx_write_output_header(EVX_OUTPUT_FORMAT format, uint32 width, uint32 height, float frame_rate, uint8 *dest)
+{
+    uint32 num = 0;
+    uint32 den = 0;
+
+    if (EVX_OUTPUT_FORMAT_Y4M != format)
+    {
+        return 0;
+    }
+
+    _get_rate_fraction(frame_rate, &num, &den);
+
+    return sprintf((char *) dest, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C444\n", width, height, num, den);
+}
+
+uint32 _write_rgb_frame(image *source, uint8 *dest)
+{
+    uint32 width = source->query_width();
+    uint32 height = source->query_height();
+    uint32 pitch = source->query_row_pitch();
+    uint8 *data = source->query_data();
+
+    // Decoded images are stored bottom-up for direct texture upload, while
+    // raw consumers expect the first row to be the top of the picture.
+    for (uint32 r = 0; r < height; r++)
+    {
+        memcpy(dest + r * width * 3, data + (height - r - 1) * pitch, width * 3);
+    }
+
+    return width * height * 3;
+}
+
+uint32 _write_bgra_frame(image *source, uint8 *dest)
+{
+    uint32 width = source->query_width();
+    uint32 height = source->query_height();
+    uint32 pitch = source->query_row_pitch();
+    uint8 *data = source->query_data();
+
+    for (uint32 r = 0; r < height; r++)
+    {
+        evx_expand_bgra(data + (height - r - 1) * pitch, width, dest + r * width * 4);
+    }
+
+    return width * height * 4;
+}
+
+uint32 _write_y4m_frame(image *source, uint8 *dest)
+{
+    uint32 width = source->query_width();
+    uint32 height = source->query_height();
+    uint32 pitch = source->query_row_pitch();
+    uint8 *data = source->query_data();
+    uint32 tag_size = sprintf((char *) dest, "FRAME\n");
+    uint8 *y_plane = dest + tag_size;
+    uint8 *u_plane = y_plane + width * height;
+    uint8 *v_plane = u_plane + width * height;
+
+    for (uint32 r = 0; r < height; r++)
+    {
+        uint8 *src = data + (height - r - 1) * pitch;
+        uint32 row_offset = r * width;
+
+        for (uint32 c = 0; c < width; c++)
+        {
+            int32 red = src[3 * c + 0];
+            int32 green = src[3 * c + 1];
+            int32 blue = src[3 * c + 2];
+
+            // BT.601 studio swing.
+            y_plane[row_offset + c] = (( 66 * red + 129 * green +  25 * blue + 128) >> 8) + 16;
+            u_plane[row_offset + c] = ((-38 * red -  74 * green + 112 * blue + 128) >> 8) + 128;
+            v_plane[row_offset + c] = ((112 * red -  94 * green -  18 * blue + 128) >> 8) + 128;
+        }
+    }
+
+    return tag_size + width * height * 3;
+}
+
+uint32 evx_write_output_frame(EVX_OUTPUT_FORMAT format, image *source, uint8 *dest)
+{
+    switch (format)
+    {
+        case EVX_OUTPUT_FORMAT_RGB: return _write_rgb_frame(source, dest);
+        case EVX_OUTPUT_FORMAT_Y4M: return _write_y4m_frame(source, dest);
+        case EVX_OUTPUT_FORMAT_BGRA: return _write_bgra_frame(source, dest);
+    };
+
+    return 0;
+}
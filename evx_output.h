@@ -0,0 +1,105 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_output.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_OUTPUT_H__
+#define __EVX_OUTPUT_H__
+
+#include "cairo/base.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+typedef enum EVX_OUTPUT_FORMAT
+{
+    EVX_OUTPUT_FORMAT_RGB = 0,      // packed top-down rgb24, no framing.
+    EVX_OUTPUT_FORMAT_Y4M,          // yuv4mpeg2 stream using 4:4:4 bt.601.
+    EVX_OUTPUT_FORMAT_BGRA,         // packed top-down bgra32 with opaque alpha, no framing.
+
+} EVX_OUTPUT_FORMAT;
+
+// The async writer owns two buffers. The producer fills one while a 
+// background thread flushes the other, so a slow consumer on the far 
+// side of a pipe only stalls the producer once both buffers are full.
+
+typedef struct EVX_ASYNC_WRITER
+{
+    FILE *file;
+    uint8 *buffers[2];
+    uint32 buffer_sizes[2];
+    uint32 fill_index;
+    uint32 pending_size;
+    bool pending;
+    bool closing;
+    bool failed;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable signal;
+
+} EVX_ASYNC_WRITER;
+
+// Opens filename for synchronous binary writing. A filename of "-" selects 
+// stdout, which is redirected to stderr first so that evx_msg output cannot 
+// corrupt the stream.
+FILE *evx_open_output_file(const char *filename);
+
+// Opens filename for asynchronous writing, with the same handling of "-"
+// as evx_open_output_file.
+int32 evx_writer_open(const char *filename, EVX_ASYNC_WRITER *writer);
+int32 evx_writer_close(EVX_ASYNC_WRITER *writer);
+
+// Returns a buffer of at least size bytes that the caller may fill 
+// before the next submit.
+uint8 *evx_writer_acquire(EVX_ASYNC_WRITER *writer, uint32 size);
+
+// Queues size bytes of the acquired buffer for writing. Blocks only if 
+// the previously submitted buffer is still being written.
+int32 evx_writer_submit(EVX_ASYNC_WRITER *writer, uint32 size);
+
+int32 evx_parse_output_format(const char *name, EVX_OUTPUT_FORMAT *format);
+
+// Returns the worst case number of bytes produced per frame, including
+// any per-frame framing and the stream header.
+uint32 evx_query_output_size(EVX_OUTPUT_FORMAT format, uint32 width, uint32 height);
+
+// Writes the stream header (if any) for format to dest, returning the 
+// number of bytes written.
+uint32 evx_write_output_header(EVX_OUTPUT_FORMAT format, uint32 width, uint32 height, float frame_rate, uint8 *dest);
+
+// Converts a decoded R8G8B8 image into format at dest, returning the 
+// number of bytes written.
+uint32 evx_write_output_frame(EVX_OUTPUT_FORMAT format, image *source, uint8 *dest);
+
+#endif // __EVX_OUTPUT_H__
@@ -33,17 +33,49 @@
 #include "cairo/base.h"
 #include "cairo/evx1.h"
 #include "cairo/image.h"
+#include "evx_cache.h"
 #include "evx_format.h"
+#include "evx_memory.h"
+#include "evx_reader.h"
+#include "evx_scale.h"
+#include "evx_shm.h"
+
+#include <math.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 #if defined(EVX_PLATFORM_WINDOWS)
-#include "time.h"
+#include <windows.h>
+#elif defined(EVX_PLATFORM_MACOSX)
+#include <mach/mach_time.h>
+#include <unistd.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Headless builds (EVX_HEADLESS) have no window. Frames are still decoded
+// and paced on the same schedule, and can be published with -share.
+#if !defined(EVX_HEADLESS)
+#if defined(EVX_PLATFORM_WINDOWS)
 #include "gl/gl.h"
 #include "glut/glut.h"
 #elif defined(EVX_PLATFORM_MACOSX)
-#include <sys/time.h>
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
 #include <GLUT/glut.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#endif
+
+// Pixel buffer uploads need GL 2.1 entry points, which Windows only exposes
+// through an extension loader, so the direct upload is used there.
+#if !defined(EVX_HEADLESS) && !defined(EVX_PLATFORM_WINDOWS)
+#define EVX_PLAYER_PBO
 #endif
 
 typedef struct EVX_VIDEO_STATE
@@ -53,37 +85,184 @@ typedef struct EVX_VIDEO_STATE
     uint32 frame_rate;
     uint32 frame_count;
     int32 frame_rate_mul;
+    int32 direction;            // 1 when playing forward, -1 in reverse.
     
 } EVX_VIDEO_STATE;
 
-image g_frame_image;
-evx1_decoder *g_decoder;
-bit_stream g_cairo_stream;
+// Presentation deadlines are kept in fractional seconds on a monotonic 
+// clock, so rates such as 29.97 fps do not drift over time. Each frame is 
+// due at its timestamp relative to an anchor frame, which lets variable 
+// rate streams keep their own pacing. The anchor is dropped whenever the
+// schedule is reset, the playlist moves on, or the timestamps jump. A frame
+// that is not yet due is held, and waited for in short slices, so that the
+// window keeps handling events however slowly frames are presented.
+
+#define EVX_MAX_CONSECUTIVE_DROPS       (8)
+#define EVX_MAX_TIMESTAMP_GAP           (10.0)
+#define EVX_MAX_SCHEDULER_SLEEP         (0.01)
+
+typedef struct EVX_FRAME_SCHEDULER
+{
+    double frame_duration;          // seconds per frame at 1x.
+    double next_deadline;           // when the last presented frame ends.
+
+    bool anchored;
+    double anchor_time;
+    int64 anchor_timestamp;
+
+    double frame_deadline;          // when the last frame read is due.
+    double frame_length;            // and how long it is shown for.
+    bool frame_waiting;             // true while that frame awaits its deadline.
+
+    uint64 presented_count;
+    uint64 late_count;
+    uint64 dropped_count;
+
+} EVX_FRAME_SCHEDULER;
+
+// Playlists are played back to back. While one stream plays, the next is
+// opened and its first frames are decoded on a background thread, so that
+// switching streams costs no more than presenting any other frame.
+
+#define EVX_PRELOAD_FRAME_COUNT         (4)
+#define EVX_PLAYLIST_MAX_LINE           (4096)
+
+// Files that can be seeked are played from a frame cache instead, which 
+// decodes ahead on its own thread and keeps recent frames, so that they 
+// can be stepped through, scrubbed and played in reverse.
+
+#define EVX_PLAYER_SEEK_SECONDS         (5.0)
+
+typedef struct EVX_PLAYER_STREAM
+{
+    EVX_READER reader;
+    bool open;
+    int32 status;                   // result of opening the stream, 0 if playable.
+    uint32 playlist_index;
+
+    image frames[EVX_PRELOAD_FRAME_COUNT];
+    EVX_MEDIA_FRAME_HEADER frame_headers[EVX_PRELOAD_FRAME_COUNT];
+    uint32 frame_width;             // dimensions of the preload frames, zero if not allocated.
+    uint32 frame_height;
+    uint32 frame_count;             // frames decoded ahead of playback.
+    uint32 next_frame;              // the next of those to present.
+
+    EVX_FRAME_CACHE cache;
+    bool cached;                    // true if frames come from the cache.
+    int64 current_frame;            // the frame last presented from the cache.
+    EVX_MEDIA_FRAME_HEADER cached_header;
+
+} EVX_PLAYER_STREAM;
+
+// Frames are uploaded either directly from the decoded image, which blocks
+// until the driver has copied it, or through a ring of pixel buffers. The
+// buffered path expands each frame to BGRA, the layout drivers transfer 
+// without conversion, and the transfer then proceeds while the next frame
+// is decoded.
 
-EVX_MEDIA_FILE_HEADER g_header = {0};
+#define EVX_UPLOAD_BUFFER_COUNT         (3)
+
+typedef enum EVX_UPLOAD_MODE
+{
+    EVX_UPLOAD_MODE_DIRECT = 0,
+    EVX_UPLOAD_MODE_PBO,
+
+} EVX_UPLOAD_MODE;
+
+// Frames larger than the window are presented from a proxy, scaled down on
+// the thread that decodes them, so that upload bandwidth and texture memory
+// follow the window rather than the source. Proxies are reduced in powers
+// of two, which keeps resizing the window from rescaling on every step. 
+// The quality mode picks the smallest proxy that still covers the window, 
+// and the speed mode the largest one that fits inside it.
+
+#define EVX_MAX_PROXY_LEVEL             (4)
+
+typedef enum EVX_PROXY_MODE
+{
+    EVX_PROXY_MODE_OFF = 0,
+    EVX_PROXY_MODE_QUALITY,
+    EVX_PROXY_MODE_SPEED,
+
+} EVX_PROXY_MODE;
+
+typedef struct EVX_PLAYER_OPTIONS
+{
+    std::vector<std::string> playlist;
+    const char *share_path;     // non-null to publish decoded frames.
+    bool follow;
+    bool loop;                  // restart the playlist when it ends.
+    bool memory_profile;        // report allocations and footprint for each stream.
+    bool reverse;               // play each file from its last frame to its first.
+    uint64 cache_size;          // bytes of decoded frames cached per file, zero to disable.
+    EVX_UPLOAD_MODE upload_mode;
+    EVX_PROXY_MODE proxy_mode;
+
+} EVX_PLAYER_OPTIONS;
+
+EVX_PLAYER_OPTIONS g_options;
+EVX_PLAYER_STREAM g_streams[2];
+EVX_PLAYER_STREAM *g_current_stream = &g_streams[0];
+EVX_PLAYER_STREAM *g_next_stream = &g_streams[1];
+std::thread g_preload_thread;
+
+image g_frame_image;
+bool g_frame_image_allocated = false;
+image g_decode_image;               // full size frames of streams that are scaled after decoding.
+bool g_decode_image_allocated = false;
+uint32 g_window_width = 0;          // zero until the window exists, and in headless builds.
+uint32 g_window_height = 0;
+EVX_SHM_PUBLISHER g_shared_output;
+bool g_shared_output_enabled = false;
 EVX_VIDEO_STATE g_video_state = {0};
+EVX_FRAME_SCHEDULER g_scheduler = {0};
 
 uint32 g_recent_bits_read = 0;
-uint32 g_source_file_size = 0;
 uint32 g_frame_texture = EVX_MAX_UINT32;
+uint32 g_texture_width = 0;
+uint32 g_texture_height = 0;
+uint32 g_upload_buffers[EVX_UPLOAD_BUFFER_COUNT] = {0};
+uint32 g_upload_index = 0;
+double g_upload_seconds = 0.0;      // time spent uploading since the last report.
+uint32 g_upload_count = 0;
 
-FILE *g_source_file = NULL;
-uint8 *g_temp_buffer = NULL;
+// Each stream is profiled from the moment it becomes current. Frames that
+// are preloaded for it are counted in the profile of the stream before.
+EVX_MEMORY_PROFILE g_memory_profile;
+bool g_memory_profile_started = false;
 
-uint64 _get_system_time_ms()
+double _get_system_time()
 {
 #if defined(EVX_PLATFORM_WINDOWS)
-    return double(clock()) / CLOCKS_PER_SEC * 1000;
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / frequency.QuadPart;
 #elif defined(EVX_PLATFORM_MACOSX)
-    timeval time;
-    gettimeofday(&time, NULL);
-    return (time.tv_sec * 1000) + (time.tv_usec / 1000);
+    static mach_timebase_info_data_t timebase = {0};
+    if (!timebase.denom) mach_timebase_info(&timebase);
+    return (double) mach_absolute_time() * timebase.numer / timebase.denom / 1000000000.0;
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1000000000.0;
 #endif
 }
 
-uint32 _get_elapsed_time_ms(uint64 from_time)
+void _sleep_until(double deadline)
 {
-    return (_get_system_time_ms() - from_time);
+    double remaining = deadline - _get_system_time();
+
+    if (remaining <= 0.0)
+    {
+        return;
+    }
+
+#if defined(EVX_PLATFORM_WINDOWS)
+    Sleep((DWORD) (remaining * 1000.0));
+#else
+    usleep((useconds_t) (remaining * 1000000.0));
+#endif
 }
 
 float _get_rate_multiplier()
@@ -98,25 +277,118 @@ float _get_rate_multiplier()
     }
 }
 
-bool _should_update_video_frame()
+void _reset_schedule()
 {
-    float rate_multiplier = _get_rate_multiplier();
-    rate_multiplier = max(_get_rate_multiplier(), 0.1f);
-    
-    static uint64 g_last_time = _get_system_time_ms();
-    uint32 required_ms = ((float) g_video_state.frame_rate / rate_multiplier);
-    uint32 elapsed = _get_elapsed_time_ms(g_last_time);
-    
-    if (elapsed < required_ms)
+    g_scheduler.next_deadline = _get_system_time();
+    g_scheduler.anchored = false;
+
+    // A held frame was scheduled under the old state, so it is due now.
+    g_scheduler.frame_deadline = min(g_scheduler.frame_deadline, g_scheduler.next_deadline);
+}
+
+// Works out when a frame that was just read from the current stream is due.
+void _schedule_frame(const EVX_MEDIA_FRAME_HEADER &frame_header)
+{
+    int64 timestamp = 0;
+    uint32 duration = 0;
+    double rate = max(_get_rate_multiplier(), 0.1f);
+
+    evx_query_frame_time(g_current_stream->reader.header, frame_header, &timestamp, &duration);
+
+    double deadline = g_scheduler.anchor_time + (double) (timestamp - g_scheduler.anchor_timestamp) * 
+                      g_video_state.direction / (EVX_TIMESTAMP_SCALE * rate);
+
+    // A discontinuity in the timestamps restarts the schedule so the frame
+    // simply follows the previous one.
+    if (!g_scheduler.anchored || fabs(deadline - g_scheduler.next_deadline) > EVX_MAX_TIMESTAMP_GAP / rate)
+    {
+        g_scheduler.anchored = true;
+        g_scheduler.anchor_time = g_scheduler.next_deadline;
+        g_scheduler.anchor_timestamp = timestamp;
+        deadline = g_scheduler.next_deadline;
+    }
+
+    g_scheduler.frame_deadline = deadline;
+    g_scheduler.frame_length = (duration ? (double) duration / EVX_TIMESTAMP_SCALE : g_scheduler.frame_duration) / rate;
+}
+
+int32 _read_next_frame(image *output);
+void _update_frame_image();
+
+#if !defined(EVX_HEADLESS)
+
+void update_scene();
+void render_scene();
+void _prepare_frame_texture();
+
+// Moves playback to frame, and presents it right away if paused, which is
+// how frames are stepped through and scrubbed while paused.
+void _move_to_frame(int64 frame)
+{
+    EVX_PLAYER_STREAM *stream = g_current_stream;
+    int64 last_frame = (int64) evx_cache_query_frame_count(&stream->cache) - 1;
+
+    frame = max(min(frame, last_frame), (int64) 0);
+    stream->current_frame = frame - g_video_state.direction;
+    evx_cache_seek(&stream->cache, frame, g_video_state.direction);
+
+    if (g_video_state.state && 0 == _read_next_frame(&g_frame_image))
     {
+        _prepare_frame_texture();
+        render_scene();
+    }
+}
+
+// Handles the keys that move around within a file. Returns false if the 
+// current file is not played from the cache.
+bool _handle_trick_key(unsigned char key)
+{
+    EVX_PLAYER_STREAM *stream = g_current_stream;
+    int64 seek_frames = (int64) (EVX_PLAYER_SEEK_SECONDS / g_scheduler.frame_duration);
+
+    if (!stream->cached)
+    {
+        evx_msg("Stepping, seeking and reverse playback require a file played from the frame cache");
         return false;
     }
 
-    g_last_time = _get_system_time_ms();
-    
+    // A held frame follows the old position, so it is discarded.
+    g_scheduler.frame_waiting = false;
+
+    switch (key)
+    {
+        case 'r': 
+        {
+            g_video_state.direction = -g_video_state.direction;
+            evx_cache_seek(&stream->cache, max(stream->current_frame, (int64) 0), g_video_state.direction);
+        } break;
+
+        case ',':
+        case '.': 
+        {
+            g_video_state.state = true;
+            _move_to_frame(stream->current_frame + ((',' == key) ? -1 : 1));
+        } break;
+
+        case '[': _move_to_frame(stream->current_frame - seek_frames); break;
+        case ']': _move_to_frame(stream->current_frame + seek_frames); break;
+    };
+
     return true;
 }
 
+void handle_reshape(int width, int height)
+{
+    glViewport(0, 0, width, height);
+
+    g_window_width = max(width, 1);
+    g_window_height = max(height, 1);
+
+    // The texture keeps the last frame until the next one is presented at
+    // the new size.
+    _update_frame_image();
+}
+
 void handle_key_press(unsigned char key, int x, int y) 
 {
     switch (key)
@@ -127,73 +399,534 @@ void handle_key_press(unsigned char key, int x, int y)
         case '_':
         case '-': g_video_state.frame_rate_mul--; break;
         case 'p': g_video_state.state = !g_video_state.state; break;
+        case 'r':
+        case ',':
+        case '.':
+        case '[':
+        case ']': if (!_handle_trick_key(key)) return; break;
     };
 
     g_video_state.frame_rate_mul = min(g_video_state.frame_rate_mul, 9);
     g_video_state.frame_rate_mul = max(g_video_state.frame_rate_mul, -7);
 
-    evx_msg("Playback state: %s, rate %.2fx",
-        (g_video_state.state ? "paused" : "playing"), _get_rate_multiplier());
+    // Restart the schedule from now, and stop idling entirely while paused.
+    _reset_schedule();
+    glutIdleFunc(g_video_state.state ? NULL : &update_scene);
+
+    evx_msg("Playback state: %s, rate %.2fx%s",
+        (g_video_state.state ? "paused" : "playing"), _get_rate_multiplier(), 
+        (g_video_state.direction < 0) ? " in reverse" : "");
 }
 
-uint32 _get_file_size(FILE *f)
+#endif
+
+void _report_bit_rate()
+{
+    if (0 == (g_video_state.frame_count % g_video_state.frame_rate))
+    {
+        evx_msg("Average bitrate: %.2f Mbps, late frames: %llu, dropped frames: %llu, upload: %.3f ms", 
+            (float) g_recent_bits_read / 1000000.0f, g_scheduler.late_count, g_scheduler.dropped_count,
+            g_upload_count ? g_upload_seconds * 1000.0 / g_upload_count : 0.0);
+        g_recent_bits_read = 0;
+        g_upload_seconds = 0.0;
+        g_upload_count = 0;
+    }
+}
+
+// Returns the dimensions that frames of a stream are presented at in a 
+// window of the given size.
+void _query_output_size(const EVX_MEDIA_FILE_HEADER &header, uint32 window_width, uint32 window_height, 
+                        uint32 *width, uint32 *height)
 {
-    uint32 file_size = 0;
-    uint32 seek_pos = ftell(f);
+    uint32 level = 0;
 
-    fseek(f, 0, SEEK_END);
-    file_size = ftell(f);
-    fseek(f, seek_pos, SEEK_SET);
+    // Shared output slots always receive full size frames.
+    if (window_width && window_height && !g_options.share_path)
+    {
+        if (EVX_PROXY_MODE_QUALITY == g_options.proxy_mode)
+        {
+            while (level < EVX_MAX_PROXY_LEVEL && (header.frame_width >> (level + 1)) >= window_width && 
+                   (header.frame_height >> (level + 1)) >= window_height)
+            {
+                level++;
+            }
+        }
+        else if (EVX_PROXY_MODE_SPEED == g_options.proxy_mode)
+        {
+            while (level < EVX_MAX_PROXY_LEVEL && ((header.frame_width >> level) > window_width || 
+                   (header.frame_height >> level) > window_height))
+            {
+                level++;
+            }
+        }
+    }
 
-    return file_size;
+    *width = max(header.frame_width >> level, 1u);
+    *height = max(header.frame_height >> level, 1u);
 }
 
-void _report_bit_rate()
+void _close_stream(EVX_PLAYER_STREAM *stream)
 {
-    if (0 == (g_video_state.frame_count % g_video_state.frame_rate))
+    if (stream->cached)
     {
-        evx_msg("Average bitrate: %.2f Mbps", (float) g_recent_bits_read / 1000000.0f);
-        g_recent_bits_read = 0;
+        evx_cache_close(&stream->cache);
+        stream->cached = false;
+    }
+
+    if (stream->open)
+    {
+        evx_reader_close(&stream->reader);
+        stream->open = false;
     }
+
+    stream->frame_count = 0;
+    stream->next_frame = 0;
 }
 
-void _read_next_frame(image *output)
+void _release_stream_frames(EVX_PLAYER_STREAM *stream)
 {
-    EVX_MEDIA_FRAME_HEADER frame_header;
+    for (uint32 i = 0; stream->frame_width && i < EVX_PRELOAD_FRAME_COUNT; i++)
+    {
+        destroy_image(&stream->frames[i]);
+    }
 
-    // If we've completed all frames in the file, do nothing.
-    if (g_header.frame_count && (g_video_state.frame_count >= g_header.frame_count))
+    stream->frame_width = 0;
+    stream->frame_height = 0;
+}
+
+// Opens a playlist entry, which validates its header, and decodes its first
+// frames, or starts its frame cache decoding them in the given direction 
+// and at the proxy size for the window. This runs on the preload thread 
+// and only touches the stream.
+void _preload_stream(EVX_PLAYER_STREAM *stream, uint32 playlist_index, int32 direction, uint32 window_width, uint32 window_height)
+{
+    _close_stream(stream);
+    evx_memory_set_stage(EVX_MEMORY_STAGE_INGEST);
+
+    stream->playlist_index = playlist_index;
+    stream->status = evx_reader_open(g_options.playlist[playlist_index].c_str(), &stream->reader);
+
+    if (0 != stream->status)
     {
         return;
     }
 
-    // If there is nothing left to read in the file, do nothing.
-    if (ftell(g_source_file) >= g_source_file_size)
+    stream->open = true;
+    stream->reader.follow = g_options.follow;
+
+    const char *filename = g_options.playlist[playlist_index].c_str();
+    uint32 output_width = 0, output_height = 0;
+
+    _query_output_size(stream->reader.header, window_width, window_height, &output_width, &output_height);
+
+    if (g_options.cache_size && !g_options.follow && 0 != strcmp(filename, "-") &&
+        0 == evx_cache_open(filename, g_options.cache_size, output_width, output_height, &stream->cache))
     {
+        uint64 frame_count = evx_cache_query_frame_count(&stream->cache);
+
+        stream->cached = true;
+        evx_cache_seek(&stream->cache, (direction < 0) ? frame_count - 1 : 0, direction);
+        evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
         return;
     }
 
-    // If insufficient time has passed, do nothing.
-    if (!_should_update_video_frame())
+    uint32 width = stream->reader.header.frame_width;
+    uint32 height = stream->reader.header.frame_height;
+
+    if (stream->frame_width != width || stream->frame_height != height)
     {
-        return;
+        _release_stream_frames(stream);
+
+        for (uint32 i = 0; i < EVX_PRELOAD_FRAME_COUNT; i++)
+        {
+            create_image(EVX_IMAGE_FORMAT_R8G8B8, width, height, &stream->frames[i]);
+        }
+
+        stream->frame_width = width;
+        stream->frame_height = height;
+    }
+
+    evx_memory_set_stage(EVX_MEMORY_STAGE_DECODE);
+
+    while (stream->frame_count < EVX_PRELOAD_FRAME_COUNT && 
+           0 == evx_reader_next_frame(&stream->reader, &stream->frames[stream->frame_count]))
+    {
+        stream->frame_headers[stream->frame_count++] = stream->reader.frame_header;
+    }
+
+    evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
+}
+
+// Returns false at the end of a playlist that does not loop.
+bool _query_next_index(uint32 playlist_index, uint32 *next_index)
+{
+    *next_index = playlist_index + 1;
+
+    if (*next_index < g_options.playlist.size())
+    {
+        return true;
+    }
+
+    *next_index = 0;
+
+    return g_options.loop;
+}
+
+void _start_preload()
+{
+    uint32 next_index = 0;
+
+    if (_query_next_index(g_current_stream->playlist_index, &next_index))
+    {
+        g_preload_thread = std::thread(_preload_stream, g_next_stream, next_index, g_video_state.direction,
+                                       g_window_width, g_window_height);
+    }
+}
+
+void _stop_preload()
+{
+    if (g_preload_thread.joinable())
+    {
+        g_preload_thread.join();
+    }
+}
+
+void _print_cache_stats()
+{
+    if (g_current_stream->cached)
+    {
+        evx_msg("Frame cache: %llu hits, %llu misses", g_current_stream->cache.hit_count, g_current_stream->cache.miss_count);
+    }
+}
+
+void _print_memory_profile()
+{
+    if (g_memory_profile_started)
+    {
+        evx_memory_print(&g_memory_profile, g_options.playlist[g_current_stream->playlist_index].c_str());
+        g_memory_profile_started = false;
+    }
+}
+
+bool _is_stream_playable(EVX_PLAYER_STREAM *stream)
+{
+    if (0 != stream->status)
+    {
+        return false;
+    }
+
+    // Shared output slots are sized for the first stream.
+    if (g_shared_output_enabled && (stream->reader.header.frame_width != g_frame_image.query_width() || 
+                                    stream->reader.header.frame_height != g_frame_image.query_height()))
+    {
+        evx_msg("Dimensions of %s do not match the shared output", g_options.playlist[stream->playlist_index].c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool _is_stream_done(EVX_PLAYER_STREAM *stream)
+{
+    if (stream->cached)
+    {
+        int64 frame = stream->current_frame + g_video_state.direction;
+        return frame < 0 || frame >= (int64) evx_cache_query_frame_count(&stream->cache);
+    }
+
+    return stream->next_frame >= stream->frame_count && evx_reader_is_done(&stream->reader);
+}
+
+bool _is_playback_done()
+{
+    return !g_scheduler.frame_waiting && _is_stream_done(g_current_stream) && !g_preload_thread.joinable();
+}
+
+// Sizes the frame image for the current stream and window. The frame image,
+// and with it the texture, is only reallocated when the dimensions change.
+void _update_frame_image()
+{
+    const EVX_MEDIA_FILE_HEADER &header = g_current_stream->reader.header;
+    uint32 width = 0, height = 0;
+
+    _query_output_size(header, g_window_width, g_window_height, &width, &height);
+
+    if (g_frame_image_allocated && (g_frame_image.query_width() != width || g_frame_image.query_height() != height))
+    {
+        destroy_image(&g_frame_image);
+        g_frame_image_allocated = false;
+    }
+
+    if (!g_frame_image_allocated)
+    {
+        create_image(EVX_IMAGE_FORMAT_R8G8B8, width, height, &g_frame_image);
+        g_frame_image_allocated = true;
+
+        if (width != header.frame_width || height != header.frame_height)
+        {
+            evx_msg("Presenting %ux%u frames at %ux%u", header.frame_width, header.frame_height, width, height);
+        }
+    }
+
+    // Cached streams are scaled by their decode thread, and the others are 
+    // decoded at full size first.
+    if (g_current_stream->cached)
+    {
+        evx_cache_resize(&g_current_stream->cache, width, height);
+    }
+    else if (g_decode_image_allocated && (g_decode_image.query_width() != header.frame_width || 
+                                          g_decode_image.query_height() != header.frame_height))
+    {
+        destroy_image(&g_decode_image);
+        g_decode_image_allocated = false;
+    }
+
+    if (!g_current_stream->cached && !g_decode_image_allocated && (width != header.frame_width || height != header.frame_height))
+    {
+        create_image(EVX_IMAGE_FORMAT_R8G8B8, header.frame_width, header.frame_height, &g_decode_image);
+        g_decode_image_allocated = true;
+    }
+}
+
+// Makes the preloaded stream current, and starts preloading the one after
+// it. Entries that cannot be played are skipped, each at most once.
+int32 _advance_playlist()
+{
+    uint32 attempt_count = 1;
+
+    if (!g_preload_thread.joinable())
+    {
+        return -1;
+    }
+
+    g_preload_thread.join();
+
+    while (!_is_stream_playable(g_next_stream))
+    {
+        uint32 next_index = 0;
+
+        evx_msg("Skipping %s", g_options.playlist[g_next_stream->playlist_index].c_str());
+
+        if (attempt_count++ >= g_options.playlist.size() || !_query_next_index(g_next_stream->playlist_index, &next_index))
+        {
+            return -1;
+        }
+
+        _preload_stream(g_next_stream, next_index, g_video_state.direction, g_window_width, g_window_height);
+    }
+
+    _print_cache_stats();
+    _print_memory_profile();
+    std::swap(g_current_stream, g_next_stream);
+
+    // Reverse playback starts from the last frame.
+    if (g_current_stream->cached)
+    {
+        uint64 frame_count = evx_cache_query_frame_count(&g_current_stream->cache);
+
+        g_current_stream->current_frame = (g_video_state.direction < 0) ? frame_count : -1;
+        evx_cache_seek(&g_current_stream->cache, g_current_stream->current_frame + g_video_state.direction, g_video_state.direction);
+    }
+
+    const EVX_MEDIA_FILE_HEADER &header = g_current_stream->reader.header;
+    evx_msg("Playing %s", g_options.playlist[g_current_stream->playlist_index].c_str());
+
+    if (g_options.memory_profile)
+    {
+        evx_memory_begin(&g_memory_profile);
+        g_memory_profile_started = true;
+    }
+
+    if (!g_frame_image_allocated)
+    {
+        evx_print_file_header(header);
+    }
+
+    _update_frame_image();
+
+    g_video_state.frame_rate = max((uint32) (1000 / header.frame_rate), 1u);
+    g_scheduler.frame_duration = 1.0 / header.frame_rate;
+    g_scheduler.anchored = false;
+
+    _start_preload();
+
+    return 0;
+}
+
+void _scale_frame(image *source, image *output)
+{
+    EVX_MEMORY_STAGE stage = evx_memory_set_stage(EVX_MEMORY_STAGE_SCALE);
+
+    evx_box_filter(source->query_data(), source->query_width(), source->query_height(), source->query_row_pitch(),
+                   output->query_data(), output->query_width(), output->query_height(), output->query_row_pitch());
+
+    evx_memory_set_stage(stage);
+}
+
+int32 _read_stream_frame(EVX_PLAYER_STREAM *stream, image *output, const EVX_MEDIA_FRAME_HEADER **frame_header)
+{
+    if (stream->cached)
+    {
+        int64 frame = stream->current_frame + g_video_state.direction;
+
+        if (frame < 0 || frame >= (int64) evx_cache_query_frame_count(&stream->cache))
+        {
+            return -1;
+        }
+
+        // A frame that cannot be decoded is passed over, like any other.
+        stream->current_frame = frame;
+        *frame_header = &stream->cached_header;
+
+        return evx_cache_fetch(&stream->cache, frame, g_video_state.direction, output, &stream->cached_header);
+    }
+
+    bool scaled = (stream->reader.header.frame_width != output->query_width() || 
+                   stream->reader.header.frame_height != output->query_height());
+
+    if (stream->next_frame < stream->frame_count)
+    {
+        if (scaled)
+        {
+            _scale_frame(&stream->frames[stream->next_frame], output);
+        }
+        else
+        {
+            memcpy(output->query_data(), stream->frames[stream->next_frame].query_data(), 
+                   output->query_row_pitch() * output->query_height());
+        }
+
+        *frame_header = &stream->frame_headers[stream->next_frame++];
+
+        return 0;
     }
 
     // Pull the next frame from the file and decode it.
-    fread(&frame_header, sizeof(frame_header), 1, g_source_file);
-    fread(g_temp_buffer, frame_header.frame_size, 1, g_source_file);
+    *frame_header = &stream->reader.frame_header;
+
+    evx_memory_set_stage(EVX_MEMORY_STAGE_INGEST);
+    int32 result = evx_reader_read_frame(&stream->reader);
+
+    if (0 == result)
+    {
+        evx_memory_set_stage(EVX_MEMORY_STAGE_DECODE);
+        result = evx_reader_decode_frame(&stream->reader, scaled ? &g_decode_image : output);
+    }
+
+    if (0 == result && scaled)
+    {
+        _scale_frame(&g_decode_image, output);
+    }
 
-    g_cairo_stream.empty();
-    g_cairo_stream.write_bytes(g_temp_buffer, frame_header.frame_size);
-    g_decoder->decode(&g_cairo_stream, output->query_data());
-    g_recent_bits_read += frame_header.header_size + frame_header.frame_size;
+    evx_memory_set_stage(EVX_MEMORY_STAGE_OTHER);
+
+    return result;
+}
+
+int32 _read_next_frame(image *output)
+{
+    const EVX_MEDIA_FRAME_HEADER *frame_header = NULL;
+    int32 result = _read_stream_frame(g_current_stream, output, &frame_header);
+
+    // Continue with the next stream as soon as this one runs out.
+    if (result < 0 && _is_stream_done(g_current_stream) && 0 == _advance_playlist())
+    {
+        result = _read_stream_frame(g_current_stream, output, &frame_header);
+    }
+
+    if (0 != result)
+    {
+        return result;
+    }
+
+    if (g_shared_output_enabled)
+    {
+        evx_shm_publish(&g_shared_output, output->query_data(), frame_header->frame_index);
+    }
+
+    _schedule_frame(*frame_header);
+
+    g_recent_bits_read += frame_header->header_size + frame_header->frame_size;
     g_video_state.frame_count++;
 
+    if (g_memory_profile_started)
+    {
+        evx_memory_frame(&g_memory_profile);
+    }
+
     _report_bit_rate();
+
+    return 0;
+}
+
+#if !defined(EVX_HEADLESS)
+
+#if defined(EVX_PLAYER_PBO)
+
+bool _is_pbo_supported()
+{
+    const char *version = (const char *) glGetString(GL_VERSION);
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    int32 major = 0, minor = 0;
+
+    if (version && 2 == sscanf(version, "%i.%i", &major, &minor) && (major > 2 || (2 == major && minor >= 1)))
+    {
+        return true;
+    }
+
+    return extensions && strstr(extensions, "GL_ARB_pixel_buffer_object");
 }
 
+// Each frame is written to the next buffer of the ring and the texture is
+// updated from it. The update only queues a transfer, and the buffer's 
+// storage is orphaned first so that a transfer still in flight never 
+// blocks the write.
+void _upload_frame_buffer(uint32 width, uint32 height, bool resized)
+{
+    uint32 source_pitch = g_frame_image.query_row_pitch();
+    uint32 dest_pitch = width * 4;
+    uint8 *source = g_frame_image.query_data();
+
+    if (!g_upload_buffers[0])
+    {
+        glGenBuffers(EVX_UPLOAD_BUFFER_COUNT, g_upload_buffers);
+    }
+
+    if (resized)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_upload_buffers[g_upload_index]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, dest_pitch * height, NULL, GL_STREAM_DRAW);
+
+    uint8 *dest = (uint8 *) glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+
+    if (dest)
+    {
+        // Rows keep the orientation of the decoded image.
+        for (uint32 r = 0; r < height; r++)
+        {
+            evx_expand_bgra(source + r * source_pitch, width, dest + r * dest_pitch);
+        }
+
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    g_upload_index = (g_upload_index + 1) % EVX_UPLOAD_BUFFER_COUNT;
+}
+
+#endif
+
 void _prepare_frame_texture()
 {
+    uint32 width = g_frame_image.query_width();
+    uint32 height = g_frame_image.query_height();
+    bool resized = (width != g_texture_width || height != g_texture_height);
+    double start_time = _get_system_time();
+
     if (EVX_MAX_UINT32 == g_frame_texture)
     {
         glGenTextures(1, &g_frame_texture);
@@ -203,20 +936,40 @@ void _prepare_frame_texture()
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_header.frame_width, g_header.frame_height, 0,
-                     GL_RGB, GL_UNSIGNED_BYTE, g_frame_image.query_data());
+    }
+
+    // Streams of the same dimensions share the texture storage.
+#if defined(EVX_PLAYER_PBO)
+    if (EVX_UPLOAD_MODE_PBO == g_options.upload_mode)
+    {
+        _upload_frame_buffer(width, height, resized);
     }
     else
+#endif
+    if (resized)
     {
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_header.frame_width, g_header.frame_height, 
-                        GL_RGB, GL_UNSIGNED_BYTE, g_frame_image.query_data());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, g_frame_image.query_data());
     }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, g_frame_image.query_data());
+    }
+
+    g_texture_width = width;
+    g_texture_height = height;
+    g_upload_seconds += _get_system_time() - start_time;
+    g_upload_count++;
 }
 
 void _render_progress_bar()
 {
-    float percentage = (float) ftell(g_source_file) / g_source_file_size;
-    percentage = min(percentage, 1.0);
+    float percentage = evx_reader_query_progress(&g_current_stream->reader);
+
+    if (g_current_stream->cached)
+    {
+        percentage = (float) (g_current_stream->current_frame + 1) / evx_cache_query_frame_count(&g_current_stream->cache);
+        percentage = max(min(percentage, 1.0f), 0.0f);
+    }
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -241,12 +994,6 @@ void _render_progress_bar()
 
 void render_scene()
 {
-    if (!g_video_state.state)
-    {
-        _read_next_frame(&g_frame_image);
-        _prepare_frame_texture();
-    }
-
     glClearColor(1, 0, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT);
     glLoadIdentity();
@@ -273,80 +1020,335 @@ void render_scene()
     glutSwapBuffers();
 }
 
-void _print_file_header(const EVX_MEDIA_FILE_HEADER &header)
+#endif
+
+// Decodes the next frame and presents it once it is due. If decoding has
+// fallen behind, frames whose display time has already passed are decoded 
+// but not uploaded or drawn. Returns without presenting while the frame is
+// not yet due, and is called again to wait for it.
+int32 _present_next_frame()
 {
-    evx_msg("Printing file header:");
-    evx_msg("size = %i", header.header_size);
-    evx_msg("version = %i", header.version);
-    evx_msg("width = %i", header.frame_width);
-    evx_msg("height = %i", header.frame_height);
-    evx_msg("frame count = %llu", header.frame_count);
-    evx_msg("rate = %f", header.frame_rate);
+    if (!g_scheduler.frame_waiting)
+    {
+        int32 result = 0;
+        uint32 drop_count = 0;
+
+        while (0 == (result = _read_next_frame(&g_frame_image)) && drop_count < EVX_MAX_CONSECUTIVE_DROPS &&
+               _get_system_time() >= g_scheduler.frame_deadline + g_scheduler.frame_length)
+        {
+            g_scheduler.dropped_count++;
+            g_scheduler.next_deadline = g_scheduler.frame_deadline + g_scheduler.frame_length;
+            drop_count++;
+        }
+
+        if (EVX_READER_PENDING == result)
+        {
+            // A followed file has not caught up yet, so check again shortly.
+            _sleep_until(_get_system_time() + min(g_scheduler.frame_duration, EVX_MAX_SCHEDULER_SLEEP));
+            return 0;
+        }
+
+        if (result < 0)
+        {
+            return result;
+        }
+
+        g_scheduler.frame_waiting = true;
+    }
+
+    double now = _get_system_time();
+
+    if (now < g_scheduler.frame_deadline)
+    {
+        _sleep_until(min(g_scheduler.frame_deadline, now + EVX_MAX_SCHEDULER_SLEEP));
+        now = _get_system_time();
+
+        if (now < g_scheduler.frame_deadline)
+        {
+            return 0;
+        }
+    }
+
+    g_scheduler.frame_waiting = false;
+
+    if (now - g_scheduler.frame_deadline > 0.25 * g_scheduler.frame_length)
+    {
+        g_scheduler.late_count++;
+    }
+
+    g_scheduler.next_deadline = g_scheduler.frame_deadline + g_scheduler.frame_length;
+
+    // Resynchronize rather than dropping indefinitely if decoding cannot 
+    // keep up with the requested rate at all.
+    if (now > g_scheduler.next_deadline)
+    {
+        g_scheduler.next_deadline = now;
+        g_scheduler.anchored = false;
+    }
+
+    g_scheduler.presented_count++;
+
+#if !defined(EVX_HEADLESS)
+    _prepare_frame_texture();
+    render_scene();
+#endif
+
+    return 0;
 }
 
-int32 _check_header_format(const EVX_MEDIA_FILE_HEADER &header)
+#if !defined(EVX_HEADLESS)
+
+void update_scene()
+{
+    if (_is_playback_done())
+    {
+        // Nothing is left to present, so stop consuming cpu entirely.
+        glutIdleFunc(NULL);
+        return;
+    }
+
+    _present_next_frame();
+}
+
+#endif
+
+// Reads playlist entries, one filename per line. Blank lines and lines 
+// beginning with '#' are ignored.
+int32 _read_playlist(const char *filename, EVX_PLAYER_OPTIONS *options)
 {
-    if (1 != header.version ||
-        0 == header.frame_rate ||
-        sizeof(header) != header.header_size)
+    char line[EVX_PLAYLIST_MAX_LINE];
+    FILE *file = fopen(filename, "r");
+
+    if (!file)
     {
+        evx_msg("Failed to open playlist %s", filename);
         return -1;
     }
 
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+
+        if (line[0] && '#' != line[0])
+        {
+            options->playlist.push_back(line);
+        }
+    }
+
+    fclose(file);
+
     return 0;
 }
 
+int32 _parse_options(int argc, char **argv, EVX_PLAYER_OPTIONS *options)
+{
+    int32 i = 1;
+
+    options->playlist.clear();
+    options->share_path = NULL;
+    options->follow = false;
+    options->loop = false;
+    options->memory_profile = false;
+    options->reverse = false;
+    options->cache_size = EVX_FRAME_CACHE_DEFAULT_SIZE;
+    options->upload_mode = EVX_UPLOAD_MODE_PBO;
+    options->proxy_mode = EVX_PROXY_MODE_QUALITY;
+
+    // Sources follow the options, and a source may itself be "-".
+    for (; i < argc && '-' == argv[i][0] && argv[i][1]; i++)
+    {
+        if (0 == strcmp(argv[i], "-follow"))
+        {
+            options->follow = true;
+        }
+        else if (0 == strcmp(argv[i], "-loop"))
+        {
+            options->loop = true;
+        }
+        else if (0 == strcmp(argv[i], "-memprofile"))
+        {
+            options->memory_profile = true;
+        }
+        else if (0 == strcmp(argv[i], "-reverse"))
+        {
+            options->reverse = true;
+        }
+        else if (0 == strcmp(argv[i], "-cache") && i + 1 < argc)
+        {
+            options->cache_size = (uint64) max(atoi(argv[++i]), 0) * EVX_MB;
+        }
+        else if (0 == strcmp(argv[i], "-upload") && i + 1 < argc)
+        {
+            i++;
+
+            if (0 == strcmp(argv[i], "direct"))
+            {
+                options->upload_mode = EVX_UPLOAD_MODE_DIRECT;
+            }
+            else if (0 == strcmp(argv[i], "pbo"))
+            {
+                options->upload_mode = EVX_UPLOAD_MODE_PBO;
+            }
+            else
+            {
+                return -1;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-proxy") && i + 1 < argc)
+        {
+            i++;
+
+            if (0 == strcmp(argv[i], "quality"))
+            {
+                options->proxy_mode = EVX_PROXY_MODE_QUALITY;
+            }
+            else if (0 == strcmp(argv[i], "speed"))
+            {
+                options->proxy_mode = EVX_PROXY_MODE_SPEED;
+            }
+            else if (0 == strcmp(argv[i], "off"))
+            {
+                options->proxy_mode = EVX_PROXY_MODE_OFF;
+            }
+            else
+            {
+                return -1;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-share") && i + 1 < argc)
+        {
+            options->share_path = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-playlist") && i + 1 < argc)
+        {
+            if (_read_playlist(argv[++i], options) < 0)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    for (; i < argc; i++)
+    {
+        options->playlist.push_back(argv[i]);
+    }
+
+    return options->playlist.empty() ? -1 : 0;
+}
+
+void _destroy_streams()
+{
+    _stop_preload();
+    _print_cache_stats();
+    _print_memory_profile();
+
+    for (uint32 i = 0; i < 2; i++)
+    {
+        _close_stream(&g_streams[i]);
+        _release_stream_frames(&g_streams[i]);
+    }
+
+    if (g_frame_image_allocated)
+    {
+        destroy_image(&g_frame_image);
+        g_frame_image_allocated = false;
+    }
+
+    if (g_decode_image_allocated)
+    {
+        destroy_image(&g_decode_image);
+        g_decode_image_allocated = false;
+    }
+}
+
+void _close_shared_output()
+{
+    if (g_shared_output_enabled)
+    {
+        evx_shm_close_publisher(&g_shared_output);
+        g_shared_output_enabled = false;
+    }
+}
+
 int main(int argc, char **argv)
 {
     evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
 
-    if (2 != argc)
+    if (_parse_options(argc, argv, &g_options) < 0)
     {
-        evx_msg("Required syntax: player <video filename>");
+        evx_msg("Required syntax: player [-follow] [-loop] [-reverse] [-cache <megabytes>] [-memprofile] [-upload <direct|pbo>] [-proxy <quality|speed|off>] [-share <socket path>] [-playlist <file>] [video filename|-]...");
         return 0;
     }
 
-    g_source_file = fopen(argv[1], "rb");
-
-    if (!g_source_file)
+    if (g_options.memory_profile)
     {
-        evx_msg("Error opening source file %s", argv[1]);
-        return 0;
+        evx_memory_enable();
     }
 
-    g_source_file_size = _get_file_size(g_source_file);
-    
-    fread(&g_header, sizeof(g_header), 1, g_source_file);
+    g_video_state.direction = g_options.reverse ? -1 : 1;
+
+    // The first stream goes through the same path as every later one.
+    g_preload_thread = std::thread(_preload_stream, g_next_stream, 0, g_video_state.direction, 0, 0);
 
-    if (_check_header_format(g_header) < 0)
+    if (0 != _advance_playlist())
     {
-        fclose(g_source_file);
+        _destroy_streams();
         return 0;
     }
 
-    _print_file_header(g_header);
+    // The player exits from its key handler, so stop preloading then.
+    atexit(_destroy_streams);
 
-    g_temp_buffer = new uint8[4 * EVX_MB];
-    g_cairo_stream.resize_capacity((4*EVX_MB) << 3);
-    g_video_state.frame_rate = 1000 / g_header.frame_rate;
+    if (g_options.share_path)
+    {
+        if (evx_shm_open_publisher(g_options.share_path, g_frame_image.query_width(), g_frame_image.query_height(),
+                                   g_frame_image.query_row_pitch(), g_current_stream->reader.header.frame_rate, 
+                                   EVX_SHM_DEFAULT_SLOT_COUNT, &g_shared_output) < 0)
+        {
+            return 0;
+        }
+
+        // The player exits from its key handler, so clean up the socket then.
+        g_shared_output_enabled = true;
+        atexit(_close_shared_output);
+    }
 
-    create_image(EVX_IMAGE_FORMAT_R8G8B8, g_header.frame_width, g_header.frame_height, &g_frame_image);
-    create_decoder(&g_decoder);
+#if defined(EVX_HEADLESS)
+    _reset_schedule();
 
+    while (!_is_playback_done() && _present_next_frame() >= 0);
+
+    evx_msg("Presented %llu frames, late frames: %llu, dropped frames: %llu", 
+        g_scheduler.presented_count, g_scheduler.late_count, g_scheduler.dropped_count);
+#else
     glutInit(&argc, argv);
-    glutInitWindowSize(g_header.frame_width, g_header.frame_height);
+    glutInitWindowSize(g_frame_image.query_width(), g_frame_image.query_height());
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
     glutCreateWindow("EVX Reference Player");
     glutDisplayFunc(&render_scene);
-    glutIdleFunc(&render_scene);
+    glutIdleFunc(&update_scene);
     glutKeyboardFunc(&handle_key_press);
-    glutMainLoop();
+    glutReshapeFunc(&handle_reshape);
+
+#if defined(EVX_PLAYER_PBO)
+    if (EVX_UPLOAD_MODE_PBO == g_options.upload_mode && !_is_pbo_supported())
+    {
+        evx_msg("Pixel buffer objects are unsupported, uploading directly");
+        g_options.upload_mode = EVX_UPLOAD_MODE_DIRECT;
+    }
+#else
+    g_options.upload_mode = EVX_UPLOAD_MODE_DIRECT;
+#endif
 
-    destroy_image(&g_frame_image);
-    destroy_decoder(g_decoder);
-    fclose(g_source_file);
+    evx_msg("Uploading frames %s", (EVX_UPLOAD_MODE_PBO == g_options.upload_mode) ? "through pixel buffers" : "directly");
 
-    delete [] g_temp_buffer;
+    _reset_schedule();
+    glutMainLoop();
+#endif
 
     return 0; 
-}
\ No newline at end of file
+}
@@ -0,0 +1,178 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_pool.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_pool.h"
+
+// Pulls tasks from the current batch until it is exhausted. Returns the 
+// number of tasks that were executed.
+uint32 _run_pool_tasks(EVX_THREAD_POOL *pool, EVX_POOL_TASK task, void *context, uint32 task_count)
+{
+    uint32 executed = 0;
+
+    while (true)
+    {
+        uint32 index = pool->next_task.fetch_add(1);
+
+        if (index >= task_count)
+        {
+            return executed;
+        }
+
+        task(context, index);
+        executed++;
+    }
+}
+
+void _pool_thread_main(EVX_THREAD_POOL *pool)
+{
+    uint64 generation = 0;
+    std::unique_lock<std::mutex> guard(pool->lock);
+
+    while (true)
+    {
+        while (!pool->closing && generation == pool->generation)
+        {
+            pool->signal.wait(guard);
+        }
+
+        if (pool->closing)
+        {
+            return;
+        }
+
+        generation = pool->generation;
+
+        // A batch whose tasks have all been claimed may already have been 
+        // returned from, and the next one may reset next_task while this 
+        // worker is outside the lock, so late arrivals skip it. Otherwise 
+        // the batch cannot complete until this worker leaves it, which 
+        // keeps the next batch from starting while its tasks are claimed.
+        if (pool->next_task >= pool->task_count)
+        {
+            continue;
+        }
+
+        pool->active_workers++;
+
+        EVX_POOL_TASK task = pool->task;
+        void *context = pool->context;
+        uint32 task_count = pool->task_count;
+
+        guard.unlock();
+        uint32 executed = _run_pool_tasks(pool, task, context, task_count);
+        guard.lock();
+
+        pool->completed_count += executed;
+        pool->active_workers--;
+
+        if (pool->completed_count == pool->task_count && !pool->active_workers)
+        {
+            pool->signal.notify_all();
+        }
+    }
+}
+
+int32 evx_pool_open(uint32 thread_count, EVX_THREAD_POOL *pool)
+{
+    if (0 == thread_count)
+    {
+        thread_count = max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    pool->task = NULL;
+    pool->context = NULL;
+    pool->task_count = 0;
+    pool->completed_count = 0;
+    pool->active_workers = 0;
+    pool->generation = 0;
+    pool->next_task = 0;
+    pool->closing = false;
+
+    // The calling thread participates in every batch, so it counts as one
+    // of the workers.
+    for (uint32 i = 1; i < thread_count; i++)
+    {
+        pool->threads.push_back(std::thread(_pool_thread_main, pool));
+    }
+
+    return 0;
+}
+
+void evx_pool_close(EVX_THREAD_POOL *pool)
+{
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->closing = true;
+        pool->signal.notify_all();
+    }
+
+    for (uint32 i = 0; i < pool->threads.size(); i++)
+    {
+        pool->threads[i].join();
+    }
+
+    pool->threads.clear();
+}
+
+void evx_pool_run(EVX_THREAD_POOL *pool, EVX_POOL_TASK task, void *context, uint32 task_count)
+{
+    if (!task_count)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->task = task;
+        pool->context = context;
+        pool->task_count = task_count;
+        pool->completed_count = 0;
+        pool->next_task = 0;
+        pool->generation++;
+        pool->signal.notify_all();
+    }
+
+    uint32 executed = _run_pool_tasks(pool, task, context, task_count);
+
+    std::unique_lock<std::mutex> guard(pool->lock);
+    pool->completed_count += executed;
+
+    while (pool->completed_count < pool->task_count || pool->active_workers)
+    {
+        pool->signal.wait(guard);
+    }
+}
+
+uint32 evx_pool_query_thread_count(EVX_THREAD_POOL *pool)
+{
+    return pool->threads.size() + 1;
+}
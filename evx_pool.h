@@ -0,0 +1,77 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_pool.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_POOL_H__
+#define __EVX_POOL_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run batches of independent tasks. 
+// Each batch calls task(context, index) once for every index in 
+// [0, task_count), and the caller blocks until the batch has completed.
+
+typedef void (*EVX_POOL_TASK)(void *context, uint32 index);
+
+typedef struct EVX_THREAD_POOL
+{
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable signal;
+
+    EVX_POOL_TASK task;
+    void *context;
+    uint32 task_count;
+    uint32 completed_count;
+    uint32 active_workers;
+    uint64 generation;
+    std::atomic<uint32> next_task;
+    bool closing;
+
+} EVX_THREAD_POOL;
+
+// Starts thread_count workers, or one per hardware thread if zero.
+int32 evx_pool_open(uint32 thread_count, EVX_THREAD_POOL *pool);
+void evx_pool_close(EVX_THREAD_POOL *pool);
+
+// Runs a batch and waits for it. The calling thread also executes tasks.
+void evx_pool_run(EVX_THREAD_POOL *pool, EVX_POOL_TASK task, void *context, uint32 task_count);
+
+uint32 evx_pool_query_thread_count(EVX_THREAD_POOL *pool);
+
+#endif // __EVX_POOL_H__
@@ -0,0 +1,524 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_quality.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_quality.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EVX_QUALITY_SSE2
+#endif
+
+// Builds only assume SSE2, so the AVX2 kernels are compiled for their own
+// target and chosen at run time on processors that support them.
+#if defined(EVX_QUALITY_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define EVX_QUALITY_AVX2
+#define EVX_QUALITY_AVX2_TARGET     __attribute__((target("avx2")))
+#endif
+
+#define EVX_SSIM_C1         (0.01 * 255 * 0.01 * 255)
+#define EVX_SSIM_C2         (0.03 * 255 * 0.03 * 255)
+
+// Each 4x4 luma block is reduced to the sums that SSIM needs: the pixels of
+// both frames, their squares (combined), and their products.
+typedef struct EVX_SSIM_SUMS
+{
+    uint32 source;
+    uint32 dest;
+    uint32 squares;
+    uint32 products;
+
+} EVX_SSIM_SUMS;
+
+#if defined(EVX_QUALITY_AVX2)
+
+bool _is_avx2_supported()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+const bool g_quality_avx2 = _is_avx2_supported();
+
+// Returns the squared error of the leading multiple of 32 bytes of a row,
+// and sets processed to the number of bytes it covered.
+EVX_QUALITY_AVX2_TARGET uint64 _row_squared_error_avx2(const uint8 *a, const uint8 *b, uint32 count, uint32 *processed)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i sum = _mm256_setzero_si256();
+    uint64 result = 0;
+    uint32 i = 0;
+
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+        __m256i low = _mm256_sub_epi16(_mm256_unpacklo_epi8(x, zero), _mm256_unpacklo_epi8(y, zero));
+        __m256i high = _mm256_sub_epi16(_mm256_unpackhi_epi8(x, zero), _mm256_unpackhi_epi8(y, zero));
+
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(low, low));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(high, high));
+    }
+
+    uint32 lanes[8];
+    _mm256_storeu_si256((__m256i *) lanes, sum);
+
+    for (uint32 j = 0; j < 8; j++)
+    {
+        result += lanes[j];
+    }
+
+    *processed = i;
+
+    return result;
+}
+
+#endif
+
+// Returns the sum of squared differences between two rows of bytes. Lane 
+// sums are 32 bit, which holds for rows of well over 100k bytes.
+uint64 _row_squared_error(const uint8 *a, const uint8 *b, uint32 count)
+{
+    uint64 result = 0;
+    uint32 i = 0;
+
+#if defined(EVX_QUALITY_AVX2)
+    if (g_quality_avx2)
+    {
+        result = _row_squared_error_avx2(a, b, count, &i);
+    }
+#endif
+
+#if defined(EVX_QUALITY_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+        __m128i low = _mm_sub_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+        __m128i high = _mm_sub_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(low, low));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(high, high));
+    }
+
+    uint32 lanes[4];
+    _mm_storeu_si128((__m128i *) lanes, sum);
+    result += (uint64) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for (; i < count; i++)
+    {
+        int32 difference = a[i] - b[i];
+        result += difference * difference;
+    }
+
+    return result;
+}
+
+// Full range BT.601 luma, in 8 bit fixed point.
+void _convert_to_luma(const uint8 *frame, uint32 pixel_count, uint8 *luma)
+{
+    for (uint32 i = 0; i < pixel_count; i++, frame += 3)
+    {
+        luma[i] = (77 * frame[0] + 150 * frame[1] + 29 * frame[2] + 128) >> 8;
+    }
+}
+
+void _sum_block(const uint8 *a, const uint8 *b, uint32 pitch, uint32 width, uint32 height, EVX_SSIM_SUMS *sums)
+{
+    memset(sums, 0, sizeof(EVX_SSIM_SUMS));
+
+    for (uint32 y = 0; y < height; y++)
+    {
+        for (uint32 x = 0; x < width; x++)
+        {
+            uint32 p = a[y * pitch + x];
+            uint32 q = b[y * pitch + x];
+
+            sums->source += p;
+            sums->dest += q;
+            sums->squares += p * p + q * q;
+            sums->products += p * q;
+        }
+    }
+}
+
+#if defined(EVX_QUALITY_SSE2)
+
+// Stores the sums of the blocks held in a register of 32 bit lanes, where 
+// each block occupies two adjacent lanes.
+void _store_block_sums(const uint32 *source, const uint32 *dest, const uint32 *squares, const uint32 *products,
+                       uint32 block_count, EVX_SSIM_SUMS *sums)
+{
+    for (uint32 i = 0; i < block_count; i++)
+    {
+        sums[i].source = source[2 * i] + source[2 * i + 1];
+        sums[i].dest = dest[2 * i] + dest[2 * i + 1];
+        sums[i].squares = squares[2 * i] + squares[2 * i + 1];
+        sums[i].products = products[2 * i] + products[2 * i + 1];
+    }
+}
+
+#endif
+
+#if defined(EVX_QUALITY_AVX2)
+
+// Reduces blocks four at a time, and returns how many were reduced.
+EVX_QUALITY_AVX2_TARGET uint32 _sum_block_row_avx2(const uint8 *a, const uint8 *b, uint32 pitch, uint32 block_count, EVX_SSIM_SUMS *sums)
+{
+    __m256i ones = _mm256_set1_epi16(1);
+    uint32 i = 0;
+
+    for (; i + 4 <= block_count; i += 4)
+    {
+        __m256i source = _mm256_setzero_si256();
+        __m256i dest = _mm256_setzero_si256();
+        __m256i squares = _mm256_setzero_si256();
+        __m256i products = _mm256_setzero_si256();
+        alignas(32) uint32 lanes[4][8];
+
+        for (uint32 y = 0; y < 4; y++)
+        {
+            __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (a + y * pitch + 4 * i)));
+            __m256i z = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (b + y * pitch + 4 * i)));
+
+            source = _mm256_add_epi16(source, x);
+            dest = _mm256_add_epi16(dest, z);
+            squares = _mm256_add_epi32(squares, _mm256_add_epi32(_mm256_madd_epi16(x, x), _mm256_madd_epi16(z, z)));
+            products = _mm256_add_epi32(products, _mm256_madd_epi16(x, z));
+        }
+
+        _mm256_store_si256((__m256i *) lanes[0], _mm256_madd_epi16(source, ones));
+        _mm256_store_si256((__m256i *) lanes[1], _mm256_madd_epi16(dest, ones));
+        _mm256_store_si256((__m256i *) lanes[2], squares);
+        _mm256_store_si256((__m256i *) lanes[3], products);
+        _store_block_sums(lanes[0], lanes[1], lanes[2], lanes[3], 4, sums + i);
+    }
+
+    return i;
+}
+
+#endif
+
+// Reduces a row of 4x4 blocks. The vector paths reduce several horizontally
+// adjacent blocks at once: madd sums neighbouring pairs of 16 bit pixels, 
+// which leaves each block in two adjacent 32 bit lanes.
+void _sum_block_row(const uint8 *a, const uint8 *b, uint32 pitch, uint32 block_count, EVX_SSIM_SUMS *sums)
+{
+    uint32 i = 0;
+
+#if defined(EVX_QUALITY_AVX2)
+    if (g_quality_avx2)
+    {
+        i = _sum_block_row_avx2(a, b, pitch, block_count, sums);
+    }
+#endif
+
+#if defined(EVX_QUALITY_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i ones_128 = _mm_set1_epi16(1);
+
+    for (; i + 2 <= block_count; i += 2)
+    {
+        __m128i source = _mm_setzero_si128();
+        __m128i dest = _mm_setzero_si128();
+        __m128i squares = _mm_setzero_si128();
+        __m128i products = _mm_setzero_si128();
+        uint32 lanes[4][4];
+
+        for (uint32 y = 0; y < 4; y++)
+        {
+            __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (a + y * pitch + 4 * i)), zero);
+            __m128i z = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (b + y * pitch + 4 * i)), zero);
+
+            source = _mm_add_epi16(source, x);
+            dest = _mm_add_epi16(dest, z);
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(x, x), _mm_madd_epi16(z, z)));
+            products = _mm_add_epi32(products, _mm_madd_epi16(x, z));
+        }
+
+        _mm_storeu_si128((__m128i *) lanes[0], _mm_madd_epi16(source, ones_128));
+        _mm_storeu_si128((__m128i *) lanes[1], _mm_madd_epi16(dest, ones_128));
+        _mm_storeu_si128((__m128i *) lanes[2], squares);
+        _mm_storeu_si128((__m128i *) lanes[3], products);
+        _store_block_sums(lanes[0], lanes[1], lanes[2], lanes[3], 2, sums + i);
+    }
+#endif
+
+    for (; i < block_count; i++)
+    {
+        _sum_block(a + 4 * i, b + 4 * i, pitch, 4, 4, sums + i);
+    }
+}
+
+double _window_ssim(double source, double dest, double squares, double products, double pixel_count)
+{
+    double n = pixel_count;
+    double c1 = EVX_SSIM_C1 * n * n;
+    double c2 = EVX_SSIM_C2 * n * n;
+    double variances = n * squares - source * source - dest * dest;
+    double covariance = n * products - source * dest;
+
+    return ((2.0 * source * dest + c1) * (2.0 * covariance + c2)) /
+           ((source * source + dest * dest + c1) * (variances + c2));
+}
+
+// Averages SSIM over 8x8 windows placed every four pixels. Each window is 
+// the sum of four neighbouring 4x4 blocks, so every pixel is only read once.
+double _measure_ssim(const uint8 *source_luma, const uint8 *dest_luma, uint32 width, uint32 height, uint32 *block_sums)
+{
+    uint32 blocks_wide = width / 4;
+    uint32 blocks_high = height / 4;
+    EVX_SSIM_SUMS *sums = (EVX_SSIM_SUMS *) block_sums;
+
+    // Frames too small for a single window are scored as one window.
+    if (blocks_wide < 2 || blocks_high < 2)
+    {
+        EVX_SSIM_SUMS frame;
+        _sum_block(source_luma, dest_luma, width, width, height, &frame);
+
+        return width && height ? _window_ssim(frame.source, frame.dest, frame.squares, frame.products, width * height) : 1.0;
+    }
+
+    for (uint32 y = 0; y < blocks_high; y++)
+    {
+        _sum_block_row(source_luma + 4 * y * width, dest_luma + 4 * y * width, width, blocks_wide, sums + y * blocks_wide);
+    }
+
+    double total = 0.0;
+
+    for (uint32 y = 0; y + 1 < blocks_high; y++)
+    {
+        const EVX_SSIM_SUMS *top = sums + y * blocks_wide;
+        const EVX_SSIM_SUMS *bottom = top + blocks_wide;
+
+        for (uint32 x = 0; x + 1 < blocks_wide; x++)
+        {
+            total += _window_ssim(top[x].source + top[x + 1].source + bottom[x].source + bottom[x + 1].source,
+                                  top[x].dest + top[x + 1].dest + bottom[x].dest + bottom[x + 1].dest,
+                                  top[x].squares + top[x + 1].squares + bottom[x].squares + bottom[x + 1].squares,
+                                  top[x].products + top[x + 1].products + bottom[x].products + bottom[x + 1].products,
+                                  64.0);
+        }
+    }
+
+    return total / ((blocks_wide - 1) * (blocks_high - 1));
+}
+
+void _measure_quality(const uint8 *source, const uint8 *dest, uint32 width, uint32 height, 
+                      uint8 *source_luma, uint8 *dest_luma, uint32 *block_sums, EVX_QUALITY_SCORE *score)
+{
+    uint64 squared_error = 0;
+    uint32 row_size = width * 3;
+
+    for (uint32 y = 0; y < height; y++)
+    {
+        squared_error += _row_squared_error(source + y * row_size, dest + y * row_size, row_size);
+    }
+
+    score->mse = (width && height) ? (double) squared_error / ((uint64) row_size * height) : 0.0;
+    score->psnr = (score->mse > 0.0) ? min(10.0 * log10(255.0 * 255.0 / score->mse), EVX_QUALITY_MAX_PSNR) : EVX_QUALITY_MAX_PSNR;
+
+    _convert_to_luma(source, width * height, source_luma);
+    _convert_to_luma(dest, width * height, dest_luma);
+
+    score->ssim = _measure_ssim(source_luma, dest_luma, width, height, block_sums);
+}
+
+void evx_measure_quality(const uint8 *source, const uint8 *dest, uint32 width, uint32 height, EVX_QUALITY_SCORE *score)
+{
+    uint8 *luma = new uint8[2 * width * height];
+    uint32 *block_sums = new uint32[width * height / 4 + 1];
+
+    _measure_quality(source, dest, width, height, luma, luma + width * height, block_sums, score);
+
+    delete [] luma;
+    delete [] block_sums;
+}
+
+void _add_score(EVX_QUALITY_SUMMARY *summary, const EVX_QUALITY_SCORE &score, uint64 frame_index)
+{
+    if (0 == summary->frame_count || score.psnr < summary->min_psnr)
+    {
+        summary->min_psnr = score.psnr;
+    }
+
+    if (0 == summary->frame_count || score.ssim < summary->min_ssim)
+    {
+        summary->min_ssim = score.ssim;
+        summary->min_ssim_frame = frame_index;
+    }
+
+    summary->frame_count++;
+    summary->mse_sum += score.mse;
+    summary->psnr_sum += score.psnr;
+    summary->ssim_sum += score.ssim;
+}
+
+void _quality_thread_main(EVX_QUALITY_ENGINE *engine)
+{
+    while (true)
+    {
+        EVX_QUALITY_SLOT *slot = NULL;
+        EVX_QUALITY_SCORE score;
+
+        {
+            std::unique_lock<std::mutex> guard(engine->lock);
+            engine->signal.wait(guard, [engine] { return engine->closing || engine->completed_count < engine->submitted_count; });
+
+            if (engine->completed_count == engine->submitted_count)
+            {
+                return;
+            }
+
+            slot = &engine->slots[engine->completed_count % EVX_QUALITY_SLOT_COUNT];
+        }
+
+        _measure_quality(slot->source, slot->dest, engine->width, engine->height, 
+                         engine->source_luma, engine->dest_luma, engine->block_sums, &score);
+
+        if (engine->score_file)
+        {
+            fprintf(engine->score_file, "%llu,%.4f,%.6f\n", slot->frame_index, score.psnr, score.ssim);
+        }
+
+        std::lock_guard<std::mutex> guard(engine->lock);
+        _add_score(&engine->summary, score, slot->frame_index);
+        engine->completed_count++;
+        engine->signal.notify_all();
+    }
+}
+
+int32 evx_quality_open(uint32 width, uint32 height, FILE *score_file, EVX_QUALITY_ENGINE *engine)
+{
+    uint32 frame_size = width * height * 3;
+
+    engine->width = width;
+    engine->height = height;
+    engine->score_file = score_file;
+    engine->submitted_count = 0;
+    engine->completed_count = 0;
+    engine->closing = false;
+
+    memset(&engine->summary, 0, sizeof(EVX_QUALITY_SUMMARY));
+
+    for (uint32 i = 0; i < EVX_QUALITY_SLOT_COUNT; i++)
+    {
+        engine->slots[i].source = new uint8[frame_size];
+        engine->slots[i].dest = new uint8[frame_size];
+        engine->slots[i].frame_index = 0;
+    }
+
+    engine->source_luma = new uint8[width * height];
+    engine->dest_luma = new uint8[width * height];
+    engine->block_sums = new uint32[width * height / 4 + 1];
+
+    if (score_file)
+    {
+        fprintf(score_file, "frame,psnr,ssim\n");
+    }
+
+    engine->thread = std::thread(_quality_thread_main, engine);
+
+    return 0;
+}
+
+void evx_quality_close(EVX_QUALITY_ENGINE *engine)
+{
+    {
+        std::lock_guard<std::mutex> guard(engine->lock);
+        engine->closing = true;
+        engine->signal.notify_all();
+    }
+
+    engine->thread.join();
+
+    for (uint32 i = 0; i < EVX_QUALITY_SLOT_COUNT; i++)
+    {
+        delete [] engine->slots[i].source;
+        delete [] engine->slots[i].dest;
+    }
+
+    delete [] engine->source_luma;
+    delete [] engine->dest_luma;
+    delete [] engine->block_sums;
+}
+
+EVX_QUALITY_SLOT *evx_quality_acquire(EVX_QUALITY_ENGINE *engine)
+{
+    std::unique_lock<std::mutex> guard(engine->lock);
+    engine->signal.wait(guard, [engine] { return engine->submitted_count - engine->completed_count < EVX_QUALITY_SLOT_COUNT; });
+
+    return &engine->slots[engine->submitted_count % EVX_QUALITY_SLOT_COUNT];
+}
+
+void evx_quality_submit(EVX_QUALITY_ENGINE *engine, uint64 frame_index)
+{
+    std::lock_guard<std::mutex> guard(engine->lock);
+    engine->slots[engine->submitted_count % EVX_QUALITY_SLOT_COUNT].frame_index = frame_index;
+    engine->submitted_count++;
+    engine->signal.notify_all();
+}
+
+void evx_quality_copy(uint8 *slot_buffer, const uint8 *frame, uint32 width, uint32 height, uint32 pitch)
+{
+    for (uint32 y = 0; y < height; y++)
+    {
+        memcpy(slot_buffer + y * width * 3, frame + y * pitch, width * 3);
+    }
+}
+
+void evx_quality_query(EVX_QUALITY_ENGINE *engine, EVX_QUALITY_SUMMARY *summary)
+{
+    std::lock_guard<std::mutex> guard(engine->lock);
+    *summary = engine->summary;
+}
+
+void evx_print_quality_summary(const EVX_QUALITY_SUMMARY &summary)
+{
+    if (!summary.frame_count)
+    {
+        return;
+    }
+
+    double mse = summary.mse_sum / summary.frame_count;
+    double psnr = (mse > 0.0) ? min(10.0 * log10(255.0 * 255.0 / mse), EVX_QUALITY_MAX_PSNR) : EVX_QUALITY_MAX_PSNR;
+
+    evx_msg("Quality over %llu frames:", summary.frame_count);
+    evx_msg("psnr = %.3f dB (mean of frames %.3f dB, worst %.3f dB)", psnr, summary.psnr_sum / summary.frame_count, summary.min_psnr);
+    evx_msg("ssim = %.5f (worst %.5f at frame %llu)", summary.ssim_sum / summary.frame_count, summary.min_ssim, summary.min_ssim_frame);
+}
@@ -0,0 +1,126 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_quality.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_QUALITY_H__
+#define __EVX_QUALITY_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Objective quality of encoded frames, measured against their source. PSNR
+// is taken over all three channels, and SSIM over the luma of overlapping 
+// 8x8 windows spaced four pixels apart. Both compare packed 24 bit frames
+// of identical dimensions.
+//
+// The quality engine measures frames on its own thread, so that scoring 
+// overlaps with encoding. Callers acquire a slot, fill it with the source
+// and decoded frames, and submit it. Acquiring only blocks when all slots
+// are waiting to be scored.
+
+#define EVX_QUALITY_SLOT_COUNT          (4)
+#define EVX_QUALITY_MAX_PSNR            (100.0)    // reported for identical frames.
+
+typedef struct EVX_QUALITY_SCORE
+{
+    double mse;
+    double psnr;
+    double ssim;
+
+} EVX_QUALITY_SCORE;
+
+typedef struct EVX_QUALITY_SUMMARY
+{
+    uint64 frame_count;
+    double mse_sum;
+    double psnr_sum;
+    double ssim_sum;
+    double min_psnr;
+    double min_ssim;
+    uint64 min_ssim_frame;      // frame index of the worst ssim.
+
+} EVX_QUALITY_SUMMARY;
+
+typedef struct EVX_QUALITY_SLOT
+{
+    uint8 *source;              // tightly packed, width * 3 bytes per row.
+    uint8 *dest;
+    uint64 frame_index;
+
+} EVX_QUALITY_SLOT;
+
+typedef struct EVX_QUALITY_ENGINE
+{
+    uint32 width;
+    uint32 height;
+    FILE *score_file;           // receives a line per frame, may be NULL.
+
+    EVX_QUALITY_SLOT slots[EVX_QUALITY_SLOT_COUNT];
+    uint64 submitted_count;
+    uint64 completed_count;
+    bool closing;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable signal;
+
+    uint8 *source_luma;         // scratch for the scoring thread.
+    uint8 *dest_luma;
+    uint32 *block_sums;
+
+    EVX_QUALITY_SUMMARY summary;
+
+} EVX_QUALITY_ENGINE;
+
+int32 evx_quality_open(uint32 width, uint32 height, FILE *score_file, EVX_QUALITY_ENGINE *engine);
+
+// Waits for every submitted frame to be scored, and stops the engine.
+void evx_quality_close(EVX_QUALITY_ENGINE *engine);
+
+EVX_QUALITY_SLOT *evx_quality_acquire(EVX_QUALITY_ENGINE *engine);
+void evx_quality_submit(EVX_QUALITY_ENGINE *engine, uint64 frame_index);
+
+// Copies a packed frame with the given row pitch into a slot buffer.
+void evx_quality_copy(uint8 *slot_buffer, const uint8 *frame, uint32 width, uint32 height, uint32 pitch);
+
+// Returns the totals of the frames scored so far.
+void evx_quality_query(EVX_QUALITY_ENGINE *engine, EVX_QUALITY_SUMMARY *summary);
+
+void evx_print_quality_summary(const EVX_QUALITY_SUMMARY &summary);
+
+// Scores a single pair of tightly packed frames on the calling thread.
+void evx_measure_quality(const uint8 *source, const uint8 *dest, uint32 width, uint32 height, EVX_QUALITY_SCORE *score);
+
+#endif // __EVX_QUALITY_H__
@@ -0,0 +1,209 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_rawvideo.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+
+#if defined(EVX_PLATFORM_WINDOWS)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+extern "C" {
+
+FILE *g_rawvideo_file = NULL;
+unsigned char *g_rawvideo_buffer = NULL;
+int g_rawvideo_width = 0;
+int g_rawvideo_height = 0;
+long long g_rawvideo_frame_count = 0;
+long long g_rawvideo_next_frame = 0;
+float g_rawvideo_frame_rate = 0.0f;
+
+int rawvideo_deinitialize()
+{
+    if (g_rawvideo_file && stdin != g_rawvideo_file) fclose(g_rawvideo_file);
+    if (g_rawvideo_buffer) free(g_rawvideo_buffer);
+
+    g_rawvideo_file = NULL;
+    g_rawvideo_buffer = NULL;
+    g_rawvideo_frame_count = 0;
+    g_rawvideo_next_frame = 0;
+
+    return 0;
+}
+
+long long rawvideo_get_frame_count()
+{
+    return g_rawvideo_frame_count;
+}
+
+float rawvideo_get_frame_rate()
+{
+    return g_rawvideo_frame_rate;
+}
+
+int rawvideo_get_frame_time(long long *timestamp, int *duration)
+{
+    *timestamp = (long long) ((g_rawvideo_next_frame - 1) * 1000000.0 / g_rawvideo_frame_rate + 0.5);
+    *duration = (int) (1000000.0 / g_rawvideo_frame_rate + 0.5);
+
+    return 0;
+}
+
+int rawvideo_play_file(const char *filename, int width, int height, float frame_rate)
+{
+    int frame_size = width * height * 3;
+
+    if (width <= 0 || height <= 0 || frame_rate <= 0.0f)
+    {
+        printf("[RAW] Invalid frame dimensions or rate for %s\n", filename);
+        return -1;
+    }
+
+    if (0 == strcmp(filename, "-"))
+    {
+#if defined(EVX_PLATFORM_WINDOWS)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        g_rawvideo_file = stdin;
+    }
+    else
+    {
+        g_rawvideo_file = fopen(filename, "rb");
+    }
+
+    if (!g_rawvideo_file)
+    {
+        printf("[RAW] Failed to open file %s\n", filename);
+        return -1;
+    }
+
+    // The frame count is only known when reading from a regular file.
+    if (stdin != g_rawvideo_file)
+    {
+        fseek(g_rawvideo_file, 0, SEEK_END);
+        g_rawvideo_frame_count = ftell(g_rawvideo_file) / frame_size;
+        fseek(g_rawvideo_file, 0, SEEK_SET);
+    }
+
+    g_rawvideo_buffer = (unsigned char *) malloc(frame_size);
+
+    if (!g_rawvideo_buffer)
+    {
+        printf("[RAW] Error allocating space for raw image buffer\n");
+        rawvideo_deinitialize();
+        return -1;
+    }
+
+    g_rawvideo_width = width;
+    g_rawvideo_height = height;
+    g_rawvideo_frame_rate = frame_rate;
+
+    return 0;
+}
+
+int rawvideo_copy_current_frame(unsigned char *dest, int row_pitch)
+{
+    int r = 0;
+    for (r = 0; r < g_rawvideo_height; r++)
+        memcpy(dest + (row_pitch * (g_rawvideo_height - r - 1)), 
+               g_rawvideo_buffer + r * g_rawvideo_width * 3, 
+               g_rawvideo_width * 3);
+
+    return 0;
+}
+
+int rawvideo_refresh(int *encoded_frame_size)
+{
+    int frame_size = g_rawvideo_width * g_rawvideo_height * 3;
+
+    if (!g_rawvideo_file || !g_rawvideo_buffer)
+    {
+        return -1;
+    }
+
+    // fread blocks until a whole frame has arrived or the pipe is closed.
+    if (1 != fread(g_rawvideo_buffer, frame_size, 1, g_rawvideo_file))
+    {
+        return -1;
+    }
+
+    if (encoded_frame_size)
+    {
+        *encoded_frame_size = frame_size;
+    }
+
+    g_rawvideo_next_frame++;
+
+    return 0;
+}
+
+int rawvideo_seek_frame(long long frame)
+{
+    long long frame_size = g_rawvideo_width * g_rawvideo_height * 3;
+
+    if (!g_rawvideo_file || !g_rawvideo_buffer)
+    {
+        return -1;
+    }
+
+    if (stdin != g_rawvideo_file)
+    {
+        if (0 != fseek(g_rawvideo_file, frame * frame_size, SEEK_SET))
+        {
+            return -1;
+        }
+
+        g_rawvideo_next_frame = frame;
+        return 0;
+    }
+
+    // Pipes can only be skipped forward, by reading the frames in between.
+    if (frame < g_rawvideo_next_frame)
+    {
+        printf("[RAW] Cannot seek backwards in a pipe\n");
+        return -1;
+    }
+
+    while (g_rawvideo_next_frame < frame)
+    {
+        if (1 != fread(g_rawvideo_buffer, frame_size, 1, g_rawvideo_file))
+        {
+            return -1;
+        }
+
+        g_rawvideo_next_frame++;
+    }
+
+    return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,412 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_reader.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_reader.h"
+
+#if defined(EVX_PLATFORM_WINDOWS)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#define EVX_RECORD_INCOMPLETE       (-1)
+#define EVX_RECORD_INVALID          (-2)
+
+void evx_print_file_header(const EVX_MEDIA_FILE_HEADER &header)
+{
+    evx_msg("Printing file header:");
+    evx_msg("size = %i", header.header_size);
+    evx_msg("version = %i", header.version);
+    evx_msg("width = %i", header.frame_width);
+    evx_msg("height = %i", header.frame_height);
+    evx_msg("frame count = %llu", header.frame_count);
+    evx_msg("rate = %f", header.frame_rate);
+}
+
+int32 evx_check_header_format(const EVX_MEDIA_FILE_HEADER &header)
+{
+    if (header.version < EVX_MEDIA_VERSION_LEGACY ||
+        header.version > EVX_MEDIA_VERSION ||
+        0 == header.frame_rate ||
+        sizeof(header) != header.header_size)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+uint64 _get_file_size(FILE *f)
+{
+    uint64 file_size = 0;
+    uint64 seek_pos = ftell(f);
+
+    fseek(f, 0, SEEK_END);
+    file_size = ftell(f);
+    fseek(f, seek_pos, SEEK_SET);
+
+    return file_size;
+}
+
+bool _read_bytes(EVX_READER *reader, void *dest, uint32 size)
+{
+    uint32 count = fread(dest, 1, size, reader->file);
+    reader->offset += count;
+
+    return (count == size);
+}
+
+bool _skip_bytes(EVX_READER *reader, uint64 size)
+{
+    // Skip by reading so that non-seekable sources are handled as well.
+    while (size)
+    {
+        uint32 count = (uint32) min(size, (uint64) EVX_READER_MAX_FRAME_SIZE);
+
+        if (!_read_bytes(reader, reader->temp_buffer, count))
+        {
+            return false;
+        }
+
+        size -= count;
+    }
+
+    return true;
+}
+
+int32 _read_record_body(EVX_READER *reader, const EVX_MEDIA_RECORD_HEADER &record, void *dest, uint32 dest_size)
+{
+    uint32 known_size = min(record.header_size, dest_size);
+
+    // Fields introduced after the record was written are left zeroed, and 
+    // fields we don't know about are skipped.
+    memset(dest, 0, dest_size);
+    memcpy(dest, &record, sizeof(record));
+
+    if (!_read_bytes(reader, (uint8 *) dest + sizeof(record), known_size - sizeof(record)) ||
+        !_skip_bytes(reader, record.header_size - known_size))
+    {
+        return EVX_RECORD_INCOMPLETE;
+    }
+
+    return 0;
+}
+
+int32 _read_frame_record(EVX_READER *reader, const EVX_MEDIA_RECORD_HEADER &record)
+{
+    EVX_MEDIA_FRAME_HEADER *frame_header = &reader->frame_header;
+    int32 result = _read_record_body(reader, record, frame_header, sizeof(EVX_MEDIA_FRAME_HEADER));
+
+    if (result < 0)
+    {
+        return result;
+    }
+
+    if (frame_header->frame_size > EVX_READER_MAX_FRAME_SIZE)
+    {
+        evx_msg("Frame %llu exceeds the maximum supported frame size", frame_header->frame_index);
+        return EVX_RECORD_INVALID;
+    }
+
+    if (!_read_bytes(reader, reader->temp_buffer, frame_header->frame_size))
+    {
+        return EVX_RECORD_INCOMPLETE;
+    }
+
+    reader->stream.empty();
+    reader->stream.write_bytes(reader->temp_buffer, frame_header->frame_size);
+    reader->frames_read++;
+
+    return 0;
+}
+
+int32 _read_index_record(EVX_READER *reader, const EVX_MEDIA_RECORD_HEADER &record)
+{
+    EVX_MEDIA_INDEX_HEADER index_header;
+    int32 result = _read_record_body(reader, record, &index_header, sizeof(index_header));
+
+    if (result < 0)
+    {
+        return result;
+    }
+
+    if (!_skip_bytes(reader, (uint64) index_header.entry_count * sizeof(EVX_MEDIA_INDEX_ENTRY)))
+    {
+        return EVX_RECORD_INCOMPLETE;
+    }
+
+    reader->stream_frame_count = index_header.frame_count;
+
+    if (index_header.flags & EVX_INDEX_FLAG_FINAL)
+    {
+        reader->finished = true;
+    }
+
+    return 1;
+}
+
+// Returns 0 if a frame was staged, 1 if a non-frame record was consumed, or
+// one of the EVX_RECORD_* errors.
+int32 _read_record(EVX_READER *reader)
+{
+    EVX_MEDIA_RECORD_HEADER record;
+
+    if (!_read_bytes(reader, &record, sizeof(record)))
+    {
+        return EVX_RECORD_INCOMPLETE;
+    }
+
+    if (record.header_size < sizeof(record))
+    {
+        return EVX_RECORD_INVALID;
+    }
+
+    // Legacy files contain only frames and their magic cannot be trusted.
+    if (EVX_MEDIA_VERSION_LEGACY == reader->header.version || evx_check_magic(record.magic, "EVFH"))
+    {
+        return _read_frame_record(reader, record);
+    }
+
+    if (evx_check_magic(record.magic, "EVIX"))
+    {
+        return _read_index_record(reader, record);
+    }
+
+    evx_msg("Unknown record at offset %llu", reader->offset - sizeof(record));
+
+    return EVX_RECORD_INVALID;
+}
+
+int32 evx_reader_open(const char *filename, EVX_READER *reader)
+{
+    reader->file = NULL;
+    reader->file_size = 0;
+    reader->offset = 0;
+    reader->frames_read = 0;
+    reader->frames_decoded = 0;
+    reader->stream_frame_count = 0;
+    reader->follow = false;
+    reader->finished = false;
+    reader->temp_buffer = NULL;
+    reader->decoder = NULL;
+
+    memset(&reader->header, 0, sizeof(reader->header));
+    memset(&reader->frame_header, 0, sizeof(reader->frame_header));
+
+    if (0 == strcmp(filename, "-"))
+    {
+#if defined(EVX_PLATFORM_WINDOWS)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        reader->file = stdin;
+    }
+    else
+    {
+        reader->file = fopen(filename, "rb");
+    }
+
+    if (!reader->file)
+    {
+        evx_msg("Error opening source file %s", filename);
+        return -1;
+    }
+
+    if (stdin != reader->file)
+    {
+        reader->file_size = _get_file_size(reader->file);
+    }
+
+    reader->temp_buffer = new uint8[EVX_READER_MAX_FRAME_SIZE];
+
+    if (!_read_bytes(reader, &reader->header, sizeof(reader->header)) ||
+        evx_check_header_format(reader->header) < 0)
+    {
+        evx_msg("Invalid or unsupported file header in %s", filename);
+        evx_reader_close(reader);
+        return -1;
+    }
+
+    reader->stream.resize_capacity(EVX_READER_MAX_FRAME_SIZE << 3);
+    create_decoder(&reader->decoder);
+
+    return 0;
+}
+
+void evx_reader_close(EVX_READER *reader)
+{
+    if (reader->decoder)
+    {
+        destroy_decoder(reader->decoder);
+        reader->decoder = NULL;
+    }
+
+    if (reader->file && stdin != reader->file)
+    {
+        fclose(reader->file);
+    }
+
+    reader->file = NULL;
+
+    delete [] reader->temp_buffer;
+    reader->temp_buffer = NULL;
+}
+
+uint64 evx_reader_tell(EVX_READER *reader)
+{
+    return reader->offset;
+}
+
+float evx_reader_query_progress(EVX_READER *reader)
+{
+    float progress = 0.0f;
+
+    if (reader->file_size && !reader->follow)
+    {
+        progress = (float) reader->offset / reader->file_size;
+    }
+    else if (reader->header.frame_count)
+    {
+        progress = (float) reader->frames_read / reader->header.frame_count;
+    }
+
+    return min(progress, 1.0f);
+}
+
+bool evx_reader_is_done(EVX_READER *reader)
+{
+    if (reader->finished)
+    {
+        return true;
+    }
+
+    // Legacy files are only complete once the frame count is reached. For 
+    // newer files the count is only a hint and the stream itself is used.
+    if (EVX_MEDIA_VERSION_LEGACY == reader->header.version && 
+        reader->header.frame_count && (reader->frames_read >= reader->header.frame_count))
+    {
+        return true;
+    }
+
+    // If there is nothing left to read in the file, we're done.
+    return !reader->follow && reader->file_size && (reader->offset >= reader->file_size);
+}
+
+int32 evx_reader_read_frame(EVX_READER *reader)
+{
+    while (!evx_reader_is_done(reader))
+    {
+        uint64 record_offset = reader->offset;
+        int32 result = _read_record(reader);
+
+        if (0 == result)
+        {
+            return 0;
+        }
+
+        if (result > 0)
+        {
+            continue;
+        }
+
+        // A partial record in a file that is still being written is retried
+        // from its start once more data has arrived.
+        if (EVX_RECORD_INCOMPLETE == result && reader->follow && reader->file_size)
+        {
+            clearerr(reader->file);
+            fseek(reader->file, record_offset, SEEK_SET);
+            reader->offset = record_offset;
+            return EVX_READER_PENDING;
+        }
+
+        reader->finished = true;
+    }
+
+    return -1;
+}
+
+void _reset_decoder(EVX_READER *reader)
+{
+    if (reader->decoder)
+    {
+        destroy_decoder(reader->decoder);
+    }
+
+    create_decoder(&reader->decoder);
+    reader->frames_decoded = 0;
+}
+
+int32 evx_reader_seek(EVX_READER *reader, uint64 offset, uint64 frame_index)
+{
+    if (!reader->file_size || offset >= reader->file_size)
+    {
+        return -1;
+    }
+
+    clearerr(reader->file);
+
+    if (0 != fseek(reader->file, offset, SEEK_SET))
+    {
+        return -1;
+    }
+
+    reader->offset = offset;
+    reader->frames_read = frame_index;
+    reader->finished = false;
+
+    _reset_decoder(reader);
+
+    return 0;
+}
+
+int32 evx_reader_decode_frame(EVX_READER *reader, image *output)
+{
+    if ((reader->frame_header.flags & EVX_FRAME_FLAG_ENTRY_POINT) && reader->frames_decoded)
+    {
+        _reset_decoder(reader);
+    }
+
+    evx_status status = reader->decoder->decode(&reader->stream, output->query_data());
+    reader->frames_decoded++;
+
+    return (EVX_SUCCESS == status) ? 0 : -1;
+}
+
+int32 evx_reader_next_frame(EVX_READER *reader, image *output)
+{
+    int32 result = evx_reader_read_frame(reader);
+
+    if (0 != result)
+    {
+        return result;
+    }
+
+    return evx_reader_decode_frame(reader, output);
+}
@@ -0,0 +1,109 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_reader.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_READER_H__
+#define __EVX_READER_H__
+
+#include "cairo/base.h"
+#include "cairo/evx1.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+
+// The reader is the headless core shared by every tool that consumes .evx
+// files. It owns the source file, a staging buffer for frame payloads and 
+// a decoder instance, and has no dependency on GL or GLUT.
+
+#define EVX_READER_MAX_FRAME_SIZE       (4 * EVX_MB)
+
+// Returned by evx_reader_read_frame when following a file that is still 
+// being written and the next record is not yet complete.
+#define EVX_READER_PENDING              (1)
+
+typedef struct EVX_READER
+{
+    FILE *file;
+    uint64 file_size;           // zero if the source is not seekable.
+    uint64 offset;
+    uint64 frames_read;
+    uint64 frames_decoded;      // frames decoded since the decoder was created.
+    uint64 stream_frame_count;  // latest count carried by an index record.
+
+    bool follow;                // wait for more data instead of stopping at eof.
+    bool finished;
+
+    EVX_MEDIA_FILE_HEADER header;
+    EVX_MEDIA_FRAME_HEADER frame_header;
+
+    uint8 *temp_buffer;
+    bit_stream stream;
+    evx1_decoder *decoder;
+
+} EVX_READER;
+
+void evx_print_file_header(const EVX_MEDIA_FILE_HEADER &header);
+int32 evx_check_header_format(const EVX_MEDIA_FILE_HEADER &header);
+
+// Opens filename, validates its file header and prepares the decoder. A 
+// filename of "-" reads from stdin.
+int32 evx_reader_open(const char *filename, EVX_READER *reader);
+void evx_reader_close(EVX_READER *reader);
+
+// Returns the current byte offset within the source.
+uint64 evx_reader_tell(EVX_READER *reader);
+
+// Returns the fraction of the source consumed so far, in [0, 1].
+float evx_reader_query_progress(EVX_READER *reader);
+
+// Returns true if there are no further frames to read.
+bool evx_reader_is_done(EVX_READER *reader);
+
+// Reads the next frame record into reader->frame_header and stages its
+// payload in reader->stream, consuming any index records on the way. 
+// Returns -1 at the end of the stream or EVX_READER_PENDING if following
+// a file whose next record has not been written yet.
+int32 evx_reader_read_frame(EVX_READER *reader);
+
+// Repositions the reader at the frame record at offset, which must be an
+// entry point, and starts a fresh decoder. Requires a seekable source.
+int32 evx_reader_seek(EVX_READER *reader, uint64 offset, uint64 frame_index);
+
+// Decodes the currently staged frame into output, which must be an 
+// R8G8B8 image matching the dimensions in the file header. The decoder is
+// restarted whenever an entry point is reached. Returns -1 if the frame 
+// could not be decoded, in which case the frames that follow it up to the
+// next entry point cannot be trusted either.
+int32 evx_reader_decode_frame(EVX_READER *reader, image *output);
+
+// Convenience wrapper that reads and decodes the next frame.
+int32 evx_reader_next_frame(EVX_READER *reader, image *output);
+
+#endif // __EVX_READER_H__
@@ -0,0 +1,328 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_remux.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_remux.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define EVX_REMUX_COPY_BUFFER_SIZE      (EVX_MB)
+
+int32 evx_remux_open_source(const char *filename, EVX_REMUX_SOURCE *source)
+{
+    source->filename = filename;
+    source->fd = -1;
+
+    if (evx_build_frame_index(filename, &source->index) < 0)
+    {
+        return -1;
+    }
+
+    source->fd = open(filename, O_RDONLY);
+
+    if (source->fd < 0)
+    {
+        evx_msg("Error opening source file %s", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+void evx_remux_close_source(EVX_REMUX_SOURCE *source)
+{
+    if (source->fd >= 0)
+    {
+        close(source->fd);
+        source->fd = -1;
+    }
+}
+
+bool _write_all(EVX_REMUX_OUTPUT *output, const void *data, uint64 size)
+{
+    const uint8 *bytes = (const uint8 *) data;
+
+    while (size)
+    {
+        ssize_t count = write(output->fd, bytes, size);
+
+        if (count < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        bytes += count;
+        size -= count;
+        output->offset += count;
+    }
+
+    return true;
+}
+
+bool _copy_with_buffer(EVX_REMUX_OUTPUT *output, int32 source_fd, uint64 offset, uint64 size)
+{
+    std::vector<uint8> buffer(min(size, (uint64) EVX_REMUX_COPY_BUFFER_SIZE));
+
+    while (size)
+    {
+        ssize_t count = pread(source_fd, &buffer[0], min(size, (uint64) buffer.size()), offset);
+
+        if (count < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (count <= 0 || !_write_all(output, &buffer[0], count))
+        {
+            return false;
+        }
+
+        offset += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+// Copies a byte range of the source to the end of the output. On Linux the
+// data is moved by copy_file_range, which lets the filesystem share extents
+// or copy within the page cache instead of bouncing through user space.
+bool _copy_range(EVX_REMUX_OUTPUT *output, int32 source_fd, uint64 offset, uint64 size)
+{
+#if defined(__linux__)
+    loff_t source_offset = offset;
+
+    while (size && !output->copy_fallback)
+    {
+        ssize_t count = copy_file_range(source_fd, &source_offset, output->fd, NULL, size, 0);
+
+        if (count < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (count < 0 && (ENOSYS == errno || EXDEV == errno || EINVAL == errno || EOPNOTSUPP == errno))
+        {
+            evx_msg("copy_file_range is unavailable for %s, copying through user space", output->filename);
+            output->copy_fallback = true;
+            break;
+        }
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        size -= count;
+        output->offset += count;
+        output->payload_bytes += count;
+    }
+
+    offset = source_offset;
+#endif
+
+    return !size || _copy_with_buffer(output, source_fd, offset, size);
+}
+
+bool _write_index_record(EVX_REMUX_OUTPUT *output, uint32 flags)
+{
+    EVX_MEDIA_INDEX_HEADER index_header;
+
+    evx_set_magic(index_header.magic, "EVIX");
+    index_header.header_size = sizeof(index_header);
+    index_header.frame_count = output->frame_count;
+    index_header.entry_count = output->index_entries.size();
+    index_header.flags = flags;
+
+    if (!_write_all(output, &index_header, sizeof(index_header)) ||
+        !_write_all(output, output->index_entries.data(), output->index_entries.size() * sizeof(EVX_MEDIA_INDEX_ENTRY)))
+    {
+        return false;
+    }
+
+    output->index_entries.clear();
+
+    return true;
+}
+
+int32 evx_remux_open_output(const char *filename, const EVX_MEDIA_FILE_HEADER &header, EVX_REMUX_OUTPUT *output)
+{
+    output->filename = filename;
+    output->offset = 0;
+    output->frame_count = 0;
+    output->payload_bytes = 0;
+    output->copy_fallback = false;
+    output->next_timestamp = 0;
+    output->time_scale = 1.0;
+    output->frame_rate = 0.0;
+    output->header = header;
+    output->header.version = EVX_MEDIA_VERSION;
+    output->header.frame_count = 0;
+    output->index_entries.clear();
+    output->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (output->fd < 0)
+    {
+        evx_msg("Error opening dest file %s", filename);
+        return -1;
+    }
+
+    if (!_write_all(output, &output->header, sizeof(output->header)))
+    {
+        evx_msg("Error writing dest file %s", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+int32 evx_remux_close_output(EVX_REMUX_OUTPUT *output)
+{
+    int32 result = 0;
+
+    output->header.frame_count = output->frame_count;
+
+    if (!_write_index_record(output, EVX_INDEX_FLAG_FINAL) ||
+        (ssize_t) sizeof(output->header) != pwrite(output->fd, &output->header, sizeof(output->header), 0))
+    {
+        evx_msg("Error finalizing dest file %s", output->filename);
+        result = -1;
+    }
+
+    if (0 != close(output->fd))
+    {
+        result = -1;
+    }
+
+    output->fd = -1;
+
+    return result;
+}
+
+int32 evx_remux_append(EVX_REMUX_OUTPUT *output, EVX_REMUX_SOURCE *source, uint64 first, uint64 last)
+{
+    const EVX_FRAME_INDEX &index = source->index;
+
+    if (first > last || last >= index.frames.size())
+    {
+        return -1;
+    }
+
+    if (!(index.frames[first].flags & EVX_FRAME_FLAG_ENTRY_POINT))
+    {
+        evx_msg("Frame %llu of %s is not an entry point", first, source->filename);
+        return -1;
+    }
+
+    int64 range_timestamp = 0;
+    int64 range_start = output->next_timestamp;
+
+    for (uint64 i = first; i <= last; i++)
+    {
+        const EVX_FRAME_ENTRY &entry = index.frames[i];
+        EVX_MEDIA_FRAME_HEADER frame_header;
+        int64 timestamp = 0;
+        uint32 duration = 0;
+
+        memset(&frame_header, 0, sizeof(frame_header));
+
+        if (pread(source->fd, &frame_header, min(entry.record_size, (uint32) sizeof(frame_header)), entry.offset) < 
+            (ssize_t) sizeof(EVX_MEDIA_RECORD_HEADER))
+        {
+            evx_msg("Error reading frame %llu of %s", i, source->filename);
+            return -1;
+        }
+
+        // Fields we know about are rewritten; any newer fields that follow 
+        // them are copied along with the payload. Older, shorter headers are
+        // upgraded to the current layout.
+        uint32 known_size = min(frame_header.header_size, (uint32) sizeof(frame_header));
+
+        memset((uint8 *) &frame_header + known_size, 0, sizeof(frame_header) - known_size);
+        evx_query_frame_time(index.header, frame_header, &timestamp, &duration);
+
+        if (i == first)
+        {
+            range_timestamp = timestamp;
+        }
+
+        if (output->frame_rate > 0.0)
+        {
+            timestamp = (int64) (output->frame_count * EVX_TIMESTAMP_SCALE / output->frame_rate + 0.5);
+            duration = (uint32) ((output->frame_count + 1) * EVX_TIMESTAMP_SCALE / output->frame_rate + 0.5) - timestamp;
+        }
+        else
+        {
+            timestamp = range_start + (int64) ((timestamp - range_timestamp) * output->time_scale + 0.5);
+            duration = (uint32) (duration * output->time_scale + 0.5);
+        }
+
+        evx_set_magic(frame_header.magic, "EVFH");
+        frame_header.header_size = max(frame_header.header_size, (uint32) sizeof(frame_header));
+        frame_header.frame_index = output->frame_count;
+        frame_header.flags |= (entry.flags & EVX_FRAME_FLAG_ENTRY_POINT) | EVX_FRAME_FLAG_TIMESTAMP;
+        frame_header.timestamp = timestamp;
+        frame_header.duration = duration;
+        output->next_timestamp = max(output->next_timestamp, timestamp + (int64) duration);
+
+        EVX_MEDIA_INDEX_ENTRY index_entry;
+        index_entry.frame_index = output->frame_count;
+        index_entry.offset = output->offset;
+
+        if (!_write_all(output, &frame_header, sizeof(frame_header)) ||
+            !_copy_range(output, source->fd, entry.offset + known_size, entry.record_size - known_size))
+        {
+            evx_msg("Error copying frame %llu of %s", i, source->filename);
+            return -1;
+        }
+
+        output->index_entries.push_back(index_entry);
+        output->frame_count++;
+
+        if (output->index_entries.size() >= EVX_DEFAULT_INDEX_INTERVAL && !_write_index_record(output, 0))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#endif
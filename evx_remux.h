@@ -0,0 +1,89 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_remux.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_REMUX_H__
+#define __EVX_REMUX_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+#include "evx_index.h"
+
+#include <vector>
+
+// Remuxing rewrites the file header, frame headers and index records of 
+// existing streams but never touches their payloads, which are copied 
+// between files by the kernel wherever possible. Cuts must fall on entry 
+// points so that every output begins with a decodable frame.
+//
+// Every frame written carries a timestamp. Each appended range starts
+// where the frames before it end, and its frames keep their original
+// spacing, scaled by time_scale. A non-zero frame_rate instead restamps
+// every frame at that constant rate.
+
+typedef struct EVX_REMUX_SOURCE
+{
+    const char *filename;
+    int32 fd;
+    EVX_FRAME_INDEX index;
+
+} EVX_REMUX_SOURCE;
+
+typedef struct EVX_REMUX_OUTPUT
+{
+    const char *filename;
+    int32 fd;
+    uint64 offset;
+    uint64 frame_count;
+    uint64 payload_bytes;       // bytes copied without passing through user space.
+    bool copy_fallback;         // true once in-kernel copies have proven unavailable.
+    int64 next_timestamp;       // end of the last frame written, in microseconds.
+    double time_scale;
+    double frame_rate;
+
+    EVX_MEDIA_FILE_HEADER header;
+    std::vector<EVX_MEDIA_INDEX_ENTRY> index_entries;
+
+} EVX_REMUX_OUTPUT;
+
+int32 evx_remux_open_source(const char *filename, EVX_REMUX_SOURCE *source);
+void evx_remux_close_source(EVX_REMUX_SOURCE *source);
+
+// Creates filename with a copy of header that is upgraded to the current
+// version. The frame count is filled in by evx_remux_close_output.
+int32 evx_remux_open_output(const char *filename, const EVX_MEDIA_FILE_HEADER &header, EVX_REMUX_OUTPUT *output);
+int32 evx_remux_close_output(EVX_REMUX_OUTPUT *output);
+
+// Appends frames [first, last] of source to output, renumbering them to 
+// follow the frames already written. first must be an entry point.
+int32 evx_remux_append(EVX_REMUX_OUTPUT *output, EVX_REMUX_SOURCE *source, uint64 first, uint64 last);
+
+#endif // __EVX_REMUX_H__
@@ -0,0 +1,142 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_retime.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "evx_format.h"
+#include "evx_index.h"
+#include "evx_remux.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <unistd.h>
+
+// Retiming rewrites the timestamps of every frame record while copying the
+// payloads untouched, so changing the rate of a file costs no more than 
+// copying it.
+
+int main(int argc, char **argv)
+{
+    EVX_REMUX_SOURCE source;
+    EVX_REMUX_OUTPUT output;
+    double frame_rate = 0.0;
+    double speed = 1.0;
+    int32 result = 0;
+    int32 i = 1;
+
+    for (; i + 1 < argc && '-' == argv[i][0]; i += 2)
+    {
+        if (0 == strcmp(argv[i], "-rate"))
+        {
+            frame_rate = atof(argv[i + 1]);
+        }
+        else if (0 == strcmp(argv[i], "-speed"))
+        {
+            speed = atof(argv[i + 1]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    if (2 != argc - i || frame_rate < 0.0 || speed <= 0.0 || (frame_rate > 0.0 && 1.0 != speed))
+    {
+        evx_msg("Required syntax: retime [-rate <fps> | -speed <factor>] <input_filename> <output_filename>");
+        return 0;
+    }
+
+    const char *source_filename = argv[i];
+    const char *dest_filename = argv[i + 1];
+
+    if (evx_remux_open_source(source_filename, &source) < 0)
+    {
+        evx_remux_close_source(&source);
+        return 0;
+    }
+
+    if (evx_remux_open_output(dest_filename, source.index.header, &output) < 0)
+    {
+        evx_remux_close_source(&source);
+        return 0;
+    }
+
+    // A constant rate restamps every frame; a speed change keeps the 
+    // spacing of the source, scaled.
+    if (frame_rate > 0.0)
+    {
+        output.frame_rate = frame_rate;
+        output.header.frame_rate = (float) frame_rate;
+    }
+    else
+    {
+        output.time_scale = 1.0 / speed;
+        output.header.frame_rate = (float) (source.index.header.frame_rate * speed);
+    }
+
+    if (source.index.frames.size())
+    {
+        result = evx_remux_append(&output, &source, 0, source.index.frames.size() - 1);
+    }
+
+    evx_remux_close_source(&source);
+
+    if (evx_remux_close_output(&output) < 0)
+    {
+        result = -1;
+    }
+
+    // Don't leave a partial file behind that looks like a finished one.
+    if (result < 0)
+    {
+        evx_msg("Removing incomplete dest file %s", dest_filename);
+        unlink(dest_filename);
+        return 0;
+    }
+
+    evx_msg("Wrote %llu frames lasting %.3f s to %s (%llu bytes copied in-kernel)", output.frame_count, 
+        (double) output.next_timestamp / EVX_TIMESTAMP_SCALE, dest_filename, output.payload_bytes);
+
+    return 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+    evx_msg("retime is not available on this platform");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,198 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_scale.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_scale.h"
+
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EVX_SCALE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EVX_SCALE_NEON
+#endif
+
+// Builds only assume SSE2, so the SSSE3 shuffle is compiled for its own
+// target and chosen at run time on processors that support it.
+#if defined(EVX_SCALE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define EVX_SCALE_SSSE3
+#define EVX_SCALE_SSSE3_TARGET      __attribute__((target("ssse3")))
+#endif
+
+// Adds count bytes of a source row to a row of 32 bit sums. This vertical
+// pass touches every source byte and accounts for nearly all of the work,
+// so it is the part that gets vectorized. The horizontal pass only runs 
+// once per destination row.
+void _accumulate_row(uint32 *sums, const uint8 *row, uint32 count)
+{
+    uint32 i = 0;
+
+#if defined(EVX_SCALE_SSE2)
+    __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (row + i));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        __m128i *dest = (__m128i *) (sums + i);
+
+        _mm_storeu_si128(dest + 0, _mm_add_epi32(_mm_loadu_si128(dest + 0), _mm_unpacklo_epi16(low, zero)));
+        _mm_storeu_si128(dest + 1, _mm_add_epi32(_mm_loadu_si128(dest + 1), _mm_unpackhi_epi16(low, zero)));
+        _mm_storeu_si128(dest + 2, _mm_add_epi32(_mm_loadu_si128(dest + 2), _mm_unpacklo_epi16(high, zero)));
+        _mm_storeu_si128(dest + 3, _mm_add_epi32(_mm_loadu_si128(dest + 3), _mm_unpackhi_epi16(high, zero)));
+    }
+#elif defined(EVX_SCALE_NEON)
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16_t bytes = vld1q_u8(row + i);
+        uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+        uint32 *dest = sums + i;
+
+        vst1q_u32(dest + 0, vaddw_u16(vld1q_u32(dest + 0), vget_low_u16(low)));
+        vst1q_u32(dest + 4, vaddw_u16(vld1q_u32(dest + 4), vget_high_u16(low)));
+        vst1q_u32(dest + 8, vaddw_u16(vld1q_u32(dest + 8), vget_low_u16(high)));
+        vst1q_u32(dest + 12, vaddw_u16(vld1q_u32(dest + 12), vget_high_u16(high)));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        sums[i] += row[i];
+    }
+}
+
+void evx_box_filter(const uint8 *source, uint32 source_width, uint32 source_height, uint32 source_pitch,
+                    uint8 *dest, uint32 dest_width, uint32 dest_height, uint32 dest_pitch)
+{
+    uint32 row_size = source_width * 3;
+    std::vector<uint32> sums(row_size);
+
+    for (uint32 y = 0; y < dest_height; y++)
+    {
+        uint32 first_row = (uint64) y * source_height / dest_height;
+        uint32 last_row = max((uint32) ((uint64) (y + 1) * source_height / dest_height), first_row + 1);
+        uint8 *dest_row = dest + y * dest_pitch;
+
+        memset(&sums[0], 0, row_size * sizeof(uint32));
+
+        for (uint32 i = first_row; i < last_row; i++)
+        {
+            _accumulate_row(&sums[0], source + i * source_pitch, row_size);
+        }
+
+        for (uint32 x = 0; x < dest_width; x++)
+        {
+            uint32 first_column = (uint64) x * source_width / dest_width;
+            uint32 last_column = max((uint32) ((uint64) (x + 1) * source_width / dest_width), first_column + 1);
+            uint32 area = (last_row - first_row) * (last_column - first_column);
+            uint32 red = 0, green = 0, blue = 0;
+
+            for (uint32 i = first_column; i < last_column; i++)
+            {
+                red += sums[3 * i + 0];
+                green += sums[3 * i + 1];
+                blue += sums[3 * i + 2];
+            }
+
+            dest_row[3 * x + 0] = (red + area / 2) / area;
+            dest_row[3 * x + 1] = (green + area / 2) / area;
+            dest_row[3 * x + 2] = (blue + area / 2) / area;
+        }
+    }
+}
+
+#if defined(EVX_SCALE_SSSE3)
+
+bool _is_ssse3_supported()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+const bool g_scale_ssse3 = _is_ssse3_supported();
+
+// Expands the leading pixels of a row and returns the number it covered.
+// Each load covers five and a third pixels, of which four are used, so the
+// loop stops while a full load still fits within the row.
+EVX_SCALE_SSSE3_TARGET uint32 _expand_bgra_ssse3(const uint8 *source, uint32 width, uint8 *dest)
+{
+    __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    __m128i alpha = _mm_set1_epi32(0xFF000000);
+    uint32 i = 0;
+
+    for (; 3 * i + 16 <= 3 * width; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i *) (source + 3 * i));
+        _mm_storeu_si128((__m128i *) (dest + 4 * i), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+    }
+
+    return i;
+}
+
+#endif
+
+void evx_expand_bgra(const uint8 *source, uint32 width, uint8 *dest)
+{
+    uint32 i = 0;
+
+#if defined(EVX_SCALE_SSSE3)
+    if (g_scale_ssse3)
+    {
+        i = _expand_bgra_ssse3(source, width, dest);
+    }
+#elif defined(EVX_SCALE_NEON)
+    for (; i + 8 <= width; i += 8)
+    {
+        uint8x8x3_t pixels = vld3_u8(source + 3 * i);
+        uint8x8x4_t expanded;
+
+        expanded.val[0] = pixels.val[2];
+        expanded.val[1] = pixels.val[1];
+        expanded.val[2] = pixels.val[0];
+        expanded.val[3] = vdup_n_u8(0xFF);
+
+        vst4_u8(dest + 4 * i, expanded);
+    }
+#endif
+
+    for (; i < width; i++)
+    {
+        dest[4 * i + 0] = source[3 * i + 2];
+        dest[4 * i + 1] = source[3 * i + 1];
+        dest[4 * i + 2] = source[3 * i + 0];
+        dest[4 * i + 3] = 0xFF;
+    }
+}
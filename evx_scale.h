@@ -0,0 +1,53 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_scale.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_SCALE_H__
+#define __EVX_SCALE_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+// Downsamples packed 24 bit pixels to the dimensions of dest by averaging
+// the box of source pixels that each destination pixel covers. Rows are 
+// processed in source order, so both buffers share the same orientation.
+// When enlarging, each destination pixel takes its nearest source pixel.
+
+void evx_box_filter(const uint8 *source, uint32 source_width, uint32 source_height, uint32 source_pitch,
+                    uint8 *dest, uint32 dest_width, uint32 dest_height, uint32 dest_pitch);
+
+// Expands a row of width packed R8G8B8 pixels into B8G8R8A8 pixels with an
+// opaque alpha. Four byte pixels keep every row aligned, which is the 
+// layout that GL drivers and most frame consumers can take without a copy.
+
+void evx_expand_bgra(const uint8 *source, uint32 width, uint8 *dest);
+
+#endif // __EVX_SCALE_H__
@@ -0,0 +1,178 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_scene.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_scene.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EVX_SCENE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EVX_SCENE_NEON
+#endif
+
+// Returns the sum of count bytes. This runs over every byte of the frame, 
+// so it is the part that gets vectorized; psadbw against zero sums sixteen
+// bytes per instruction.
+uint32 _sum_bytes(const uint8 *data, uint32 count)
+{
+    uint32 sum = 0;
+    uint32 i = 0;
+
+#if defined(EVX_SCENE_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i sums = _mm_setzero_si128();
+
+    for (; i + 16 <= count; i += 16)
+    {
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (data + i)), zero));
+    }
+
+    sum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+#elif defined(EVX_SCENE_NEON)
+    uint32x4_t sums = vdupq_n_u32(0);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        sums = vpadalq_u16(sums, vpaddlq_u8(vld1q_u8(data + i)));
+    }
+
+    sum = vgetq_lane_u32(sums, 0) + vgetq_lane_u32(sums, 1) + vgetq_lane_u32(sums, 2) + vgetq_lane_u32(sums, 3);
+#endif
+
+    for (; i < count; i++)
+    {
+        sum += data[i];
+    }
+
+    return sum;
+}
+
+// Pixels beyond the last whole cell are ignored, except in frames smaller
+// than a single cell.
+void _build_thumbnail(EVX_SCENE_DETECTOR *detector, const uint8 *data, uint32 row_pitch, uint32 *cells)
+{
+    uint32 cell_width = min(detector->width, (uint32) EVX_SCENE_CELL_SIZE);
+    uint32 cell_height = min(detector->height, (uint32) EVX_SCENE_CELL_SIZE);
+
+    memset(cells, 0, detector->columns * detector->rows * sizeof(uint32));
+
+    for (uint32 y = 0; y < detector->rows * cell_height; y++)
+    {
+        const uint8 *row = data + y * row_pitch;
+        uint32 *cell_row = cells + (y / cell_height) * detector->columns;
+
+        for (uint32 x = 0; x < detector->columns; x++)
+        {
+            cell_row[x] += _sum_bytes(row + x * cell_width * 3, cell_width * 3);
+        }
+    }
+}
+
+int32 evx_scene_open(uint32 width, uint32 height, double threshold, EVX_SCENE_DETECTOR *detector)
+{
+    if (!width || !height)
+    {
+        return -1;
+    }
+
+    detector->width = width;
+    detector->height = height;
+    detector->columns = max(width / EVX_SCENE_CELL_SIZE, 1u);
+    detector->rows = max(height / EVX_SCENE_CELL_SIZE, 1u);
+    detector->cells[0] = new uint32[detector->columns * detector->rows];
+    detector->cells[1] = new uint32[detector->columns * detector->rows];
+    detector->threshold = threshold;
+
+    evx_scene_reset(detector);
+
+    return 0;
+}
+
+void evx_scene_close(EVX_SCENE_DETECTOR *detector)
+{
+    delete [] detector->cells[0];
+    delete [] detector->cells[1];
+    detector->cells[0] = NULL;
+    detector->cells[1] = NULL;
+}
+
+void evx_scene_reset(EVX_SCENE_DETECTOR *detector)
+{
+    detector->current = 0;
+    detector->primed = false;
+    detector->average_score = 0.0;
+    detector->frames_since_cut = 0;
+}
+
+bool evx_scene_detect(EVX_SCENE_DETECTOR *detector, const uint8 *data, uint32 row_pitch, double *score)
+{
+    uint32 cell_count = detector->columns * detector->rows;
+    uint32 cell_pixels = min(detector->width, (uint32) EVX_SCENE_CELL_SIZE) * min(detector->height, (uint32) EVX_SCENE_CELL_SIZE);
+    uint32 *cells = detector->cells[detector->current];
+    uint32 *previous_cells = detector->cells[detector->current ^ 1];
+    uint64 difference = 0;
+
+    _build_thumbnail(detector, data, row_pitch, cells);
+    detector->current ^= 1;
+    detector->frames_since_cut++;
+    *score = 0.0;
+
+    if (!detector->primed)
+    {
+        detector->primed = true;
+        return false;
+    }
+
+    for (uint32 i = 0; i < cell_count; i++)
+    {
+        difference += (cells[i] > previous_cells[i]) ? cells[i] - previous_cells[i] : previous_cells[i] - cells[i];
+    }
+
+    *score = (double) difference / ((uint64) cell_count * cell_pixels * 3);
+
+    bool cut = *score >= detector->threshold && 
+               *score >= EVX_SCENE_MIN_CONTRAST * detector->average_score &&
+               detector->frames_since_cut >= EVX_SCENE_MIN_INTERVAL;
+
+    // The score of a cut says nothing about motion within either scene, so
+    // it is kept out of the average.
+    if (cut)
+    {
+        detector->frames_since_cut = 0;
+        return true;
+    }
+
+    detector->average_score = 0.9 * detector->average_score + 0.1 * *score;
+
+    return false;
+}
@@ -0,0 +1,79 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_scene.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_SCENE_H__
+#define __EVX_SCENE_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+// The scene detector reduces each frame to a thumbnail of cell sums, where
+// each cell covers EVX_SCENE_CELL_SIZE square pixels, and scores a frame 
+// by the mean absolute difference between its thumbnail and the previous
+// one, in units of a single 8 bit channel. A frame is a cut when its score
+// reaches the threshold and also stands out against the recent scores, so 
+// that continuous motion does not cut on every frame.
+
+#define EVX_SCENE_CELL_SIZE             (16)
+#define EVX_SCENE_DEFAULT_THRESHOLD     (24.0)
+#define EVX_SCENE_MIN_CONTRAST          (3.0)   // score relative to the recent average.
+#define EVX_SCENE_MIN_INTERVAL          (8)     // frames between cuts.
+
+typedef struct EVX_SCENE_DETECTOR
+{
+    uint32 width;
+    uint32 height;
+    uint32 columns;
+    uint32 rows;
+
+    uint32 *cells[2];           // thumbnails of the current and previous frames.
+    uint32 current;
+    bool primed;                // true once a previous frame is available.
+
+    double threshold;
+    double average_score;       // running average of recent scores.
+    uint64 frames_since_cut;
+
+} EVX_SCENE_DETECTOR;
+
+int32 evx_scene_open(uint32 width, uint32 height, double threshold, EVX_SCENE_DETECTOR *detector);
+void evx_scene_close(EVX_SCENE_DETECTOR *detector);
+
+// Forgets the previous frame, as after a seek, so the next frame is not
+// compared against it.
+void evx_scene_reset(EVX_SCENE_DETECTOR *detector);
+
+// Scores an R8G8B8 frame against the previous one. Returns true if the 
+// frame begins a new scene.
+bool evx_scene_detect(EVX_SCENE_DETECTOR *detector, const uint8 *data, uint32 row_pitch, double *score);
+
+#endif // __EVX_SCENE_H__
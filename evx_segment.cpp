@@ -0,0 +1,314 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_segment.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_segment.h"
+
+void _build_segments(const EVX_FRAME_INDEX &index, std::vector<EVX_SEGMENT> *segments)
+{
+    segments->clear();
+
+    // The first frame is always an entry point, whether or not it was 
+    // written with the flag.
+    for (size_t i = 0; i < index.frames.size(); i++)
+    {
+        if (0 == i || (index.frames[i].flags & EVX_FRAME_FLAG_ENTRY_POINT))
+        {
+            EVX_SEGMENT segment;
+
+            segment.first_frame = i;
+            segment.frame_count = 0;
+            segment.offset = index.frames[i].offset;
+
+            segments->push_back(segment);
+        }
+
+        segments->back().frame_count++;
+    }
+}
+
+uint32 _query_default_slot_count(EVX_SEGMENT_DECODER *decoder, uint32 thread_count)
+{
+    uint64 frame_size = (uint64) decoder->header.frame_width * decoder->header.frame_height * 3;
+    uint64 longest_segment = 0;
+
+    for (size_t i = 0; i < decoder->segments.size(); i++)
+    {
+        longest_segment = max(longest_segment, decoder->segments[i].frame_count);
+    }
+
+    // Every worker can stay busy once the buffer spans a segment per worker.
+    uint64 useful_count = min(longest_segment * thread_count, decoder->frame_count);
+    uint64 budget_count = EVX_SEGMENT_DEFAULT_BUFFER_SIZE / max(frame_size, (uint64) 1);
+
+    return (uint32) max(min(useful_count, budget_count), (uint64) 1);
+}
+
+// Waits until frame fits within the reorder buffer. Returns false if the
+// decoder is closing or an earlier frame has failed, so the frame will 
+// never be returned.
+bool _wait_for_slot(EVX_SEGMENT_DECODER *decoder, uint64 frame)
+{
+    std::unique_lock<std::mutex> guard(decoder->lock);
+
+    while (!decoder->closing && frame < decoder->error_frame && frame >= decoder->next_frame + decoder->slot_count)
+    {
+        decoder->signal.wait(guard);
+    }
+
+    return !decoder->closing && frame < decoder->error_frame;
+}
+
+void _fail_frame(EVX_SEGMENT_DECODER *decoder, uint64 frame)
+{
+    std::lock_guard<std::mutex> guard(decoder->lock);
+
+    decoder->error_frame = min(decoder->error_frame, frame);
+    decoder->signal.notify_all();
+}
+
+// Decodes a segment into the reorder buffer. Returns false if the worker
+// should stop.
+bool _decode_segment(EVX_SEGMENT_DECODER *decoder, EVX_READER *reader, const EVX_SEGMENT &segment)
+{
+    if (evx_reader_seek(reader, segment.offset, segment.first_frame) < 0)
+    {
+        _fail_frame(decoder, segment.first_frame);
+        return false;
+    }
+
+    for (uint64 frame = segment.first_frame; frame < segment.first_frame + segment.frame_count; frame++)
+    {
+        // Records are read before waiting, so that the read overlaps with 
+        // the consumer releasing the slot.
+        if (0 != evx_reader_read_frame(reader))
+        {
+            evx_msg("Error reading frame %llu", frame);
+            _fail_frame(decoder, frame);
+            return false;
+        }
+
+        if (!_wait_for_slot(decoder, frame))
+        {
+            return false;
+        }
+
+        // The slot belongs to this worker until it is marked ready, as no
+        // other frame maps to it within the reorder buffer.
+        EVX_SEGMENT_SLOT *slot = &decoder->slots[frame % decoder->slot_count];
+
+        if (!slot->allocated)
+        {
+            create_image(EVX_IMAGE_FORMAT_R8G8B8, decoder->header.frame_width, decoder->header.frame_height, &slot->frame_image);
+            slot->allocated = true;
+        }
+
+        if (0 != evx_reader_decode_frame(reader, &slot->frame_image))
+        {
+            evx_msg("Error decoding frame %llu", frame);
+            _fail_frame(decoder, frame);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(decoder->lock);
+        slot->ready = true;
+        decoder->signal.notify_all();
+    }
+
+    return true;
+}
+
+void _segment_thread_main(EVX_SEGMENT_DECODER *decoder, EVX_READER *reader)
+{
+    while (true)
+    {
+        uint32 segment_index = 0;
+
+        {
+            // Segments are claimed in file order, so the earliest frame not
+            // yet returned always belongs to a worker that can decode it.
+            std::lock_guard<std::mutex> guard(decoder->lock);
+
+            if (decoder->closing || decoder->next_segment >= decoder->segments.size())
+            {
+                return;
+            }
+
+            segment_index = decoder->next_segment++;
+        }
+
+        if (!_decode_segment(decoder, reader, decoder->segments[segment_index]))
+        {
+            return;
+        }
+    }
+}
+
+int32 evx_segment_open(const char *filename, uint32 thread_count, uint32 slot_count, EVX_SEGMENT_DECODER *decoder)
+{
+    EVX_FRAME_INDEX index;
+
+    decoder->readers = NULL;
+    decoder->slots = NULL;
+    decoder->slot_count = 0;
+    decoder->next_segment = 0;
+    decoder->next_frame = 0;
+    decoder->holding = false;
+    decoder->closing = false;
+
+    if (evx_build_frame_index(filename, &index) < 0)
+    {
+        return -1;
+    }
+
+    decoder->header = index.header;
+    decoder->frame_count = index.frames.size();
+    decoder->error_frame = decoder->frame_count;
+
+    _build_segments(index, &decoder->segments);
+
+    if (0 == thread_count)
+    {
+        thread_count = max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Additional workers would never claim a segment.
+    thread_count = max(min(thread_count, (uint32) decoder->segments.size()), 1u);
+
+    decoder->slot_count = slot_count ? slot_count : _query_default_slot_count(decoder, thread_count);
+    decoder->slots = new EVX_SEGMENT_SLOT[decoder->slot_count];
+
+    for (uint32 i = 0; i < decoder->slot_count; i++)
+    {
+        decoder->slots[i].allocated = false;
+        decoder->slots[i].ready = false;
+    }
+
+    // Readers are opened up front, so a worker can never fail to start.
+    decoder->readers = new EVX_READER[thread_count];
+
+    for (uint32 i = 0; i < thread_count; i++)
+    {
+        if (evx_reader_open(filename, &decoder->readers[i]) < 0)
+        {
+            for (uint32 j = 0; j < i; j++)
+            {
+                evx_reader_close(&decoder->readers[j]);
+            }
+
+            delete [] decoder->readers;
+            delete [] decoder->slots;
+            decoder->readers = NULL;
+            decoder->slots = NULL;
+
+            return -1;
+        }
+    }
+
+    for (uint32 i = 0; i < thread_count; i++)
+    {
+        decoder->threads.push_back(std::thread(_segment_thread_main, decoder, &decoder->readers[i]));
+    }
+
+    return 0;
+}
+
+void evx_segment_close(EVX_SEGMENT_DECODER *decoder)
+{
+    {
+        std::lock_guard<std::mutex> guard(decoder->lock);
+        decoder->closing = true;
+        decoder->signal.notify_all();
+    }
+
+    for (uint32 i = 0; i < decoder->threads.size(); i++)
+    {
+        decoder->threads[i].join();
+        evx_reader_close(&decoder->readers[i]);
+    }
+
+    for (uint32 i = 0; i < decoder->slot_count; i++)
+    {
+        if (decoder->slots[i].allocated)
+        {
+            destroy_image(&decoder->slots[i].frame_image);
+        }
+    }
+
+    decoder->threads.clear();
+
+    delete [] decoder->readers;
+    delete [] decoder->slots;
+    decoder->readers = NULL;
+    decoder->slots = NULL;
+    decoder->slot_count = 0;
+}
+
+int32 evx_segment_next_frame(EVX_SEGMENT_DECODER *decoder, image **frame)
+{
+    std::unique_lock<std::mutex> guard(decoder->lock);
+
+    // Releasing the previous frame frees its slot for a waiting worker.
+    if (decoder->holding)
+    {
+        decoder->slots[decoder->next_frame % decoder->slot_count].ready = false;
+        decoder->next_frame++;
+        decoder->holding = false;
+        decoder->signal.notify_all();
+    }
+
+    if (decoder->next_frame >= decoder->frame_count)
+    {
+        return 1;
+    }
+
+    EVX_SEGMENT_SLOT *slot = &decoder->slots[decoder->next_frame % decoder->slot_count];
+
+    while (!slot->ready && decoder->next_frame < decoder->error_frame)
+    {
+        decoder->signal.wait(guard);
+    }
+
+    if (!slot->ready)
+    {
+        return -1;
+    }
+
+    decoder->holding = true;
+    *frame = &slot->frame_image;
+
+    return 0;
+}
+
+uint32 evx_segment_query_thread_count(EVX_SEGMENT_DECODER *decoder)
+{
+    return decoder->threads.size();
+}
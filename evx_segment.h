@@ -0,0 +1,111 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_segment.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_SEGMENT_H__
+#define __EVX_SEGMENT_H__
+
+#include "cairo/base.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+#include "evx_index.h"
+#include "evx_reader.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The segment decoder decodes a seekable file on several threads at once. 
+// The file is split at its entry points into segments that decode 
+// independently, and each worker claims the next segment in file order 
+// with its own reader and decoder. Decoded frames are returned in order 
+// through a reorder buffer of a fixed number of frames.
+//
+// A worker may only decode a frame once it fits within the reorder buffer,
+// so the buffer bounds memory, and decoding only proceeds in parallel to 
+// the extent that the buffer spans several segments. Files without entry 
+// points after their first frame decode on a single thread.
+
+#define EVX_SEGMENT_DEFAULT_BUFFER_SIZE     (512 * EVX_MB)
+
+typedef struct EVX_SEGMENT
+{
+    uint64 first_frame;
+    uint64 frame_count;
+    uint64 offset;              // offset of the first frame record.
+
+} EVX_SEGMENT;
+
+typedef struct EVX_SEGMENT_SLOT
+{
+    image frame_image;          // allocated by the first worker to use the slot.
+    bool allocated;
+    bool ready;                 // true once the frame has been decoded.
+
+} EVX_SEGMENT_SLOT;
+
+typedef struct EVX_SEGMENT_DECODER
+{
+    EVX_MEDIA_FILE_HEADER header;
+    std::vector<EVX_SEGMENT> segments;
+    uint64 frame_count;
+
+    EVX_READER *readers;                // one per worker.
+    std::vector<std::thread> threads;
+    EVX_SEGMENT_SLOT *slots;
+    uint32 slot_count;
+
+    std::mutex lock;
+    std::condition_variable signal;
+    uint32 next_segment;
+    uint64 next_frame;                  // the next frame to return.
+    uint64 error_frame;                 // the first frame that failed to read.
+    bool holding;                       // true while a returned frame is in use.
+    bool closing;
+
+} EVX_SEGMENT_DECODER;
+
+// Opens filename and starts thread_count workers, or one per hardware 
+// thread if zero. The reorder buffer holds slot_count frames, or as many
+// as fit in EVX_SEGMENT_DEFAULT_BUFFER_SIZE (but no more than useful) if
+// zero. Requires a seekable file.
+int32 evx_segment_open(const char *filename, uint32 thread_count, uint32 slot_count, EVX_SEGMENT_DECODER *decoder);
+void evx_segment_close(EVX_SEGMENT_DECODER *decoder);
+
+// Returns 0 with the next frame in order, 1 once every frame has been 
+// returned, or -1 if the frame could not be read. The frame remains valid
+// until the next call.
+int32 evx_segment_next_frame(EVX_SEGMENT_DECODER *decoder, image **frame);
+
+uint32 evx_segment_query_thread_count(EVX_SEGMENT_DECODER *decoder);
+
+#endif // __EVX_SEGMENT_H__
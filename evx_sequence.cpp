@@ -0,0 +1,743 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_sequence.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "evx_memory.h"
+
+#include <ctype.h>
+#include <png.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(EVX_PLATFORM_WINDOWS)
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// An image sequence is a directory of numbered frames, each in its own 
+// file. Frames do not depend on each other, so a set of worker threads 
+// decodes them ahead of the encoder into a ring of slots, and refresh 
+// returns them in order. Seeking restarts the workers at the new frame, 
+// and successive seeks by the same distance, as when every nth frame is 
+// converted, are followed so that frames in between are never decoded.
+
+#define SEQUENCE_BUFFER_SIZE            (256 * EVX_MB)
+#define SEQUENCE_SLOTS_PER_THREAD       (2)
+
+typedef enum EVX_SEQUENCE_FORMAT
+{
+    EVX_SEQUENCE_FORMAT_UNKNOWN = 0,
+    EVX_SEQUENCE_FORMAT_RAW,        // headerless top-down rgb24.
+    EVX_SEQUENCE_FORMAT_PPM,        // binary P6 or P5, 8 or 16 bits per sample.
+    EVX_SEQUENCE_FORMAT_PNG,
+
+} EVX_SEQUENCE_FORMAT;
+
+typedef struct EVX_SEQUENCE_SLOT
+{
+    unsigned char *data;            // top-down rgb24.
+    int encoded_size;
+    bool ready;
+    bool failed;
+
+} EVX_SEQUENCE_SLOT;
+
+typedef struct EVX_SEQUENCE_STATE
+{
+    std::vector<std::string> filenames;
+    int width;
+    int height;
+    int raw_width;                  // dimensions of raw frames, zero if not given.
+    int raw_height;
+    float frame_rate;
+
+    std::vector<std::thread> threads;
+    EVX_SEQUENCE_SLOT *slots;
+    int slot_count;
+
+    // Frames are returned in ordinal order, where ordinal k is frame 
+    // base_frame + k * stride, and ordinal k decodes into slot k % slot_count.
+    std::mutex lock;
+    std::condition_variable signal;
+    long long base_frame;
+    long long stride;
+    long long next_ordinal;         // the next ordinal to return.
+    long long next_claim;           // the next ordinal for a worker to decode.
+    long long last_frame;           // the frame last returned, -1 if none.
+    int busy_count;                 // workers decoding a claimed frame.
+    bool holding;                   // true while the returned frame is in use.
+    bool seeked;                    // true if a seek preceded the next refresh.
+    bool draining;                  // true while a seek waits for the workers.
+    bool closing;
+
+} EVX_SEQUENCE_STATE;
+
+EVX_SEQUENCE_STATE g_sequence;
+
+EVX_SEQUENCE_FORMAT _query_sequence_format(const std::string &filename)
+{
+    size_t dot = filename.rfind('.');
+
+    if (std::string::npos == dot)
+    {
+        return EVX_SEQUENCE_FORMAT_UNKNOWN;
+    }
+
+    std::string extension = filename.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if ("png" == extension) return EVX_SEQUENCE_FORMAT_PNG;
+    if ("ppm" == extension || "pgm" == extension || "pnm" == extension) return EVX_SEQUENCE_FORMAT_PPM;
+    if ("rgb" == extension || "raw" == extension) return EVX_SEQUENCE_FORMAT_RAW;
+
+    return EVX_SEQUENCE_FORMAT_UNKNOWN;
+}
+
+// Orders names with runs of digits compared by value, so that frame_9 
+// comes before frame_10 whether or not the numbers are zero padded.
+bool _compare_frame_names(const std::string &a, const std::string &b)
+{
+    size_t i = 0, j = 0;
+
+    while (i < a.size() && j < b.size())
+    {
+        if (isdigit((unsigned char) a[i]) && isdigit((unsigned char) b[j]))
+        {
+            size_t a_end = i, b_end = j;
+
+            while (i < a.size() && '0' == a[i]) i++;
+            while (j < b.size() && '0' == b[j]) j++;
+
+            for (a_end = i; a_end < a.size() && isdigit((unsigned char) a[a_end]); a_end++);
+            for (b_end = j; b_end < b.size() && isdigit((unsigned char) b[b_end]); b_end++);
+
+            if (a_end - i != b_end - j)
+            {
+                return (a_end - i) < (b_end - j);
+            }
+
+            int order = a.compare(i, a_end - i, b, j, b_end - j);
+
+            if (order)
+            {
+                return order < 0;
+            }
+
+            i = a_end;
+            j = b_end;
+            continue;
+        }
+
+        if (a[i] != b[j])
+        {
+            return a[i] < b[j];
+        }
+
+        i++;
+        j++;
+    }
+
+    return (a.size() - i) < (b.size() - j);
+}
+
+// Collects the frames of a supported format in dirname, in frame order.
+int _list_sequence_frames(const char *dirname, std::vector<std::string> *filenames)
+{
+    std::vector<std::string> names;
+
+#if defined(EVX_PLATFORM_WINDOWS)
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((std::string(dirname) + "\\*").c_str(), &entry);
+
+    if (INVALID_HANDLE_VALUE == find)
+    {
+        return -1;
+    }
+
+    do
+    {
+        if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.push_back(entry.cFileName);
+    } while (FindNextFileA(find, &entry));
+
+    FindClose(find);
+#else
+    DIR *dir = opendir(dirname);
+    struct dirent *entry = NULL;
+
+    if (!dir)
+    {
+        return -1;
+    }
+
+    while ((entry = readdir(dir)))
+    {
+        if ('.' != entry->d_name[0]) names.push_back(entry->d_name);
+    }
+
+    closedir(dir);
+#endif
+
+    std::sort(names.begin(), names.end(), _compare_frame_names);
+    filenames->clear();
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (EVX_SEQUENCE_FORMAT_UNKNOWN != _query_sequence_format(names[i]))
+        {
+            filenames->push_back(std::string(dirname) + "/" + names[i]);
+        }
+    }
+
+    return 0;
+}
+
+// Reads the next number in a ppm header, skipping whitespace and comments,
+// and the single whitespace character that follows it.
+bool _read_ppm_value(FILE *file, int *value)
+{
+    int c = fgetc(file);
+
+    while (EOF != c && (isspace(c) || '#' == c))
+    {
+        if ('#' == c)
+        {
+            while (EOF != c && '\n' != c) c = fgetc(file);
+        }
+
+        c = fgetc(file);
+    }
+
+    if (!isdigit(c))
+    {
+        return false;
+    }
+
+    for (*value = 0; isdigit(c); c = fgetc(file))
+    {
+        *value = *value * 10 + (c - '0');
+    }
+
+    return true;
+}
+
+// Reads a ppm frame into dest, or only its dimensions if dest is NULL.
+int _read_ppm_frame(FILE *file, int *width, int *height, unsigned char *dest)
+{
+    int channels = 0, frame_width = 0, frame_height = 0, max_value = 0;
+
+    if ('P' != fgetc(file))
+    {
+        return -1;
+    }
+
+    switch (fgetc(file))
+    {
+        case '5': channels = 1; break;
+        case '6': channels = 3; break;
+        default: return -1;
+    };
+
+    if (!_read_ppm_value(file, &frame_width) || !_read_ppm_value(file, &frame_height) || 
+        !_read_ppm_value(file, &max_value) || max_value <= 0 || max_value > 65535)
+    {
+        return -1;
+    }
+
+    if (!dest)
+    {
+        *width = frame_width;
+        *height = frame_height;
+        return 0;
+    }
+
+    if (frame_width != *width || frame_height != *height)
+    {
+        return -1;
+    }
+
+    // Samples above 8 bits are stored big endian, so keep the high byte.
+    int sample_size = (max_value > 255) ? 2 : 1;
+    int row_size = frame_width * channels * sample_size;
+
+    if (3 == channels && 1 == sample_size)
+    {
+        return (1 == fread(dest, row_size * frame_height, 1, file)) ? 0 : -1;
+    }
+
+    std::vector<unsigned char> row(row_size);
+
+    for (int y = 0; y < frame_height; y++)
+    {
+        unsigned char *dest_row = dest + y * frame_width * 3;
+
+        if (1 != fread(&row[0], row_size, 1, file))
+        {
+            return -1;
+        }
+
+        for (int x = 0; x < frame_width * 3; x++)
+        {
+            int sample = (3 == channels) ? x : x / 3;
+            dest_row[x] = row[sample * sample_size];
+        }
+    }
+
+    return 0;
+}
+
+// Reads a png frame into dest, or only its dimensions if dest is NULL. Any
+// png is reduced to 8 bit rgb, with alpha discarded.
+int _read_png_frame(FILE *file, int *width, int *height, unsigned char *dest)
+{
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+
+    if (!info)
+    {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return -1;
+    }
+
+    if (setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_read_struct(&png, &info, NULL);
+        return -1;
+    }
+
+    png_init_io(png, file);
+    png_read_info(png, info);
+
+    int frame_width = png_get_image_width(png, info);
+    int frame_height = png_get_image_height(png, info);
+    int color_type = png_get_color_type(png, info);
+
+    if (!dest)
+    {
+        *width = frame_width;
+        *height = frame_height;
+        png_destroy_read_struct(&png, &info, NULL);
+        return 0;
+    }
+
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_strip_alpha(png);
+
+    if (PNG_COLOR_TYPE_GRAY == color_type || PNG_COLOR_TYPE_GRAY_ALPHA == color_type)
+    {
+        png_set_gray_to_rgb(png);
+    }
+
+    int pass_count = png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    if (frame_width != *width || frame_height != *height || png_get_rowbytes(png, info) != (png_size_t) frame_width * 3)
+    {
+        png_destroy_read_struct(&png, &info, NULL);
+        return -1;
+    }
+
+    for (int pass = 0; pass < pass_count; pass++)
+    {
+        for (int y = 0; y < frame_height; y++)
+        {
+            png_read_row(png, dest + y * frame_width * 3, NULL);
+        }
+    }
+
+    png_destroy_read_struct(&png, &info, NULL);
+
+    return 0;
+}
+
+// Reads frame into dest, which must match the sequence dimensions, or only
+// queries its dimensions if dest is NULL.
+int _read_sequence_frame(const std::string &filename, int *width, int *height, unsigned char *dest, int *encoded_size)
+{
+    int result = -1;
+    struct stat file_stat;
+    FILE *file = fopen(filename.c_str(), "rb");
+
+    if (!file)
+    {
+        return -1;
+    }
+
+    if (encoded_size && 0 == fstat(fileno(file), &file_stat))
+    {
+        *encoded_size = (int) file_stat.st_size;
+    }
+
+    switch (_query_sequence_format(filename))
+    {
+        case EVX_SEQUENCE_FORMAT_PNG: result = _read_png_frame(file, width, height, dest); break;
+        case EVX_SEQUENCE_FORMAT_PPM: result = _read_ppm_frame(file, width, height, dest); break;
+        case EVX_SEQUENCE_FORMAT_RAW:
+        {
+            if (g_sequence.raw_width <= 0 || g_sequence.raw_height <= 0)
+            {
+                break;
+            }
+
+            if (!dest)
+            {
+                *width = g_sequence.raw_width;
+                *height = g_sequence.raw_height;
+                result = 0;
+            }
+            else
+            {
+                result = (1 == fread(dest, *width * *height * 3, 1, file)) ? 0 : -1;
+            }
+        } break;
+
+        default: break;
+    };
+
+    fclose(file);
+
+    return result;
+}
+
+bool _can_claim_frame()
+{
+    return !g_sequence.draining && g_sequence.next_claim < g_sequence.next_ordinal + g_sequence.slot_count &&
+           g_sequence.base_frame + g_sequence.next_claim * g_sequence.stride < (long long) g_sequence.filenames.size();
+}
+
+void _sequence_thread_main()
+{
+    evx_memory_set_stage(EVX_MEMORY_STAGE_INGEST);
+
+    while (true)
+    {
+        long long frame = 0;
+        EVX_SEQUENCE_SLOT *slot = NULL;
+
+        {
+            std::unique_lock<std::mutex> guard(g_sequence.lock);
+
+            while (!g_sequence.closing && !_can_claim_frame())
+            {
+                g_sequence.signal.wait(guard);
+            }
+
+            if (g_sequence.closing)
+            {
+                return;
+            }
+
+            // The slot last held the ordinal slot_count earlier, which has
+            // already been returned and released.
+            long long ordinal = g_sequence.next_claim++;
+
+            frame = g_sequence.base_frame + ordinal * g_sequence.stride;
+            slot = &g_sequence.slots[ordinal % g_sequence.slot_count];
+            g_sequence.busy_count++;
+        }
+
+        int width = g_sequence.width;
+        int height = g_sequence.height;
+        int result = _read_sequence_frame(g_sequence.filenames[frame], &width, &height, slot->data, &slot->encoded_size);
+
+        if (result < 0)
+        {
+            printf("[SEQ] Failed to read frame %s\n", g_sequence.filenames[frame].c_str());
+        }
+
+        std::lock_guard<std::mutex> guard(g_sequence.lock);
+        slot->ready = (0 == result);
+        slot->failed = (0 != result);
+        g_sequence.busy_count--;
+        g_sequence.signal.notify_all();
+    }
+}
+
+// Waits for the workers to finish the frames they have claimed and drops
+// every decoded frame, so that decoding can restart elsewhere.
+void _reset_sequence(std::unique_lock<std::mutex> &guard, long long frame, long long stride)
+{
+    g_sequence.draining = true;
+
+    while (g_sequence.busy_count)
+    {
+        g_sequence.signal.wait(guard);
+    }
+
+    for (int i = 0; i < g_sequence.slot_count; i++)
+    {
+        g_sequence.slots[i].ready = false;
+        g_sequence.slots[i].failed = false;
+    }
+
+    g_sequence.base_frame = frame;
+    g_sequence.stride = stride;
+    g_sequence.next_ordinal = 0;
+    g_sequence.next_claim = 0;
+    g_sequence.holding = false;
+    g_sequence.draining = false;
+    g_sequence.signal.notify_all();
+}
+
+extern "C" {
+
+int sequence_deinitialize()
+{
+    {
+        std::lock_guard<std::mutex> guard(g_sequence.lock);
+        g_sequence.closing = true;
+        g_sequence.signal.notify_all();
+    }
+
+    for (size_t i = 0; i < g_sequence.threads.size(); i++)
+    {
+        g_sequence.threads[i].join();
+    }
+
+    for (int i = 0; i < g_sequence.slot_count; i++)
+    {
+        free(g_sequence.slots[i].data);
+    }
+
+    delete [] g_sequence.slots;
+
+    g_sequence.threads.clear();
+    g_sequence.filenames.clear();
+    g_sequence.slots = NULL;
+    g_sequence.slot_count = 0;
+
+    return 0;
+}
+
+long long sequence_get_frame_count()
+{
+    return (long long) g_sequence.filenames.size();
+}
+
+float sequence_get_frame_rate()
+{
+    return g_sequence.frame_rate;
+}
+
+int sequence_get_frame_time(long long *timestamp, int *duration)
+{
+    *timestamp = (long long) (g_sequence.last_frame * 1000000.0 / g_sequence.frame_rate + 0.5);
+    *duration = (int) (1000000.0 / g_sequence.frame_rate + 0.5);
+
+    return 0;
+}
+
+int sequence_play_file(const char *dirname, int raw_width, int raw_height, float frame_rate, int thread_count, int *width, int *height)
+{
+    g_sequence.raw_width = raw_width;
+    g_sequence.raw_height = raw_height;
+    g_sequence.frame_rate = frame_rate;
+    g_sequence.slots = NULL;
+    g_sequence.slot_count = 0;
+    g_sequence.base_frame = 0;
+    g_sequence.stride = 1;
+    g_sequence.next_ordinal = 0;
+    g_sequence.next_claim = 0;
+    g_sequence.last_frame = -1;
+    g_sequence.busy_count = 0;
+    g_sequence.holding = false;
+    g_sequence.seeked = false;
+    g_sequence.draining = false;
+    g_sequence.closing = false;
+
+    if (frame_rate <= 0.0f || 0 != _list_sequence_frames(dirname, &g_sequence.filenames))
+    {
+        printf("[SEQ] Failed to open image sequence %s\n", dirname);
+        return -1;
+    }
+
+    if (g_sequence.filenames.empty())
+    {
+        printf("[SEQ] No png, ppm or raw frames found in %s\n", dirname);
+        return -1;
+    }
+
+    // The first frame sets the dimensions of the sequence.
+    if (0 != _read_sequence_frame(g_sequence.filenames[0], &g_sequence.width, &g_sequence.height, NULL, NULL) ||
+        g_sequence.width <= 0 || g_sequence.height <= 0)
+    {
+        printf("[SEQ] Failed to read the dimensions of %s\n", g_sequence.filenames[0].c_str());
+        g_sequence.filenames.clear();
+        return -1;
+    }
+
+    long long frame_size = (long long) g_sequence.width * g_sequence.height * 3;
+
+    if (thread_count <= 0)
+    {
+        thread_count = max((int) std::thread::hardware_concurrency(), 1);
+    }
+
+    // Each worker keeps a frame ahead of the one it is decoding, within the
+    // limit of the buffer.
+    g_sequence.slot_count = (int) min((long long) thread_count * SEQUENCE_SLOTS_PER_THREAD, 
+                                      max(SEQUENCE_BUFFER_SIZE / frame_size, 2LL));
+    thread_count = min(thread_count, g_sequence.slot_count);
+    g_sequence.slots = new EVX_SEQUENCE_SLOT[g_sequence.slot_count];
+
+    for (int i = 0; i < g_sequence.slot_count; i++)
+    {
+        g_sequence.slots[i].data = (unsigned char *) malloc(frame_size);
+        g_sequence.slots[i].encoded_size = 0;
+        g_sequence.slots[i].ready = false;
+        g_sequence.slots[i].failed = false;
+
+        if (!g_sequence.slots[i].data)
+        {
+            printf("[SEQ] Error allocating space for the frame buffers\n");
+            sequence_deinitialize();
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        g_sequence.threads.push_back(std::thread(_sequence_thread_main));
+    }
+
+    printf("[SEQ] Decoding %i frames of %ix%i on %i threads\n", (int) g_sequence.filenames.size(), 
+        g_sequence.width, g_sequence.height, thread_count);
+
+    *width = g_sequence.width;
+    *height = g_sequence.height;
+
+    return 0;
+}
+
+int sequence_copy_current_frame(unsigned char *dest, int row_pitch)
+{
+    EVX_SEQUENCE_SLOT *slot = &g_sequence.slots[g_sequence.next_ordinal % g_sequence.slot_count];
+
+    for (int r = 0; r < g_sequence.height; r++)
+        memcpy(dest + (row_pitch * (g_sequence.height - r - 1)), 
+               slot->data + r * g_sequence.width * 3, 
+               g_sequence.width * 3);
+
+    return 0;
+}
+
+int sequence_refresh(int *encoded_frame_size)
+{
+    std::unique_lock<std::mutex> guard(g_sequence.lock);
+
+    // Releasing the previous frame frees its slot for a waiting worker.
+    if (g_sequence.holding)
+    {
+        g_sequence.slots[g_sequence.next_ordinal % g_sequence.slot_count].ready = false;
+        g_sequence.next_ordinal++;
+        g_sequence.holding = false;
+        g_sequence.signal.notify_all();
+    }
+
+    // Without a seek, refresh continues with the very next frame, whatever
+    // stride the workers have been following.
+    if (!g_sequence.seeked && 1 != g_sequence.stride && g_sequence.last_frame >= 0)
+    {
+        _reset_sequence(guard, g_sequence.last_frame + 1, 1);
+    }
+
+    g_sequence.seeked = false;
+
+    long long frame = g_sequence.base_frame + g_sequence.next_ordinal * g_sequence.stride;
+
+    if (!g_sequence.slot_count || frame >= (long long) g_sequence.filenames.size())
+    {
+        return -1;
+    }
+
+    EVX_SEQUENCE_SLOT *slot = &g_sequence.slots[g_sequence.next_ordinal % g_sequence.slot_count];
+
+    while (!slot->ready && !slot->failed)
+    {
+        g_sequence.signal.wait(guard);
+    }
+
+    if (slot->failed)
+    {
+        return -1;
+    }
+
+    if (encoded_frame_size)
+    {
+        *encoded_frame_size = slot->encoded_size;
+    }
+
+    g_sequence.holding = true;
+    g_sequence.last_frame = frame;
+
+    return 0;
+}
+
+int sequence_seek_frame(long long frame)
+{
+    std::unique_lock<std::mutex> guard(g_sequence.lock);
+
+    if (!g_sequence.slot_count || frame < 0)
+    {
+        return -1;
+    }
+
+    // The frame after the one held is already on its way.
+    long long next_frame = g_sequence.base_frame + (g_sequence.next_ordinal + (g_sequence.holding ? 1 : 0)) * g_sequence.stride;
+
+    g_sequence.seeked = true;
+
+    if (frame == next_frame)
+    {
+        return 0;
+    }
+
+    long long stride = g_sequence.stride;
+
+    if (g_sequence.last_frame >= 0 && frame > g_sequence.last_frame)
+    {
+        stride = frame - g_sequence.last_frame;
+    }
+
+    _reset_sequence(guard, frame, stride);
+
+    return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,654 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_serve.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "evx_format.h"
+#include "evx_index.h"
+#include "evx_output.h"
+#include "evx_socket.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Requests are single text lines:
+//
+//   FRAMES <name> <first> <last>   returns frames [first, last] of a file.
+//   STATS                          returns the server metrics as text.
+//
+// Each response starts with an EVX_SERVE_RESPONSE_HEADER. A frame response
+// body is a self-contained EVX stream (a copy of the file header followed
+// by the requested records) that may be fed straight into decode or player.
+// Ranges are moved back to start at the nearest entry point, so that a 
+// fresh decoder can decode them, and the response reports the first frame
+// actually sent.
+
+#define EVX_SERVE_MAX_EVENTS            (64)
+#define EVX_SERVE_MAX_REQUEST           (512)
+#define EVX_SERVE_MAX_RESPONSE          (1024)
+#define EVX_SERVE_LATENCY_BUCKETS       (32)
+
+#define EVX_SERVE_STATUS_OK             (0)
+#define EVX_SERVE_STATUS_BAD_REQUEST    (1)
+#define EVX_SERVE_STATUS_UNKNOWN_FILE   (2)
+#define EVX_SERVE_STATUS_BAD_RANGE      (3)
+
+#pragma pack( push )
+#pragma pack( 2 )
+
+typedef struct EVX_SERVE_RESPONSE_HEADER
+{
+    uint8 magic[4];             // must be 'EVSR'
+    uint32 header_size;         // must be sizeof(EVX_SERVE_RESPONSE_HEADER)
+    int32 status;
+    uint64 first_frame;
+    uint64 frame_count;
+    uint64 body_size;           // bytes that follow this header.
+
+} EVX_SERVE_RESPONSE_HEADER;
+
+#pragma pack(pop)
+
+typedef struct EVX_SERVE_FILE
+{
+    const char *name;
+    int32 fd;
+    EVX_FRAME_INDEX index;
+
+} EVX_SERVE_FILE;
+
+typedef struct EVX_SERVE_CONNECTION
+{
+    int32 fd;
+    bool active;                // true while a response is being sent.
+
+    char request[EVX_SERVE_MAX_REQUEST];
+    uint32 request_size;
+
+    uint8 response[EVX_SERVE_MAX_RESPONSE];
+    uint32 response_size;
+    uint32 response_sent;
+
+    int32 body_fd;
+    off_t body_offset;
+    uint64 body_remaining;
+
+    int32 status;
+    uint64 request_start_us;
+
+} EVX_SERVE_CONNECTION;
+
+typedef struct EVX_SERVE_METRICS
+{
+    uint64 request_count;
+    uint64 error_count;
+    uint64 bytes_sent;
+    uint64 total_latency_us;
+    uint64 max_latency_us;
+    uint64 latency_histogram[EVX_SERVE_LATENCY_BUCKETS];
+
+} EVX_SERVE_METRICS;
+
+std::vector<EVX_SERVE_FILE> g_serve_files;
+EVX_SERVE_METRICS g_serve_metrics = {0};
+int32 g_epoll_fd = -1;
+volatile sig_atomic_t g_serve_running = 1;
+
+uint64 _get_monotonic_time_us()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64) time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+void _handle_stop_signal(int signal)
+{
+    g_serve_running = 0;
+}
+
+// Returns an upper bound for the requested latency percentile, taken from 
+// power of two microsecond buckets.
+uint64 _query_latency_percentile(const EVX_SERVE_METRICS &metrics, float percentile)
+{
+    uint64 target = (uint64) (metrics.request_count * percentile + 0.5f);
+    uint64 count = 0;
+
+    for (uint32 i = 0; i < EVX_SERVE_LATENCY_BUCKETS; i++)
+    {
+        count += metrics.latency_histogram[i];
+
+        if (count >= target && count)
+        {
+            return (uint64) 1 << i;
+        }
+    }
+
+    return metrics.max_latency_us;
+}
+
+uint32 _format_metrics(const EVX_SERVE_METRICS &metrics, char *dest, uint32 dest_size)
+{
+    uint64 average_us = metrics.request_count ? metrics.total_latency_us / metrics.request_count : 0;
+
+    return snprintf(dest, dest_size, 
+                    "requests %llu errors %llu bytes %llu latency_avg_us %llu latency_p50_us %llu "
+                    "latency_p99_us %llu latency_max_us %llu\n",
+                    metrics.request_count, metrics.error_count, metrics.bytes_sent, average_us,
+                    _query_latency_percentile(metrics, 0.5f), _query_latency_percentile(metrics, 0.99f),
+                    metrics.max_latency_us);
+}
+
+void _record_request(EVX_SERVE_CONNECTION *connection)
+{
+    uint64 latency = _get_monotonic_time_us() - connection->request_start_us;
+    uint32 bucket = 0;
+
+    while (bucket < EVX_SERVE_LATENCY_BUCKETS - 1 && ((uint64) 1 << bucket) < latency)
+    {
+        bucket++;
+    }
+
+    g_serve_metrics.request_count++;
+    g_serve_metrics.error_count += (EVX_SERVE_STATUS_OK != connection->status);
+    g_serve_metrics.total_latency_us += latency;
+    g_serve_metrics.max_latency_us = max(g_serve_metrics.max_latency_us, latency);
+    g_serve_metrics.latency_histogram[bucket]++;
+}
+
+EVX_SERVE_FILE *_find_serve_file(const char *name)
+{
+    for (uint32 i = 0; i < g_serve_files.size(); i++)
+    {
+        if (0 == strcmp(g_serve_files[i].name, name))
+        {
+            return &g_serve_files[i];
+        }
+    }
+
+    return NULL;
+}
+
+void _prepare_response(EVX_SERVE_CONNECTION *connection, const char *request)
+{
+    EVX_SERVE_RESPONSE_HEADER *response = (EVX_SERVE_RESPONSE_HEADER *) connection->response;
+    char name[EVX_SERVE_MAX_REQUEST];
+    unsigned long long first = 0;
+    unsigned long long last = 0;
+
+    memset(response, 0, sizeof(EVX_SERVE_RESPONSE_HEADER));
+    evx_set_magic(response->magic, "EVSR");
+    response->header_size = sizeof(EVX_SERVE_RESPONSE_HEADER);
+
+    connection->response_size = sizeof(EVX_SERVE_RESPONSE_HEADER);
+    connection->response_sent = 0;
+    connection->body_fd = -1;
+    connection->body_remaining = 0;
+    connection->status = EVX_SERVE_STATUS_OK;
+
+    if (0 == strcmp(request, "STATS"))
+    {
+        char *text = (char *) connection->response + connection->response_size;
+        uint32 text_size = _format_metrics(g_serve_metrics, text, EVX_SERVE_MAX_RESPONSE - connection->response_size);
+
+        response->body_size = text_size;
+        connection->response_size += text_size;
+        return;
+    }
+
+    if (3 != sscanf(request, "FRAMES %511s %llu %llu", name, &first, &last))
+    {
+        connection->status = response->status = EVX_SERVE_STATUS_BAD_REQUEST;
+        return;
+    }
+
+    EVX_SERVE_FILE *file = _find_serve_file(name);
+
+    if (!file)
+    {
+        connection->status = response->status = EVX_SERVE_STATUS_UNKNOWN_FILE;
+        return;
+    }
+
+    const EVX_FRAME_INDEX &index = file->index;
+    last = min(last, (unsigned long long) index.frames.size() - 1);
+
+    if (index.frames.empty() || first > last)
+    {
+        connection->status = response->status = EVX_SERVE_STATUS_BAD_RANGE;
+        return;
+    }
+
+    first = evx_query_entry_point(index, first);
+
+    // The body opens with a file header describing just this range, so 
+    // that the response is itself a playable stream.
+    EVX_MEDIA_FILE_HEADER header = index.header;
+    header.frame_count = last - first + 1;
+    memcpy(connection->response + connection->response_size, &header, sizeof(header));
+    connection->response_size += sizeof(header);
+
+    connection->body_fd = file->fd;
+    connection->body_offset = index.frames[first].offset;
+    connection->body_remaining = evx_query_frame_range_size(index, first, last);
+
+    response->first_frame = first;
+    response->frame_count = header.frame_count;
+    response->body_size = sizeof(header) + connection->body_remaining;
+}
+
+void _close_connection(EVX_SERVE_CONNECTION *connection)
+{
+    epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    delete connection;
+}
+
+void _set_connection_events(EVX_SERVE_CONNECTION *connection, uint32 events)
+{
+    struct epoll_event event;
+    event.events = events | EPOLLRDHUP;
+    event.data.ptr = connection;
+    epoll_ctl(g_epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+// Returns false if the connection failed and must be closed.
+bool _send_response(EVX_SERVE_CONNECTION *connection)
+{
+    while (connection->response_sent < connection->response_size)
+    {
+        ssize_t count = send(connection->fd, connection->response + connection->response_sent, 
+                             connection->response_size - connection->response_sent, MSG_NOSIGNAL);
+
+        if (count < 0)
+        {
+            return (EAGAIN == errno || EWOULDBLOCK == errno);
+        }
+
+        connection->response_sent += count;
+        g_serve_metrics.bytes_sent += count;
+    }
+
+    // Frame data moves from the page cache to the socket without ever 
+    // being copied into user space.
+    while (connection->body_remaining)
+    {
+        ssize_t count = sendfile(connection->fd, connection->body_fd, &connection->body_offset, 
+                                 min(connection->body_remaining, (uint64) 0x7FFFF000));
+
+        if (count < 0)
+        {
+            return (EAGAIN == errno || EWOULDBLOCK == errno);
+        }
+
+        if (0 == count)
+        {
+            return false;
+        }
+
+        connection->body_remaining -= count;
+        g_serve_metrics.bytes_sent += count;
+    }
+
+    _record_request(connection);
+    connection->active = false;
+
+    return true;
+}
+
+// Consumes complete request lines and starts the next response. Returns 
+// false if the connection must be closed.
+bool _process_requests(EVX_SERVE_CONNECTION *connection)
+{
+    while (!connection->active)
+    {
+        char *line_end = (char *) memchr(connection->request, '\n', connection->request_size);
+
+        if (!line_end)
+        {
+            // Requests are short, so a full buffer without a newline is junk.
+            return connection->request_size < EVX_SERVE_MAX_REQUEST;
+        }
+
+        uint32 line_size = line_end - connection->request + 1;
+        *line_end = 0;
+
+        if (line_end > connection->request && '\r' == line_end[-1])
+        {
+            line_end[-1] = 0;
+        }
+
+        connection->request_start_us = _get_monotonic_time_us();
+        connection->active = true;
+        _prepare_response(connection, connection->request);
+
+        // Keep any pipelined requests for later.
+        connection->request_size -= line_size;
+        memmove(connection->request, connection->request + line_size, connection->request_size);
+
+        if (!_send_response(connection))
+        {
+            return false;
+        }
+    }
+
+    _set_connection_events(connection, connection->active ? EPOLLOUT : EPOLLIN);
+
+    return true;
+}
+
+bool _read_requests(EVX_SERVE_CONNECTION *connection)
+{
+    while (connection->request_size < EVX_SERVE_MAX_REQUEST)
+    {
+        ssize_t count = recv(connection->fd, connection->request + connection->request_size, 
+                             EVX_SERVE_MAX_REQUEST - connection->request_size, 0);
+
+        if (count < 0)
+        {
+            return (EAGAIN == errno || EWOULDBLOCK == errno);
+        }
+
+        if (0 == count)
+        {
+            return false;
+        }
+
+        connection->request_size += count;
+    }
+
+    return true;
+}
+
+void _handle_connection_event(EVX_SERVE_CONNECTION *connection, uint32 events)
+{
+    if (events & (EPOLLERR | EPOLLHUP))
+    {
+        _close_connection(connection);
+        return;
+    }
+
+    if ((events & EPOLLOUT) && connection->active && !_send_response(connection))
+    {
+        _close_connection(connection);
+        return;
+    }
+
+    if ((events & (EPOLLIN | EPOLLRDHUP)) && !_read_requests(connection) && !connection->active)
+    {
+        // The peer has gone away and there is nothing left to send.
+        if (0 == connection->request_size || !memchr(connection->request, '\n', connection->request_size))
+        {
+            _close_connection(connection);
+            return;
+        }
+    }
+
+    if (!_process_requests(connection))
+    {
+        _close_connection(connection);
+    }
+}
+
+void _accept_connections(int32 listen_fd)
+{
+    while (true)
+    {
+        int32 fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            return;
+        }
+
+        EVX_SERVE_CONNECTION *connection = new EVX_SERVE_CONNECTION;
+        memset(connection, 0, sizeof(EVX_SERVE_CONNECTION));
+        connection->fd = fd;
+        connection->body_fd = -1;
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = connection;
+
+        if (0 != epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, fd, &event))
+        {
+            close(fd);
+            delete connection;
+        }
+    }
+}
+
+// Addresses of the form [host]:port select TCP, anything else is treated 
+// as a Unix socket path. TCP listeners bind to the loopback address unless
+// a host is given explicitly.
+int32 _run_server(const char *address, int32 file_count, char **filenames)
+{
+    struct epoll_event events[EVX_SERVE_MAX_EVENTS];
+    struct epoll_event listen_event;
+
+    for (int32 i = 0; i < file_count; i++)
+    {
+        EVX_SERVE_FILE file;
+        const char *base_name = strrchr(filenames[i], '/');
+
+        file.name = base_name ? base_name + 1 : filenames[i];
+        file.fd = open(filenames[i], O_RDONLY | O_CLOEXEC);
+
+        if (file.fd < 0 || evx_build_frame_index(filenames[i], &file.index) < 0)
+        {
+            evx_msg("Failed to index %s", filenames[i]);
+            return -1;
+        }
+
+        evx_msg("Serving %s as %s (%llu frames)", filenames[i], file.name, (uint64) file.index.frames.size());
+        g_serve_files.push_back(file);
+    }
+
+    int32 listen_fd = evx_open_socket(address, true);
+
+    if (listen_fd < 0 || 0 != listen(listen_fd, 64))
+    {
+        evx_msg("Failed to listen on %s", address);
+        return -1;
+    }
+
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = NULL;
+    epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, _handle_stop_signal);
+    signal(SIGTERM, _handle_stop_signal);
+
+    evx_msg("Listening on %s", address);
+
+    while (g_serve_running)
+    {
+        int32 count = epoll_wait(g_epoll_fd, events, EVX_SERVE_MAX_EVENTS, 1000);
+
+        for (int32 i = 0; i < count; i++)
+        {
+            if (!events[i].data.ptr)
+            {
+                _accept_connections(listen_fd);
+                continue;
+            }
+
+            _handle_connection_event((EVX_SERVE_CONNECTION *) events[i].data.ptr, events[i].events);
+        }
+    }
+
+    char metrics[EVX_SERVE_MAX_RESPONSE];
+    _format_metrics(g_serve_metrics, metrics, sizeof(metrics));
+    evx_msg("Final metrics: %s", metrics);
+
+    close(listen_fd);
+    close(g_epoll_fd);
+
+    if (!strchr(address, ':'))
+    {
+        unlink(address);
+    }
+
+    return 0;
+}
+
+bool _receive_all(int32 fd, void *dest, uint64 size)
+{
+    uint8 *data = (uint8 *) dest;
+
+    while (size)
+    {
+        ssize_t count = recv(fd, data, size, 0);
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        data += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+// A minimal client used to exercise the server locally. The body of the 
+// response is written to dest_filename, which may be "-" for stdout.
+int32 _run_client(const char *address, const char *request, const char *dest_filename)
+{
+    EVX_SERVE_RESPONSE_HEADER response;
+    uint64 start_time = _get_monotonic_time_us();
+    int32 fd = evx_open_socket(address, false);
+    uint8 *buffer = NULL;
+
+    if (fd < 0)
+    {
+        evx_msg("Failed to connect to %s", address);
+        return -1;
+    }
+
+    FILE *dest = evx_open_output_file(dest_filename);
+
+    if (!dest)
+    {
+        evx_msg("Error opening dest file %s", dest_filename);
+        close(fd);
+        return -1;
+    }
+
+    if ((ssize_t) strlen(request) != send(fd, request, strlen(request), MSG_NOSIGNAL) ||
+        !_receive_all(fd, &response, sizeof(response)) || !evx_check_magic(response.magic, "EVSR"))
+    {
+        evx_msg("Invalid response from %s", address);
+        fclose(dest);
+        close(fd);
+        return -1;
+    }
+
+    buffer = new uint8[EVX_MB];
+
+    for (uint64 remaining = response.body_size; remaining;)
+    {
+        uint32 count = (uint32) min(remaining, (uint64) EVX_MB);
+
+        if (!_receive_all(fd, buffer, count) || 1 != fwrite(buffer, count, 1, dest))
+        {
+            evx_msg("Failed to receive the response body");
+            break;
+        }
+
+        remaining -= count;
+    }
+
+    evx_msg("Status %i, frames %llu..%llu, %llu bytes in %.3f ms", response.status, response.first_frame,
+            response.first_frame + response.frame_count - (response.frame_count ? 1 : 0), response.body_size,
+            (_get_monotonic_time_us() - start_time) / 1000.0f);
+
+    delete [] buffer;
+    fclose(dest);
+    close(fd);
+
+    return (EVX_SERVE_STATUS_OK == response.status) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    char request[EVX_SERVE_MAX_REQUEST];
+
+    if (argc >= 7 && 0 == strcmp(argv[1], "-fetch"))
+    {
+        snprintf(request, sizeof(request), "FRAMES %s %s %s\n", argv[3], argv[4], argv[5]);
+        return _run_client(argv[2], request, argv[6]) < 0 ? 1 : 0;
+    }
+
+    if (argc >= 3 && 0 == strcmp(argv[1], "-stats"))
+    {
+        return _run_client(argv[2], "STATS\n", "-") < 0 ? 1 : 0;
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    if (argc < 3)
+    {
+        evx_msg("Required syntax: serve <socket path|[host]:port> <evx file> [<evx file> ...]");
+        evx_msg("                 serve -fetch <socket path|[host]:port> <name> <first> <last> <output_filename|->");
+        evx_msg("                 serve -stats <socket path|[host]:port>");
+        return 0;
+    }
+
+    return _run_server(argv[1], argc - 2, argv + 2) < 0 ? 1 : 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+    evx_msg("serve requires epoll and sendfile, and is only available on Linux");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,441 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_shm.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_shm.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define EVX_SHM_ALIGNMENT       (4096)
+#define EVX_SHM_DATA_OFFSET     (64)
+
+static_assert(std::atomic<uint64>::is_always_lock_free, "shared frame rings require lock-free 64 bit atomics");
+
+uint64 _align_shm_size(uint64 size)
+{
+    return (size + EVX_SHM_ALIGNMENT - 1) & ~((uint64) EVX_SHM_ALIGNMENT - 1);
+}
+
+EVX_SHM_SLOT_HEADER *_get_shm_slot(const uint8 *memory, const EVX_SHM_HEADER *header, uint64 frame_number)
+{
+    uint64 slot_offset = _align_shm_size(sizeof(EVX_SHM_HEADER)) + (frame_number % header->slot_count) * header->slot_size;
+    return (EVX_SHM_SLOT_HEADER *) (memory + slot_offset);
+}
+
+int32 _create_shared_memory(uint64 size)
+{
+    int32 fd = -1;
+
+#if defined(__linux__)
+    fd = memfd_create("evx-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    char name[64];
+    sprintf(name, "/evx-frames-%i", (int32) getpid());
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    shm_unlink(name);
+#endif
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (0 != ftruncate(fd, size))
+    {
+        close(fd);
+        return -1;
+    }
+
+#if defined(__linux__)
+    // Readers rely on the mapping size, so prevent it from ever changing.
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+
+    return fd;
+}
+
+bool _send_shm_fd(int32 socket_fd, int32 fd)
+{
+    char data = 'E';
+    char control[CMSG_SPACE(sizeof(int32))];
+    struct iovec io = { &data, 1 };
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr *control_header = CMSG_FIRSTHDR(&message);
+    control_header->cmsg_level = SOL_SOCKET;
+    control_header->cmsg_type = SCM_RIGHTS;
+    control_header->cmsg_len = CMSG_LEN(sizeof(int32));
+    memcpy(CMSG_DATA(control_header), &fd, sizeof(int32));
+
+    return 1 == sendmsg(socket_fd, &message, 0);
+}
+
+int32 _receive_shm_fd(int32 socket_fd)
+{
+    char data = 0;
+    char control[CMSG_SPACE(sizeof(int32))];
+    struct iovec io = { &data, 1 };
+    struct msghdr message;
+    int32 fd = -1;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (1 != recvmsg(socket_fd, &message, 0))
+    {
+        return -1;
+    }
+
+    struct cmsghdr *control_header = CMSG_FIRSTHDR(&message);
+
+    if (!control_header || SOL_SOCKET != control_header->cmsg_level || SCM_RIGHTS != control_header->cmsg_type)
+    {
+        return -1;
+    }
+
+    memcpy(&fd, CMSG_DATA(control_header), sizeof(int32));
+
+    return fd;
+}
+
+void _shm_accept_thread_main(EVX_SHM_PUBLISHER *publisher)
+{
+    struct pollfd listener = { publisher->listen_fd, POLLIN, 0 };
+
+    while (!publisher->closing)
+    {
+        // Wake periodically so that close requests are noticed promptly.
+        if (poll(&listener, 1, 100) <= 0)
+        {
+            continue;
+        }
+
+        int32 client_fd = accept(publisher->listen_fd, NULL, NULL);
+
+        if (client_fd < 0)
+        {
+            continue;
+        }
+
+        if (!_send_shm_fd(client_fd, publisher->memory_fd))
+        {
+            evx_msg("Failed to hand the frame ring to a reader");
+        }
+
+        close(client_fd);
+    }
+}
+
+int32 _open_unix_socket(const char *socket_path, struct sockaddr_un *address)
+{
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+    {
+        evx_msg("Socket path %s is too long", socket_path);
+        return -1;
+    }
+
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socket_path);
+
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+int32 evx_shm_open_publisher(const char *socket_path, uint32 width, uint32 height, uint32 row_pitch, float frame_rate, 
+                             uint32 slot_count, EVX_SHM_PUBLISHER *publisher)
+{
+    struct sockaddr_un address;
+    uint32 slot_size = _align_shm_size(EVX_SHM_DATA_OFFSET + row_pitch * height);
+
+    publisher->memory_fd = -1;
+    publisher->listen_fd = -1;
+    publisher->memory = NULL;
+    publisher->header = NULL;
+    publisher->closing = false;
+    publisher->memory_size = _align_shm_size(sizeof(EVX_SHM_HEADER)) + (uint64) slot_size * slot_count;
+    publisher->socket_path[0] = 0;
+
+    publisher->memory_fd = _create_shared_memory(publisher->memory_size);
+
+    if (publisher->memory_fd < 0)
+    {
+        evx_msg("Failed to create shared frame memory");
+        return -1;
+    }
+
+    publisher->memory = (uint8 *) mmap(NULL, publisher->memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, publisher->memory_fd, 0);
+
+    if (MAP_FAILED == publisher->memory)
+    {
+        evx_msg("Failed to map shared frame memory");
+        publisher->memory = NULL;
+        evx_shm_close_publisher(publisher);
+        return -1;
+    }
+
+    // Freshly truncated memory is zeroed, so every slot sequence starts 
+    // out as "never written".
+    publisher->header = (EVX_SHM_HEADER *) publisher->memory;
+    evx_set_magic(publisher->header->magic, "EVSM");
+    publisher->header->header_size = sizeof(EVX_SHM_HEADER);
+    publisher->header->frame_width = width;
+    publisher->header->frame_height = height;
+    publisher->header->row_pitch = row_pitch;
+    publisher->header->slot_count = slot_count;
+    publisher->header->slot_size = slot_size;
+    publisher->header->data_offset = EVX_SHM_DATA_OFFSET;
+    publisher->header->frame_rate = frame_rate;
+    publisher->header->frames_published.store(0, std::memory_order_release);
+
+    publisher->listen_fd = _open_unix_socket(socket_path, &address);
+
+    if (publisher->listen_fd < 0)
+    {
+        evx_shm_close_publisher(publisher);
+        return -1;
+    }
+
+    unlink(socket_path);
+
+    if (0 != bind(publisher->listen_fd, (struct sockaddr *) &address, sizeof(address)) ||
+        0 != listen(publisher->listen_fd, 16))
+    {
+        evx_msg("Failed to listen on %s", socket_path);
+        evx_shm_close_publisher(publisher);
+        return -1;
+    }
+
+    strcpy(publisher->socket_path, socket_path);
+    publisher->thread = std::thread(_shm_accept_thread_main, publisher);
+
+    return 0;
+}
+
+void evx_shm_close_publisher(EVX_SHM_PUBLISHER *publisher)
+{
+    publisher->closing = true;
+
+    if (publisher->thread.joinable())
+    {
+        publisher->thread.join();
+    }
+
+    if (publisher->listen_fd >= 0)
+    {
+        close(publisher->listen_fd);
+        unlink(publisher->socket_path);
+        publisher->listen_fd = -1;
+    }
+
+    // Readers keep their own mappings, so they may finish with the last 
+    // frames after the publisher has gone away.
+    if (publisher->memory)
+    {
+        munmap(publisher->memory, publisher->memory_size);
+        publisher->memory = NULL;
+        publisher->header = NULL;
+    }
+
+    if (publisher->memory_fd >= 0)
+    {
+        close(publisher->memory_fd);
+        publisher->memory_fd = -1;
+    }
+}
+
+void evx_shm_publish(EVX_SHM_PUBLISHER *publisher, const uint8 *frame_data, uint64 frame_index)
+{
+    EVX_SHM_HEADER *header = publisher->header;
+    uint64 frame_number = header->frames_published.load(std::memory_order_relaxed);
+    EVX_SHM_SLOT_HEADER *slot = _get_shm_slot(publisher->memory, header, frame_number);
+
+    slot->sequence.store(2 * frame_number + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy((uint8 *) slot + header->data_offset, frame_data, header->row_pitch * header->frame_height);
+    slot->frame_index = frame_index;
+
+    slot->sequence.store(2 * frame_number + 2, std::memory_order_release);
+    header->frames_published.store(frame_number + 1, std::memory_order_release);
+}
+
+int32 evx_shm_open_client(const char *socket_path, EVX_SHM_CLIENT *client)
+{
+    struct sockaddr_un address;
+    struct stat memory_stat;
+    int32 socket_fd = _open_unix_socket(socket_path, &address);
+    int32 memory_fd = -1;
+
+    client->memory = NULL;
+    client->header = NULL;
+    client->memory_size = 0;
+
+    if (socket_fd < 0)
+    {
+        return -1;
+    }
+
+    // Not finding a publisher is left to the caller to report.
+    if (0 != connect(socket_fd, (struct sockaddr *) &address, sizeof(address)))
+    {
+        close(socket_fd);
+        return -1;
+    }
+
+    memory_fd = _receive_shm_fd(socket_fd);
+    close(socket_fd);
+
+    if (memory_fd < 0 || 0 != fstat(memory_fd, &memory_stat))
+    {
+        evx_msg("Failed to receive a frame ring from %s", socket_path);
+        if (memory_fd >= 0) close(memory_fd);
+        return -1;
+    }
+
+    client->memory_size = memory_stat.st_size;
+    client->memory = (const uint8 *) mmap(NULL, client->memory_size, PROT_READ, MAP_SHARED, memory_fd, 0);
+    close(memory_fd);
+
+    if (MAP_FAILED == client->memory)
+    {
+        client->memory = NULL;
+        return -1;
+    }
+
+    client->header = (const EVX_SHM_HEADER *) client->memory;
+
+    if (!evx_check_magic(client->header->magic, "EVSM") || 
+        sizeof(EVX_SHM_HEADER) != client->header->header_size ||
+        client->memory_size < _align_shm_size(sizeof(EVX_SHM_HEADER)) + (uint64) client->header->slot_size * client->header->slot_count)
+    {
+        evx_msg("Invalid frame ring received from %s", socket_path);
+        evx_shm_close_client(client);
+        return -1;
+    }
+
+    return 0;
+}
+
+void evx_shm_close_client(EVX_SHM_CLIENT *client)
+{
+    if (client->memory)
+    {
+        munmap((void *) client->memory, client->memory_size);
+    }
+
+    client->memory = NULL;
+    client->header = NULL;
+}
+
+uint64 evx_shm_query_published(const EVX_SHM_CLIENT *client)
+{
+    return client->header->frames_published.load(std::memory_order_acquire);
+}
+
+const uint8 *evx_shm_acquire_frame(const EVX_SHM_CLIENT *client, uint64 frame_number, uint64 *sequence, uint64 *frame_index)
+{
+    if (frame_number >= evx_shm_query_published(client))
+    {
+        return NULL;
+    }
+
+    EVX_SHM_SLOT_HEADER *slot = _get_shm_slot(client->memory, client->header, frame_number);
+    *sequence = slot->sequence.load(std::memory_order_acquire);
+
+    // The slot has already been reused for a later frame.
+    if (*sequence != 2 * frame_number + 2)
+    {
+        return NULL;
+    }
+
+    *frame_index = slot->frame_index;
+
+    return (const uint8 *) slot + client->header->data_offset;
+}
+
+bool evx_shm_release_frame(const EVX_SHM_CLIENT *client, uint64 frame_number, uint64 sequence)
+{
+    EVX_SHM_SLOT_HEADER *slot = _get_shm_slot(client->memory, client->header, frame_number);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return sequence == slot->sequence.load(std::memory_order_relaxed);
+}
+
+#else
+
+int32 evx_shm_open_publisher(const char *socket_path, uint32 width, uint32 height, uint32 row_pitch, float frame_rate, 
+                             uint32 slot_count, EVX_SHM_PUBLISHER *publisher)
+{
+    evx_msg("Shared frame output is not supported on this platform");
+    return -1;
+}
+
+void evx_shm_close_publisher(EVX_SHM_PUBLISHER *publisher) {}
+void evx_shm_publish(EVX_SHM_PUBLISHER *publisher, const uint8 *frame_data, uint64 frame_index) {}
+
+int32 evx_shm_open_client(const char *socket_path, EVX_SHM_CLIENT *client)
+{
+    evx_msg("Shared frame output is not supported on this platform");
+    return -1;
+}
+
+void evx_shm_close_client(EVX_SHM_CLIENT *client) {}
+uint64 evx_shm_query_published(const EVX_SHM_CLIENT *client) { return 0; }
+
+const uint8 *evx_shm_acquire_frame(const EVX_SHM_CLIENT *client, uint64 frame_number, uint64 *sequence, uint64 *frame_index)
+{
+    return NULL;
+}
+
+bool evx_shm_release_frame(const EVX_SHM_CLIENT *client, uint64 frame_number, uint64 sequence)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,121 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_shm.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_SHM_H__
+#define __EVX_SHM_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+#include <atomic>
+#include <thread>
+
+// Decoded frames are published into a ring of slots within a single shared
+// memory object. Each slot is guarded by a sequence counter that is odd 
+// while the slot is being written, so any number of readers can map the 
+// ring read-only and use frames in place without locks: a reader validates
+// the sequence after it is done with a frame and discards it on mismatch.
+// The memory object is handed to readers over a Unix domain socket.
+
+#define EVX_SHM_DEFAULT_SLOT_COUNT      (4)
+
+typedef struct EVX_SHM_HEADER
+{
+    uint8 magic[4];                     // must be 'EVSM'
+    uint32 header_size;                 // must be sizeof(EVX_SHM_HEADER)
+    uint32 frame_width;
+    uint32 frame_height;
+    uint32 row_pitch;
+    uint32 slot_count;
+    uint32 slot_size;                   // stride between slots, in bytes.
+    uint32 data_offset;                 // offset of frame data within a slot.
+    float frame_rate;
+    std::atomic<uint64> frames_published;
+
+} EVX_SHM_HEADER;
+
+typedef struct EVX_SHM_SLOT_HEADER
+{
+    std::atomic<uint64> sequence;       // 2 * (frame + 1) once complete.
+    uint64 frame_index;
+
+} EVX_SHM_SLOT_HEADER;
+
+typedef struct EVX_SHM_PUBLISHER
+{
+    int32 memory_fd;
+    int32 listen_fd;
+    uint64 memory_size;
+    uint8 *memory;
+    EVX_SHM_HEADER *header;
+    char socket_path[108];
+
+    std::atomic<bool> closing;
+    std::thread thread;
+
+} EVX_SHM_PUBLISHER;
+
+typedef struct EVX_SHM_CLIENT
+{
+    uint64 memory_size;
+    const uint8 *memory;
+    const EVX_SHM_HEADER *header;
+
+} EVX_SHM_CLIENT;
+
+// Creates the shared ring for frames of the given layout and begins 
+// handing it to readers that connect to socket_path.
+int32 evx_shm_open_publisher(const char *socket_path, uint32 width, uint32 height, uint32 row_pitch, float frame_rate, 
+                             uint32 slot_count, EVX_SHM_PUBLISHER *publisher);
+void evx_shm_close_publisher(EVX_SHM_PUBLISHER *publisher);
+
+// Copies a decoded frame into the next slot and publishes it.
+void evx_shm_publish(EVX_SHM_PUBLISHER *publisher, const uint8 *frame_data, uint64 frame_index);
+
+// Connects to a publisher and maps its ring read-only.
+int32 evx_shm_open_client(const char *socket_path, EVX_SHM_CLIENT *client);
+void evx_shm_close_client(EVX_SHM_CLIENT *client);
+
+// Returns the number of frames published so far.
+uint64 evx_shm_query_published(const EVX_SHM_CLIENT *client);
+
+// Returns a pointer to frame_number (0 based) within the ring, or NULL if
+// it is not available, along with the index of the frame within its file.
+// Both stay valid until the publisher wraps around to the slot, which 
+// evx_shm_release_frame reports.
+const uint8 *evx_shm_acquire_frame(const EVX_SHM_CLIENT *client, uint64 frame_number, uint64 *sequence, uint64 *frame_index);
+
+// Returns true if the frame acquired with sequence was not overwritten 
+// while it was in use.
+bool evx_shm_release_frame(const EVX_SHM_CLIENT *client, uint64 frame_number, uint64 sequence);
+
+#endif // __EVX_SHM_H__
@@ -0,0 +1,244 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_shmcheck.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "cairo/image.h"
+#include "evx_cache.h"
+#include "evx_format.h"
+#include "evx_shm.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Attaches to the frame ring of a running player (see -share) and follows
+// it the way any reader would: each frame is copied out of its slot, and 
+// kept only if the slot was not rewritten meanwhile. Given the file that 
+// is being played, every frame read is also compared with the frame of the
+// same index decoded from the file.
+
+#define EVX_SHMCHECK_DEFAULT_TIMEOUT    (2.0)
+#define EVX_SHMCHECK_MAX_REPORTS        (8)
+
+typedef struct EVX_SHMCHECK_STATS
+{
+    uint64 checked_count;
+    uint64 missed_count;        // overwritten before they could be read.
+    uint64 torn_count;          // overwritten while they were being read.
+    uint64 mismatch_count;
+
+} EVX_SHMCHECK_STATS;
+
+double _get_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The player only creates its socket once the first file is open, so keep
+// trying until the timeout.
+int32 _connect_client(const char *socket_path, double timeout, EVX_SHM_CLIENT *client)
+{
+    double deadline = _get_seconds() + timeout;
+
+    while (0 != evx_shm_open_client(socket_path, client))
+    {
+        if (_get_seconds() >= deadline)
+        {
+            return -1;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    return 0;
+}
+
+bool _compare_frame(const EVX_SHM_HEADER *header, const uint8 *frame, image *reference)
+{
+    for (uint32 r = 0; r < header->frame_height; r++)
+    {
+        if (0 != memcmp(frame + r * header->row_pitch, reference->query_data() + r * reference->query_row_pitch(), header->frame_width * 3))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    EVX_SHM_CLIENT client;
+    EVX_FRAME_CACHE cache;
+    EVX_SHMCHECK_STATS stats = {0};
+    double timeout = EVX_SHMCHECK_DEFAULT_TIMEOUT;
+    int32 i = 1;
+
+    for (; i + 1 < argc && '-' == argv[i][0]; i += 2)
+    {
+        if (0 == strcmp(argv[i], "-timeout"))
+        {
+            timeout = atof(argv[i + 1]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    if (argc - i < 1 || argc - i > 2 || timeout <= 0.0)
+    {
+        evx_msg("Required syntax: shmcheck [-timeout <seconds>] <socket path> [reference_filename]");
+        return 0;
+    }
+
+    const char *socket_path = argv[i];
+    const char *reference_filename = (argc - i > 1) ? argv[i + 1] : NULL;
+
+    if (_connect_client(socket_path, timeout, &client) < 0)
+    {
+        evx_msg("Failed to attach to %s", socket_path);
+        return 1;
+    }
+
+    const EVX_SHM_HEADER *header = client.header;
+
+    if (reference_filename)
+    {
+        if (evx_cache_open(reference_filename, EVX_FRAME_CACHE_DEFAULT_SIZE, header->frame_width, header->frame_height, &cache) < 0)
+        {
+            evx_msg("Failed to open %s", reference_filename);
+            evx_shm_close_client(&client);
+            return 1;
+        }
+
+        if (cache.index.header.frame_width != header->frame_width || cache.index.header.frame_height != header->frame_height)
+        {
+            evx_msg("Dimensions of %s do not match the shared frames", reference_filename);
+            evx_cache_close(&cache);
+            evx_shm_close_client(&client);
+            return 1;
+        }
+    }
+
+    evx_msg("Attached to %s: %ux%u frames in %u slots", socket_path, header->frame_width, header->frame_height, header->slot_count);
+
+    std::vector<uint8> frame(header->row_pitch * header->frame_height);
+    image reference_image;
+    uint64 frame_number = evx_shm_query_published(&client);
+    uint64 last_index = 0;
+    double last_progress = _get_seconds();
+
+    if (reference_filename)
+    {
+        create_image(EVX_IMAGE_FORMAT_R8G8B8, header->frame_width, header->frame_height, &reference_image);
+    }
+
+    // Reading stops once nothing has been published for the timeout.
+    while (true)
+    {
+        uint64 published = evx_shm_query_published(&client);
+
+        if (frame_number >= published)
+        {
+            if (_get_seconds() - last_progress >= timeout)
+            {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        last_progress = _get_seconds();
+
+        // Slots that have been reused since are skipped to the newest frame.
+        if (published - frame_number > header->slot_count)
+        {
+            stats.missed_count += published - 1 - frame_number;
+            frame_number = published - 1;
+        }
+
+        uint64 sequence = 0;
+        uint64 frame_index = 0;
+        const uint8 *data = evx_shm_acquire_frame(&client, frame_number, &sequence, &frame_index);
+
+        if (!data)
+        {
+            stats.missed_count++;
+            frame_number++;
+            continue;
+        }
+
+        memcpy(&frame[0], data, frame.size());
+
+        if (!evx_shm_release_frame(&client, frame_number, sequence))
+        {
+            stats.torn_count++;
+            frame_number++;
+            continue;
+        }
+
+        if (reference_filename)
+        {
+            EVX_MEDIA_FRAME_HEADER frame_header;
+            int32 direction = (frame_index < last_index) ? -1 : 1;
+            bool matched = frame_index < evx_cache_query_frame_count(&cache) &&
+                           0 == evx_cache_fetch(&cache, frame_index, direction, &reference_image, &frame_header) &&
+                           _compare_frame(header, &frame[0], &reference_image);
+
+            if (!matched && stats.mismatch_count++ < EVX_SHMCHECK_MAX_REPORTS)
+            {
+                evx_msg("Shared frame %llu (frame %llu of %s) does not match", frame_number, frame_index, reference_filename);
+            }
+        }
+
+        last_index = frame_index;
+        stats.checked_count++;
+        frame_number++;
+    }
+
+    evx_msg("Read %llu frames: %llu missed, %llu overwritten while reading, %llu mismatched", 
+        stats.checked_count, stats.missed_count, stats.torn_count, stats.mismatch_count);
+
+    if (reference_filename)
+    {
+        destroy_image(&reference_image);
+        evx_cache_close(&cache);
+    }
+
+    evx_shm_close_client(&client);
+
+    return (stats.mismatch_count || !stats.checked_count) ? 1 : 0;
+}
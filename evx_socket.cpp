@@ -0,0 +1,138 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_socket.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_socket.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int32 _create_socket(int32 domain)
+{
+    int32 fd = socket(domain, SOCK_STREAM, 0);
+
+    if (fd >= 0)
+    {
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    }
+
+    return fd;
+}
+
+int32 evx_open_socket(const char *address, bool listener)
+{
+    const char *port = strrchr(address, ':');
+    int32 fd = -1;
+
+    if (port)
+    {
+        struct sockaddr_in inet_address;
+        char host[64] = "127.0.0.1";
+        uint32 host_size = port - address;
+
+        if (host_size && host_size < sizeof(host) && strncmp(address, "localhost", host_size))
+        {
+            memcpy(host, address, host_size);
+            host[host_size] = 0;
+        }
+
+        memset(&inet_address, 0, sizeof(inet_address));
+        inet_address.sin_family = AF_INET;
+        inet_address.sin_port = htons(atoi(port + 1));
+
+        if (1 != inet_pton(AF_INET, host, &inet_address.sin_addr))
+        {
+            evx_msg("Invalid address %s", address);
+            return -1;
+        }
+
+        fd = _create_socket(AF_INET);
+
+        if (fd >= 0 && listener)
+        {
+            int32 enable = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+            if (0 != bind(fd, (struct sockaddr *) &inet_address, sizeof(inet_address)))
+            {
+                close(fd);
+                return -1;
+            }
+        }
+        else if (fd >= 0 && 0 != connect(fd, (struct sockaddr *) &inet_address, sizeof(inet_address)))
+        {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    struct sockaddr_un unix_address;
+
+    if (strlen(address) >= sizeof(unix_address.sun_path))
+    {
+        evx_msg("Socket path %s is too long", address);
+        return -1;
+    }
+
+    memset(&unix_address, 0, sizeof(unix_address));
+    unix_address.sun_family = AF_UNIX;
+    strcpy(unix_address.sun_path, address);
+
+    fd = _create_socket(AF_UNIX);
+
+    if (fd >= 0 && listener)
+    {
+        unlink(address);
+
+        if (0 != bind(fd, (struct sockaddr *) &unix_address, sizeof(unix_address)))
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else if (fd >= 0 && 0 != connect(fd, (struct sockaddr *) &unix_address, sizeof(unix_address)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+#endif
@@ -0,0 +1,105 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_source.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "evx_source.h"
+
+#include <sys/stat.h>
+
+int32 evx_open_ffmpeg_source(char *filename, int32 *width, int32 *height, EVX_FRAME_SOURCE *source)
+{
+    int32 format = 0;
+
+    ffmpeg_initialize();
+
+    // A file that fails to open has already been cleaned up.
+    if (0 != ffmpeg_play_file(filename, (int*) &format, (int*) width, (int*) height))
+    {
+        evx_msg("Failed to open content file %s", filename);
+        return -1;
+    }
+
+    source->refresh = ffmpeg_refresh;
+    source->seek_frame = ffmpeg_seek_frame;
+    source->copy_current_frame = ffmpeg_copy_current_frame;
+    source->get_frame_time = ffmpeg_get_frame_time;
+    source->get_frame_count = ffmpeg_get_frame_count;
+    source->get_frame_rate = ffmpeg_get_frame_rate;
+    source->deinitialize = ffmpeg_deinitialize;
+
+    return 0;
+}
+
+int32 evx_open_rawvideo_source(const char *filename, int32 width, int32 height, float frame_rate, EVX_FRAME_SOURCE *source)
+{
+    if (0 != rawvideo_play_file(filename, width, height, frame_rate))
+    {
+        evx_msg("Failed to open raw content file %s", filename);
+        return -1;
+    }
+
+    source->refresh = rawvideo_refresh;
+    source->seek_frame = rawvideo_seek_frame;
+    source->copy_current_frame = rawvideo_copy_current_frame;
+    source->get_frame_time = rawvideo_get_frame_time;
+    source->get_frame_count = rawvideo_get_frame_count;
+    source->get_frame_rate = rawvideo_get_frame_rate;
+    source->deinitialize = rawvideo_deinitialize;
+
+    return 0;
+}
+
+bool evx_is_image_sequence(const char *filename)
+{
+    struct stat file_stat;
+
+    return 0 == stat(filename, &file_stat) && S_IFDIR == (file_stat.st_mode & S_IFMT);
+}
+
+int32 evx_open_sequence_source(const char *dirname, int32 raw_width, int32 raw_height, float frame_rate, uint32 thread_count, 
+                               int32 *width, int32 *height, EVX_FRAME_SOURCE *source)
+{
+    if (0 != sequence_play_file(dirname, raw_width, raw_height, frame_rate, thread_count, (int*) width, (int*) height))
+    {
+        evx_msg("Failed to open image sequence %s", dirname);
+        return -1;
+    }
+
+    source->refresh = sequence_refresh;
+    source->seek_frame = sequence_seek_frame;
+    source->copy_current_frame = sequence_copy_current_frame;
+    source->get_frame_time = sequence_get_frame_time;
+    source->get_frame_count = sequence_get_frame_count;
+    source->get_frame_rate = sequence_get_frame_rate;
+    source->deinitialize = sequence_deinitialize;
+
+    return 0;
+}
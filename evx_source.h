@@ -0,0 +1,117 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_source.h
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#ifndef __EVX_SOURCE_H__
+#define __EVX_SOURCE_H__
+
+#include "cairo/base.h"
+#include "evx_format.h"
+
+extern "C"
+{
+    int ffmpeg_initialize();
+    int ffmpeg_deinitialize();
+    int ffmpeg_reset();
+
+    int ffmpeg_play_file(char * filename, int *format, int *width, int *height);
+    int ffmpeg_copy_current_frame(unsigned char *dest, int row_pitch);
+    int ffmpeg_refresh(int *encoded_frame_size);
+    int ffmpeg_seek_frame(long long frame);
+
+    long long ffmpeg_get_frame_count();
+    float ffmpeg_get_frame_rate();
+    int ffmpeg_get_frame_time(long long *timestamp, int *duration);
+
+    int rawvideo_play_file(const char *filename, int width, int height, float frame_rate);
+    int rawvideo_deinitialize();
+    int rawvideo_copy_current_frame(unsigned char *dest, int row_pitch);
+    int rawvideo_refresh(int *encoded_frame_size);
+    int rawvideo_seek_frame(long long frame);
+
+    long long rawvideo_get_frame_count();
+    float rawvideo_get_frame_rate();
+    int rawvideo_get_frame_time(long long *timestamp, int *duration);
+
+    int sequence_play_file(const char *dirname, int raw_width, int raw_height, float frame_rate, int thread_count, int *width, int *height);
+    int sequence_deinitialize();
+    int sequence_copy_current_frame(unsigned char *dest, int row_pitch);
+    int sequence_refresh(int *encoded_frame_size);
+    int sequence_seek_frame(long long frame);
+
+    long long sequence_get_frame_count();
+    float sequence_get_frame_rate();
+    int sequence_get_frame_time(long long *timestamp, int *duration);
+
+} // extern "C"
+
+// Every frame source follows the ffmpeg_* calling conventions, so tools 
+// can ingest from any of them through a single table.
+
+typedef struct EVX_FRAME_SOURCE
+{
+    int (*refresh)(int *encoded_frame_size);
+
+    // Positions the source so that the next refresh returns the given frame.
+    // Frames in between are skipped as cheaply as the source allows.
+    int (*seek_frame)(long long frame);
+
+    int (*copy_current_frame)(unsigned char *dest, int row_pitch);
+
+    // Returns the presentation time and duration of the current frame, in
+    // microseconds. Sources without timestamps derive them from the rate.
+    int (*get_frame_time)(long long *timestamp, int *duration);
+
+    long long (*get_frame_count)();
+    float (*get_frame_rate)();
+    int (*deinitialize)();
+
+} EVX_FRAME_SOURCE;
+
+// Opens filename through ffmpeg and returns the content dimensions.
+int32 evx_open_ffmpeg_source(char *filename, int32 *width, int32 *height, EVX_FRAME_SOURCE *source);
+
+// Opens a headerless stream of top-down rgb24 frames. A filename of "-" 
+// reads from stdin.
+int32 evx_open_rawvideo_source(const char *filename, int32 width, int32 height, float frame_rate, EVX_FRAME_SOURCE *source);
+
+// Returns true if filename is a directory, which is ingested as an image 
+// sequence.
+bool evx_is_image_sequence(const char *filename);
+
+// Opens a directory of png, ppm or raw frames, ordered by the numbers in 
+// their names, and decodes them ahead on thread_count threads (one per 
+// hardware thread if zero). Raw frames require raw_width and raw_height;
+// other formats set the dimensions from the first frame.
+int32 evx_open_sequence_source(const char *dirname, int32 raw_width, int32 raw_height, float frame_rate, uint32 thread_count, 
+                               int32 *width, int32 *height, EVX_FRAME_SOURCE *source);
+
+#endif // __EVX_SOURCE_H__
@@ -0,0 +1,164 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_split.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "evx_format.h"
+#include "evx_index.h"
+#include "evx_remux.h"
+
+#if !defined(EVX_PLATFORM_WINDOWS)
+
+#include <vector>
+
+// Moves a requested cut back to the entry point at or before it, as that 
+// is the closest frame a new file can begin with.
+uint64 _align_cut(const EVX_REMUX_SOURCE &source, uint64 frame)
+{
+    uint64 entry_point = evx_query_entry_point(source.index, frame);
+
+    if (entry_point != frame)
+    {
+        evx_msg("Moved cut at frame %llu back to entry point %llu", frame, entry_point);
+    }
+
+    return entry_point;
+}
+
+int32 _write_segment(EVX_REMUX_SOURCE *source, const char *filename, uint64 first, uint64 last)
+{
+    EVX_REMUX_OUTPUT output;
+
+    if (evx_remux_open_output(filename, source->index.header, &output) < 0)
+    {
+        return -1;
+    }
+
+    int32 result = evx_remux_append(&output, source, first, last);
+
+    if (evx_remux_close_output(&output) < 0)
+    {
+        result = -1;
+    }
+
+    if (0 == result)
+    {
+        evx_msg("Wrote frames %llu to %llu to %s (%llu bytes copied in-kernel)", first, last, filename, output.payload_bytes);
+    }
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    EVX_REMUX_SOURCE source;
+    std::vector<uint64> cuts;
+    unsigned long long range_first = 0;
+    unsigned long long range_last = 0;
+    bool range = (argc > 1 && 0 == strcmp(argv[1], "-range"));
+
+    if ((range && (5 != argc || 2 != sscanf(argv[2], "%llu-%llu", &range_first, &range_last))) || (!range && argc < 4))
+    {
+        evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+        evx_msg("Required syntax: split <input_filename> <output_prefix> <cut_frame> [<cut_frame> ...]");
+        evx_msg("                 split -range <first>-<last> <input_filename> <output_filename>");
+        return 0;
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    const char *source_filename = range ? argv[3] : argv[1];
+
+    if (evx_remux_open_source(source_filename, &source) < 0 || source.index.frames.empty())
+    {
+        evx_msg("No frames could be indexed in %s", source_filename);
+        evx_remux_close_source(&source);
+        return 0;
+    }
+
+    uint64 frame_count = source.index.frames.size();
+
+    if (range)
+    {
+        if (range_first > range_last || range_first >= frame_count)
+        {
+            evx_msg("Invalid range %llu-%llu for %s (%llu frames)", range_first, range_last, source_filename, frame_count);
+        }
+        else
+        {
+            _write_segment(&source, argv[4], _align_cut(source, range_first), min((uint64) range_last, frame_count - 1));
+        }
+
+        evx_remux_close_source(&source);
+        return 0;
+    }
+
+    // Segments run from one cut to the next, beginning with frame zero.
+    cuts.push_back(0);
+
+    for (int32 i = 3; i < argc; i++)
+    {
+        uint64 cut = _align_cut(source, strtoull(argv[i], NULL, 10));
+
+        if (cut > cuts.back())
+        {
+            cuts.push_back(cut);
+        }
+    }
+
+    cuts.push_back(frame_count);
+
+    for (uint32 i = 0; i + 1 < cuts.size(); i++)
+    {
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s_%03i.evx", argv[2], i);
+
+        if (_write_segment(&source, filename, cuts[i], cuts[i + 1] - 1) < 0)
+        {
+            break;
+        }
+    }
+
+    evx_remux_close_source(&source);
+
+    return 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+    evx_msg("split is not available on this platform");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,320 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_thumbs.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "cairo/evx1.h"
+#include "cairo/image.h"
+#include "evx_format.h"
+#include "evx_reader.h"
+#include "evx_index.h"
+#include "evx_pool.h"
+#include "evx_scale.h"
+
+#include <math.h>
+
+#define EVX_THUMBS_DEFAULT_COUNT        (16)
+#define EVX_THUMBS_DEFAULT_WIDTH        (160)
+
+typedef struct EVX_THUMBS_OPTIONS
+{
+    const char *dest_path;
+    uint32 thumb_count;
+    uint32 thumb_width;
+    uint32 columns;
+    uint32 thread_count;
+
+} EVX_THUMBS_OPTIONS;
+
+typedef struct EVX_THUMBS_JOB
+{
+    EVX_THUMBS_OPTIONS *options;
+    char **filenames;
+    std::atomic<uint32> failed_count;
+    std::atomic<uint64> decoded_count;
+    std::atomic<uint64> total_count;
+
+} EVX_THUMBS_JOB;
+
+// Picks up to count entry points spread evenly over the stream. Each slot
+// takes the entry point nearest the middle of its span, so short streams
+// with few entry points simply produce fewer thumbnails.
+void _select_entry_points(const EVX_FRAME_INDEX &index, uint32 count, std::vector<uint64> *selected)
+{
+    uint64 frame_count = index.frames.size();
+
+    selected->clear();
+
+    for (uint32 i = 0; i < count; i++)
+    {
+        uint64 target = (2 * i + 1) * frame_count / (2 * count);
+        uint64 frame = evx_query_entry_point(index, target);
+
+        // Prefer the next entry point if it is closer to the target.
+        for (uint64 next = target + 1; next < frame_count && next - target < target - frame; next++)
+        {
+            if (index.frames[next].flags & EVX_FRAME_FLAG_ENTRY_POINT)
+            {
+                frame = next;
+                break;
+            }
+        }
+
+        if (selected->empty() || selected->back() < frame)
+        {
+            selected->push_back(frame);
+        }
+    }
+}
+
+void _prepare_sheet_filename(const char *dest_path, const char *source_filename, char *output, uint32 output_size)
+{
+    const char *name = strrchr(source_filename, '/');
+    name = name ? name + 1 : source_filename;
+
+    uint32 name_length = strlen(name);
+    const char *extension = strrchr(name, '.');
+
+    if (extension && extension != name)
+    {
+        name_length = extension - name;
+    }
+
+    snprintf(output, output_size, "%s/%.*s.ppm", dest_path, name_length, name);
+}
+
+int32 _write_sheet(const char *filename, image *sheet)
+{
+    FILE *file = fopen(filename, "wb");
+    uint32 width = sheet->query_width();
+    uint32 height = sheet->query_height();
+    bool result = true;
+
+    if (!file)
+    {
+        evx_msg("Error opening dest file %s", filename);
+        return -1;
+    }
+
+    fprintf(file, "P6\n%i %i\n255\n", width, height);
+
+    // Images are stored bottom-up, while ppm rows run top-down.
+    for (uint32 y = 0; y < height && result; y++)
+    {
+        uint8 *row = sheet->query_data() + (height - 1 - y) * sheet->query_row_pitch();
+        result = (1 == fwrite(row, width * 3, 1, file));
+    }
+
+    if (0 != fclose(file) || !result)
+    {
+        evx_msg("Error writing dest file %s", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Builds the sprite sheet for a single file. Only the record headers are 
+// read to find entry points, and only the selected frames are decoded.
+int32 _extract_thumbnails(EVX_THUMBS_OPTIONS *options, const char *filename, uint64 *decoded_count, uint64 *frame_count)
+{
+    EVX_FRAME_INDEX index;
+    EVX_READER reader;
+    image frame_image;
+    image sheet_image;
+    std::vector<uint64> selected;
+    char sheet_filename[1024];
+    int32 result = 0;
+
+    if (evx_build_frame_index(filename, &index) < 0 || index.frames.empty() ||
+        evx_reader_open(filename, &reader) < 0)
+    {
+        evx_msg("Skipping %s, no frames could be indexed", filename);
+        return -1;
+    }
+
+    uint32 frame_width = index.header.frame_width;
+    uint32 frame_height = index.header.frame_height;
+    uint32 thumb_width = options->thumb_width;
+    uint32 thumb_height = max((uint32) ((uint64) thumb_width * frame_height / frame_width), (uint32) 1);
+    uint32 columns = options->columns ? options->columns : (uint32) ceil(sqrt((double) options->thumb_count));
+    uint32 rows = (options->thumb_count + columns - 1) / columns;
+
+    create_image(EVX_IMAGE_FORMAT_R8G8B8, frame_width, frame_height, &frame_image);
+    create_image(EVX_IMAGE_FORMAT_R8G8B8, columns * thumb_width, rows * thumb_height, &sheet_image);
+    memset(sheet_image.query_data(), 0, sheet_image.query_row_pitch() * sheet_image.query_height());
+
+    _select_entry_points(index, options->thumb_count, &selected);
+
+    for (uint32 i = 0; i < selected.size(); i++)
+    {
+        const EVX_FRAME_ENTRY &entry = index.frames[selected[i]];
+
+        if (evx_reader_seek(&reader, entry.offset, entry.frame_index) < 0 ||
+            evx_reader_next_frame(&reader, &frame_image) < 0)
+        {
+            evx_msg("Error decoding frame %llu of %s", entry.frame_index, filename);
+            result = -1;
+            break;
+        }
+
+        // Thumbnails run left to right from the top of the sheet, which is
+        // the end of the bottom-up image.
+        uint32 sheet_pitch = sheet_image.query_row_pitch();
+        uint32 tile_x = (i % columns) * thumb_width;
+        uint32 tile_y = (rows - 1 - i / columns) * thumb_height;
+        uint8 *dest = sheet_image.query_data() + tile_y * sheet_pitch + tile_x * 3;
+
+        evx_box_filter(frame_image.query_data(), frame_width, frame_height, frame_image.query_row_pitch(), 
+                       dest, thumb_width, thumb_height, sheet_pitch);
+    }
+
+    if (0 == result)
+    {
+        _prepare_sheet_filename(options->dest_path, filename, sheet_filename, sizeof(sheet_filename));
+        result = _write_sheet(sheet_filename, &sheet_image);
+    }
+
+    if (0 == result)
+    {
+        evx_msg("Wrote %s (%i thumbnails from %llu frames)", sheet_filename, 
+                (int32) selected.size(), (uint64) index.frames.size());
+    }
+
+    *decoded_count = selected.size();
+    *frame_count = index.frames.size();
+
+    destroy_image(&sheet_image);
+    destroy_image(&frame_image);
+    evx_reader_close(&reader);
+
+    return result;
+}
+
+void _process_file(void *context, uint32 index)
+{
+    EVX_THUMBS_JOB *job = (EVX_THUMBS_JOB *) context;
+    uint64 decoded_count = 0;
+    uint64 frame_count = 0;
+
+    if (_extract_thumbnails(job->options, job->filenames[index], &decoded_count, &frame_count) < 0)
+    {
+        job->failed_count++;
+    }
+
+    job->decoded_count += decoded_count;
+    job->total_count += frame_count;
+}
+
+int32 _parse_options(int argc, char **argv, EVX_THUMBS_OPTIONS *options, int32 *first_source)
+{
+    int32 i = 1;
+
+    memset(options, 0, sizeof(EVX_THUMBS_OPTIONS));
+    options->thumb_count = EVX_THUMBS_DEFAULT_COUNT;
+    options->thumb_width = EVX_THUMBS_DEFAULT_WIDTH;
+
+    for (; i < argc && '-' == argv[i][0] && argv[i][1]; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            return -1;
+        }
+
+        if (0 == strcmp(argv[i], "-count"))
+        {
+            options->thumb_count = atoi(argv[i + 1]);
+        }
+        else if (0 == strcmp(argv[i], "-width"))
+        {
+            options->thumb_width = atoi(argv[i + 1]);
+        }
+        else if (0 == strcmp(argv[i], "-columns"))
+        {
+            options->columns = atoi(argv[i + 1]);
+        }
+        else if (0 == strcmp(argv[i], "-threads"))
+        {
+            options->thread_count = atoi(argv[i + 1]);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (argc - i < 2 || !options->thumb_count || !options->thumb_width)
+    {
+        return -1;
+    }
+
+    options->dest_path = argv[i];
+    *first_source = i + 1;
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    EVX_THUMBS_OPTIONS options;
+    EVX_THUMBS_JOB job;
+    EVX_THREAD_POOL pool;
+    int32 first_source = 0;
+
+    if (_parse_options(argc, argv, &options, &first_source) < 0)
+    {
+        evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+        evx_msg("Required syntax: thumbs [-count <thumbnails>] [-width <pixels>] [-columns <count>] [-threads <count>] "
+                "<output_directory> <input_filename> [<input_filename> ...]");
+        return 0;
+    }
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    uint32 file_count = argc - first_source;
+
+    job.options = &options;
+    job.filenames = argv + first_source;
+    job.failed_count = 0;
+    job.decoded_count = 0;
+    job.total_count = 0;
+
+    // Files are independent, so each task handles one file from start to 
+    // finish with its own reader and decoder.
+    evx_pool_open(options.thread_count, &pool);
+    evx_pool_run(&pool, _process_file, &job, file_count);
+    evx_pool_close(&pool);
+
+    evx_msg("Processed %i files (%i failed), decoded %llu of %llu frames", file_count, 
+            (uint32) job.failed_count, (uint64) job.decoded_count, (uint64) job.total_count);
+
+    return 0;
+}
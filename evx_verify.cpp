@@ -0,0 +1,282 @@
+
+/*
+// Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.
+//
+// evx_verify.cpp
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice, this
+//     list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+//   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+//   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+//   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Additional Information:
+//
+//   For more information, visit http://www.bertolami.com.
+*/
+
+#include "cairo/base.h"
+#include "cairo/evx1.h"
+#include "cairo/image.h"
+#include "evx_batch.h"
+#include "evx_format.h"
+#include "evx_index.h"
+#include "evx_reader.h"
+
+#include <chrono>
+#include <vector>
+
+// Scans whole libraries of files, checking that every frame record can be
+// read and matches its index, and optionally that every frame decodes. The
+// frames of all files are read through a single batch reader, so that the
+// scan is limited by storage rather than by the latency of each read.
+//
+// Returns 1 if any file failed, so the tool can be used from scripts.
+
+typedef std::chrono::steady_clock evx_clock;
+
+typedef struct EVX_VERIFY_OPTIONS
+{
+    uint32 depth;
+    bool decode;
+    int32 first_file;           // argv index of the first input file.
+
+} EVX_VERIFY_OPTIONS;
+
+typedef struct EVX_VERIFY_FILE
+{
+    const char *filename;
+    EVX_FRAME_INDEX index;
+    uint64 frames_read;
+    uint64 bytes_read;
+    uint64 error_count;
+    bool queued;
+
+    evx1_decoder *decoder;
+    image frame_image;
+    uint64 frames_decoded;
+
+} EVX_VERIFY_FILE;
+
+int32 _parse_options(int argc, char **argv, EVX_VERIFY_OPTIONS *options)
+{
+    int32 i = 1;
+
+    memset(options, 0, sizeof(EVX_VERIFY_OPTIONS));
+    options->depth = EVX_BATCH_DEFAULT_DEPTH;
+
+    for (; i < argc && '-' == argv[i][0]; i++)
+    {
+        if (0 == strcmp(argv[i], "-depth") && i < argc - 1)
+        {
+            options->depth = max(atoi(argv[++i]), 1);
+        }
+        else if (0 == strcmp(argv[i], "-decode"))
+        {
+            options->decode = true;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (i >= argc)
+    {
+        return -1;
+    }
+
+    options->first_file = i;
+
+    return 0;
+}
+
+int32 _check_frame(EVX_VERIFY_FILE *file, const EVX_BATCH_FRAME &frame, bit_stream *stream)
+{
+    EVX_MEDIA_FILE_HEADER *header = &file->index.header;
+
+    // Legacy files may carry any value in their frame headers.
+    if (EVX_MEDIA_VERSION_LEGACY != header->version && frame.header.frame_index != frame.frame_index)
+    {
+        evx_msg("%s: frame %llu is labelled %llu", file->filename, frame.frame_index, frame.header.frame_index);
+        return -1;
+    }
+
+    if (frame.header.frame_size > EVX_READER_MAX_FRAME_SIZE)
+    {
+        evx_msg("%s: frame %llu is too large (%u bytes)", file->filename, frame.frame_index, frame.header.frame_size);
+        return -1;
+    }
+
+    if (!file->decoder)
+    {
+        return 0;
+    }
+
+    if ((frame.header.flags & EVX_FRAME_FLAG_ENTRY_POINT) && file->frames_decoded)
+    {
+        destroy_decoder(file->decoder);
+        create_decoder(&file->decoder);
+        file->frames_decoded = 0;
+    }
+
+    stream->empty();
+    stream->write_bytes((void *) frame.payload, frame.header.frame_size);
+
+    evx_status status = file->decoder->decode(stream, file->frame_image.query_data());
+    file->frames_decoded++;
+
+    if (EVX_SUCCESS != status)
+    {
+        evx_msg("%s: frame %llu failed to decode", file->filename, frame.frame_index);
+        return -1;
+    }
+
+    return 0;
+}
+
+void _release_file(EVX_VERIFY_FILE *file)
+{
+    if (file->decoder)
+    {
+        destroy_decoder(file->decoder);
+        destroy_image(&file->frame_image);
+        file->decoder = NULL;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    EVX_VERIFY_OPTIONS options;
+    EVX_BATCH_READER reader;
+    EVX_BATCH_FRAME frame;
+    bit_stream stream;
+    uint64 total_bytes = 0;
+    uint32 failed_count = 0;
+
+    evx_msg("Copyright (c) 2010-2014 Joe Bertolami. All Right Reserved.");
+
+    if (_parse_options(argc, argv, &options) < 0)
+    {
+        evx_msg("Required syntax: verify [-depth <count>] [-decode] <input_filename> [input_filename ...]");
+        return 0;
+    }
+
+    std::vector<EVX_VERIFY_FILE> files(argc - options.first_file);
+
+    if (evx_batch_open(options.depth, &reader) < 0)
+    {
+        return 1;
+    }
+
+    if (options.decode)
+    {
+        stream.resize_capacity(EVX_READER_MAX_FRAME_SIZE << 3);
+    }
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        EVX_VERIFY_FILE *file = &files[i];
+
+        file->filename = argv[options.first_file + i];
+        file->frames_read = 0;
+        file->bytes_read = 0;
+        file->error_count = 0;
+        file->queued = false;
+        file->decoder = NULL;
+        file->frames_decoded = 0;
+
+        if (evx_build_frame_index(file->filename, &file->index) < 0)
+        {
+            evx_msg("%s: failed to index", file->filename);
+            file->error_count++;
+            continue;
+        }
+
+        if (evx_batch_add_file(&reader, file->filename, file->index) < 0)
+        {
+            file->error_count++;
+            continue;
+        }
+
+        file->queued = true;
+
+        if (options.decode)
+        {
+            create_image(EVX_IMAGE_FORMAT_R8G8B8, file->index.header.frame_width, file->index.header.frame_height, &file->frame_image);
+            create_decoder(&file->decoder);
+        }
+    }
+
+    // The batch reader numbers files in the order they were added, which
+    // skips any file that failed to index.
+    std::vector<EVX_VERIFY_FILE *> queued_files;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (files[i].queued)
+        {
+            queued_files.push_back(&files[i]);
+        }
+    }
+
+    evx_clock::time_point start_time = evx_clock::now();
+
+    while (true)
+    {
+        int32 result = evx_batch_next_frame(&reader, &frame);
+
+        if (result > 0)
+        {
+            break;
+        }
+
+        EVX_VERIFY_FILE *file = queued_files[frame.file];
+
+        if (result < 0 || _check_frame(file, frame, &stream) < 0)
+        {
+            file->error_count++;
+            continue;
+        }
+
+        file->frames_read++;
+        file->bytes_read += frame.header.header_size + frame.header.frame_size;
+        total_bytes += frame.header.header_size + frame.header.frame_size;
+    }
+
+    double elapsed = std::chrono::duration<double>(evx_clock::now() - start_time).count();
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        EVX_VERIFY_FILE *file = &files[i];
+
+        evx_msg("%s: %s, %llu frames, %.2f MB, %llu errors", file->filename, file->error_count ? "FAILED" : "ok", 
+            file->frames_read, file->bytes_read / (double) EVX_MB, file->error_count);
+
+        failed_count += (file->error_count ? 1 : 0);
+        _release_file(file);
+    }
+
+    evx_msg("Verified %u files (%u failed), %.2f MB in %.3f s, %.2f MB/s using %s", (uint32) files.size(), failed_count, 
+        total_bytes / (double) EVX_MB, elapsed, elapsed > 0.0 ? total_bytes / (double) EVX_MB / elapsed : 0.0, 
+        evx_batch_is_async(&reader) ? "io_uring" : "pread");
+
+    evx_batch_close(&reader);
+
+    return failed_count ? 1 : 0;
+}